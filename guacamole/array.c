@@ -0,0 +1,646 @@
+#include "array.h"
+#include "fuel.h"
+#include "mem.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && !defined(GUAC_NO_SIMD)
+#include <immintrin.h>
+#define ARRAY_SIMD 1
+#else
+#define ARRAY_SIMD 0
+#endif
+
+// Elements summed per pass of the split kernels, each 64 bit lane then adds less than 2^62
+#define SPLIT_BLOCK (1L << 28)
+// Arrays shorter than this are sorted by insertion
+#define SORT_INSERTION 48
+
+__extension__ typedef __int128 i128;
+
+static struct array *new_array(long size)
+{
+    struct array *a = mem_malloc(MEM_ARRAYS, sizeof(struct array) + size * sizeof(int64_t));
+    if (!a)
+        val_die("out of memory");
+
+    a->refs = 1;
+    a->size = size;
+    return a;
+}
+
+static value wrap(struct array *a)
+{
+    return (value)((uintptr_t)a + 3);
+}
+
+// What a failed array_of gives back, no index is in its range
+static struct array no_array = {1, 0};
+
+static struct array *array_of(value v, const char *msg)
+{
+    if (!val_is_array(v))
+    {
+        val_fail(msg);
+        return &no_array;
+    }
+
+    return val_array(v);
+}
+
+// 0 after an error
+static int element_of(value v, int64_t *x)
+{
+    long n;
+    if (!val_to_long(v, &n))
+    {
+        val_fail("array elements are 64 bit ints");
+        return 0;
+    }
+
+    *x = n;
+    return 1;
+}
+
+// -1 after an error
+static long index_of(struct array *a, value i)
+{
+    long n;
+    char msg[96];
+
+    if (!val_to_long(i, &n) || n < 0 || n >= a->size)
+    {
+        if (val_is_array(i) || val_is_str(i))
+            val_fail("an array index is an int");
+        else if (!val_is_small(i))
+            val_fail("index out of range");
+        else
+        {
+            snprintf(msg, sizeof(msg), "index %ld out of range for an array of %ld", val_untag(i), a->size);
+            val_fail(msg);
+        }
+        return -1;
+    }
+
+    return n;
+}
+
+static value val_from_i128(i128 x)
+{
+    if (x >= LONG_MIN && x <= LONG_MAX)
+        return val_from_long((long)x);
+
+    // x = high * 2^64 + low with low unsigned, low added 32 bits at a time
+    uint64_t low = (uint64_t)x;
+    value v = val_from_long((long)(x >> 64));
+    v = val_add(val_mul(v, VAL_SMALL(1L << 32)), VAL_SMALL((long)(low >> 32)));
+    return val_add(val_mul(v, VAL_SMALL(1L << 32)), VAL_SMALL((long)(low & 0xffffffff)));
+}
+
+value array_new(long size)
+{
+    struct array *a = new_array(size);
+    memset(a->items, 0, size * sizeof(int64_t));
+    return wrap(a);
+}
+
+value array_from(const value *vals, long n)
+{
+    struct array *a = new_array(n);
+    for (long i = 0; i < n; i++)
+    {
+        if (!element_of(vals[i], &a->items[i]))
+            a->items[i] = 0;
+    }
+
+    return wrap(a);
+}
+
+value array_get(value a, value i)
+{
+    struct array *arr = array_of(a, "only arrays can be indexed");
+    long k = index_of(arr, i);
+    return k < 0 ? 0 : val_from_long(arr->items[k]);
+}
+
+void array_set(value *slot, value i, value v)
+{
+    struct array *arr = array_of(*slot, "only arrays can be indexed");
+    long k = index_of(arr, i);
+    int64_t x;
+
+    if (k < 0 || !element_of(v, &x))
+        return;
+    if (arr->refs > 1)
+    {
+        struct array *copy = new_array(arr->size);
+        memcpy(copy->items, arr->items, arr->size * sizeof(int64_t));
+        val_assign(slot, wrap(copy));
+        arr = copy;
+    }
+
+    arr->items[k] = x;
+}
+
+int array_cmp(value a, value b)
+{
+    struct array *x = val_array(a);
+    struct array *y = val_array(b);
+    long n = x->size < y->size ? x->size : y->size;
+
+    for (long i = 0; i < n; i++)
+    {
+        if (x->items[i] != y->items[i])
+            return x->items[i] < y->items[i] ? -1 : 1;
+    }
+
+    return (x->size > y->size) - (x->size < y->size);
+}
+
+int array_fprint(FILE *f, value a)
+{
+    struct array *arr = val_array(a);
+    int n = fprintf(f, "[");
+
+    for (long i = 0; i < arr->size; i++)
+        n += fprintf(f, i ? ", %ld" : "%ld", (long)arr->items[i]);
+
+    return n + fprintf(f, "]");
+}
+
+// KERNELS
+//
+// Exact sums of int64 lanes : an element x is hi * 2^32 + lo - neg * 2^64 with hi
+// and lo its upper and lower 32 bits unsigned and neg its sign bit, three sums
+// that cannot overflow a lane for SPLIT_BLOCK elements.
+
+static i128 sum_scalar(const int64_t *x, long n)
+{
+    i128 s = 0;
+    for (long i = 0; i < n; i++)
+        s += x[i];
+
+    return s;
+}
+
+static void minmax_scalar(const int64_t *x, long n, int64_t *min, int64_t *max)
+{
+    int64_t lo = x[0];
+    int64_t hi = x[0];
+
+    for (long i = 1; i < n; i++)
+    {
+        lo = x[i] < lo ? x[i] : lo;
+        hi = x[i] > hi ? x[i] : hi;
+    }
+
+    *min = lo;
+    *max = hi;
+}
+
+// Exact, a partial sum leaving the i128 range is carried into a bignum
+static value dot_scalar(const int64_t *x, const int64_t *y, long n)
+{
+    value total = 0;
+    i128 acc = 0;
+
+    for (long i = 0; i < n; i++)
+    {
+        i128 p = (i128)x[i] * y[i];
+        i128 t;
+        if (__builtin_add_overflow(acc, p, &t))
+        {
+            total = val_add(total, val_from_i128(acc));
+            t = p;
+        }
+        acc = t;
+    }
+
+    return val_add(total, val_from_i128(acc));
+}
+
+static void fill_scalar(int64_t *x, long n, int64_t v)
+{
+    for (long i = 0; i < n; i++)
+        x[i] = v;
+}
+
+// 0 when a running sum overflows
+static int scan_scalar(const int64_t *x, int64_t *out, long n)
+{
+    int64_t run = 0;
+
+    for (long i = 0; i < n; i++)
+    {
+        if (__builtin_add_overflow(run, x[i], &run))
+            return 0;
+        out[i] = run;
+    }
+
+    return 1;
+}
+
+#if ARRAY_SIMD
+
+static int has_avx2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2"))) static i128 split_total(__m256i lo, __m256i hi, __m256i neg)
+{
+    uint64_t l[4], h[4], g[4];
+    i128 s = 0;
+
+    _mm256_storeu_si256((__m256i *)l, lo);
+    _mm256_storeu_si256((__m256i *)h, hi);
+    _mm256_storeu_si256((__m256i *)g, neg);
+    for (int k = 0; k < 4; k++)
+        s += ((i128)h[k] << 32) + l[k] - ((i128)g[k] << 64);
+
+    return s;
+}
+
+// lo, hi and neg of the split sum get v
+__attribute__((target("avx2"))) static inline void split_add(__m256i v, __m256i *lo, __m256i *hi, __m256i *neg)
+{
+    const __m256i mask = _mm256_set1_epi64x(0xffffffff);
+
+    *lo = _mm256_add_epi64(*lo, _mm256_and_si256(v, mask));
+    *hi = _mm256_add_epi64(*hi, _mm256_srli_epi64(v, 32));
+    *neg = _mm256_sub_epi64(*neg, _mm256_cmpgt_epi64(_mm256_setzero_si256(), v));
+}
+
+__attribute__((target("avx2"))) static i128 sum_avx2(const int64_t *x, long n)
+{
+    i128 s = 0;
+    long i = 0;
+
+    while (n - i >= 4)
+    {
+        long end = n - i > SPLIT_BLOCK ? i + SPLIT_BLOCK : n - (n - i) % 4;
+        __m256i lo = _mm256_setzero_si256(), hi = lo, neg = lo;
+
+        for (; i < end; i += 4)
+            split_add(_mm256_loadu_si256((const __m256i *)(x + i)), &lo, &hi, &neg);
+        s += split_total(lo, hi, neg);
+    }
+
+    return s + sum_scalar(x + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void minmax_avx2(const int64_t *x, long n, int64_t *min, int64_t *max)
+{
+    if (n < 8)
+    {
+        minmax_scalar(x, n, min, max);
+        return;
+    }
+
+    __m256i lo = _mm256_loadu_si256((const __m256i *)x);
+    __m256i hi = lo;
+    long i = 4;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+        lo = _mm256_blendv_epi8(lo, v, _mm256_cmpgt_epi64(lo, v));
+        hi = _mm256_blendv_epi8(hi, v, _mm256_cmpgt_epi64(v, hi));
+    }
+
+    int64_t l[4], h[4];
+    _mm256_storeu_si256((__m256i *)l, lo);
+    _mm256_storeu_si256((__m256i *)h, hi);
+    minmax_scalar(l, 4, min, max);
+    int64_t unused;
+    minmax_scalar(h, 4, &unused, max);
+
+    for (; i < n; i++)
+    {
+        *min = x[i] < *min ? x[i] : *min;
+        *max = x[i] > *max ? x[i] : *max;
+    }
+}
+
+// When every element fits 32 bits, products come from one multiply per lane and
+// are summed split. Otherwise the scalar kernel does it again with 128 bit products.
+__attribute__((target("avx2"))) static value dot_avx2(const int64_t *x, const int64_t *y, long n)
+{
+    const __m256i bias = _mm256_set1_epi64x(1L << 31);
+    __m256i wide = _mm256_setzero_si256();
+    i128 s = 0;
+    long i = 0;
+
+    while (n - i >= 4)
+    {
+        long end = n - i > SPLIT_BLOCK ? i + SPLIT_BLOCK : n - (n - i) % 4;
+        __m256i lo = _mm256_setzero_si256(), hi = lo, neg = lo;
+
+        for (; i < end; i += 4)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(x + i));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(y + i));
+            // x + 2^31 has its upper half set unless x is in [-2^31, 2^31)
+            wide = _mm256_or_si256(wide, _mm256_or_si256(_mm256_add_epi64(a, bias), _mm256_add_epi64(b, bias)));
+            split_add(_mm256_mul_epi32(a, b), &lo, &hi, &neg);
+        }
+        s += split_total(lo, hi, neg);
+    }
+
+    for (long k = i; k < n; k++)
+    {
+        if (x[k] != (int32_t)x[k] || y[k] != (int32_t)y[k])
+            return dot_scalar(x, y, n);
+    }
+    if (!_mm256_testz_si256(wide, _mm256_set1_epi64x(0xffffffff00000000L)))
+        return dot_scalar(x, y, n);
+
+    for (; i < n; i++)
+        s += (i128)x[i] * y[i];
+
+    return val_from_i128(s);
+}
+
+__attribute__((target("avx2"))) static void fill_avx2(int64_t *x, long n, int64_t v)
+{
+    __m256i w = _mm256_set1_epi64x(v);
+    long i = 0;
+
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_si256((__m256i *)(x + i), w);
+
+    fill_scalar(x + i, n - i, v);
+}
+
+// a + b, with the lanes that overflowed marked in the sign bits of ovf
+__attribute__((target("avx2"))) static inline __m256i add_marked(__m256i a, __m256i b, __m256i *ovf)
+{
+    __m256i r = _mm256_add_epi64(a, b);
+    *ovf = _mm256_or_si256(*ovf, _mm256_and_si256(_mm256_xor_si256(a, r), _mm256_xor_si256(b, r)));
+    return r;
+}
+
+// Running sums of 4 lanes in 2 shifted adds, then the last sum of the previous lanes.
+// A partial sum may overflow where the running sums do not : 0 sends the whole
+// array to the scalar kernel, which tells.
+__attribute__((target("avx2"))) static int scan_avx2(const int64_t *x, int64_t *out, long n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i carry = zero;
+    __m256i ovf = zero;
+    long i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+        // [0, x0, x1, x2] then [0, 0, s0, s1]
+        v = add_marked(v, _mm256_blend_epi32(_mm256_permute4x64_epi64(v, 0x90), zero, 0x03), &ovf);
+        v = add_marked(v, _mm256_permute2x128_si256(v, v, 0x08), &ovf);
+        v = add_marked(v, carry, &ovf);
+        _mm256_storeu_si256((__m256i *)(out + i), v);
+        carry = _mm256_permute4x64_epi64(v, 0xff);
+    }
+
+    if (!_mm256_testz_si256(ovf, _mm256_set1_epi64x(INT64_MIN)))
+        return 0;
+
+    int64_t run = i ? out[i - 1] : 0;
+    for (; i < n; i++)
+    {
+        if (__builtin_add_overflow(run, x[i], &run))
+            return 0;
+        out[i] = run;
+    }
+
+    return 1;
+}
+
+#endif
+
+static i128 sum_of(const int64_t *x, long n)
+{
+#if ARRAY_SIMD
+    if (has_avx2())
+        return sum_avx2(x, n);
+#endif
+    return sum_scalar(x, n);
+}
+
+static void minmax_of(const int64_t *x, long n, int64_t *min, int64_t *max)
+{
+#if ARRAY_SIMD
+    if (has_avx2())
+    {
+        minmax_avx2(x, n, min, max);
+        return;
+    }
+#endif
+    minmax_scalar(x, n, min, max);
+}
+
+static value dot_of(const int64_t *x, const int64_t *y, long n)
+{
+#if ARRAY_SIMD
+    if (has_avx2())
+        return dot_avx2(x, y, n);
+#endif
+    return dot_scalar(x, y, n);
+}
+
+static void fill_of(int64_t *x, long n, int64_t v)
+{
+#if ARRAY_SIMD
+    if (has_avx2())
+    {
+        fill_avx2(x, n, v);
+        return;
+    }
+#endif
+    fill_scalar(x, n, v);
+}
+
+static int scan_of(const int64_t *x, int64_t *out, long n)
+{
+#if ARRAY_SIMD
+    if (has_avx2() && scan_avx2(x, out, n))
+        return 1;
+#endif
+    return scan_scalar(x, out, n);
+}
+
+// Least significant byte first, on keys x - min whose order is the order of x :
+// only the bytes needed by max - min get a pass.
+static void radix_sort(int64_t *x, long n)
+{
+    int64_t min, max;
+    minmax_of(x, n, &min, &max);
+
+    uint64_t range = (uint64_t)max - (uint64_t)min;
+    int passes = 0;
+    while (passes < 8 && range >> (8 * passes))
+        passes += 1;
+    if (!passes)
+        return;
+    fuel_charge_words(n * passes);
+
+    uint64_t *src = (uint64_t *)x;
+    uint64_t *dst = mem_malloc(MEM_ARRAYS, n * sizeof(uint64_t));
+    long (*counts)[256] = mem_calloc(MEM_ARRAYS, passes, sizeof(long[256]));
+
+    if (!dst || !counts)
+        val_die("out of memory");
+
+    for (long i = 0; i < n; i++)
+    {
+        src[i] -= (uint64_t)min;
+        for (int b = 0; b < passes; b++)
+            counts[b][(src[i] >> (8 * b)) & 255] += 1;
+    }
+
+    for (int b = 0; b < passes; b++)
+    {
+        long at = 0;
+        for (int d = 0; d < 256; d++)
+        {
+            long c = counts[b][d];
+            counts[b][d] = at;
+            at += c;
+        }
+
+        for (long i = 0; i < n; i++)
+            dst[counts[b][(src[i] >> (8 * b)) & 255]++] = src[i];
+
+        uint64_t *t = src;
+        src = dst;
+        dst = t;
+    }
+
+    // an odd number of passes left the keys in the buffer
+    for (long i = 0; i < n; i++)
+        x[i] = (int64_t)(src[i] + (uint64_t)min);
+    if (src != (uint64_t *)x)
+        dst = src;
+
+    mem_free(MEM_ARRAYS, dst);
+    mem_free(MEM_ARRAYS, counts);
+}
+
+static void insertion_sort(int64_t *x, long n)
+{
+    for (long i = 1; i < n; i++)
+    {
+        int64_t v = x[i];
+        long j = i;
+        for (; j > 0 && x[j - 1] > v; j--)
+            x[j] = x[j - 1];
+        x[j] = v;
+    }
+}
+
+// BUILTINS
+
+value array_len(value a)
+{
+    return VAL_SMALL(array_of(a, "len expects an array")->size);
+}
+
+value array_sum(value a)
+{
+    struct array *arr = array_of(a, "sum expects an array");
+    fuel_charge_words(arr->size);
+    return val_from_i128(sum_of(arr->items, arr->size));
+}
+
+value array_min(value a)
+{
+    struct array *arr = array_of(a, "min expects an array");
+    int64_t min, max;
+
+    if (!arr->size)
+    {
+        val_fail("min of an empty array");
+        return 0;
+    }
+
+    fuel_charge_words(arr->size);
+    minmax_of(arr->items, arr->size, &min, &max);
+    return val_from_long(min);
+}
+
+value array_max(value a)
+{
+    struct array *arr = array_of(a, "max expects an array");
+    int64_t min, max;
+
+    if (!arr->size)
+    {
+        val_fail("max of an empty array");
+        return 0;
+    }
+
+    fuel_charge_words(arr->size);
+    minmax_of(arr->items, arr->size, &min, &max);
+    return val_from_long(max);
+}
+
+value array_dot(value a, value b)
+{
+    struct array *x = array_of(a, "dot expects two arrays");
+    struct array *y = array_of(b, "dot expects two arrays");
+
+    if (x->size != y->size)
+    {
+        val_fail("dot of arrays of different sizes");
+        return 0;
+    }
+
+    fuel_charge_words(x->size);
+    return dot_of(x->items, y->items, x->size);
+}
+
+value array_fill(value n, value v)
+{
+    long size;
+    int64_t x;
+
+    if (!val_to_long(n, &size) || size < 0 || size > LONG_MAX / (long)sizeof(int64_t))
+    {
+        val_fail("fill expects a size and an int");
+        return 0;
+    }
+    if (!element_of(v, &x))
+        return 0;
+
+    struct array *arr = new_array(size);
+    fuel_charge_words(size);
+    fill_of(arr->items, size, x);
+    return wrap(arr);
+}
+
+value array_scan(value a)
+{
+    struct array *arr = array_of(a, "scan expects an array");
+    struct array *out = new_array(arr->size);
+
+    fuel_charge_words(arr->size);
+    if (!scan_of(arr->items, out->items, arr->size))
+        val_fail("scan overflows 64 bit ints");
+
+    return wrap(out);
+}
+
+value array_sort(value a)
+{
+    struct array *arr = array_of(a, "sort expects an array");
+    struct array *out = new_array(arr->size);
+
+    memcpy(out->items, arr->items, arr->size * sizeof(int64_t));
+    fuel_charge_words(arr->size);
+    if (arr->size < SORT_INSERTION)
+        insertion_sort(out->items, arr->size);
+    else
+        radix_sort(out->items, arr->size);
+
+    return wrap(out);
+}
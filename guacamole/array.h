@@ -0,0 +1,57 @@
+#ifndef _ARRAY_H
+#define _ARRAY_H
+#include "bigint.h"
+
+// Arrays of 64 bit ints
+//
+// An array is a value like an int : a word ending in binary 11 points (plus 3)
+// to a reference counted block holding its elements back to back. Assigning an
+// array or passing it to a funk shares the block, a write copies it first while
+// another reference exists, so an array only changes through its own name.
+// Elements must fit an int64_t, anything else is a runtime error (val_fail).
+//
+// The builtins over whole arrays run AVX2 kernels when the CPU has them (x86-64,
+// unless built with -DGUAC_NO_SIMD) and scalar loops otherwise. Sums and dot
+// products are exact, they become bignums past the int64_t range.
+
+struct array
+{
+    int refs;
+    long size;
+    int64_t items[];
+};
+
+static inline struct array *val_array(value v)
+{
+    return (struct array *)(uintptr_t)(v - 3);
+}
+
+// size zeroed elements
+value array_new(long size);
+// Array of the n values of vals, which stay owned by the caller
+value array_from(const value *vals, long n);
+
+// Element i of a, a new reference. a and i are borrowed.
+value array_get(value a, value i);
+// Element i of the array in slot becomes v, slot gets a copy when it is shared. i and v are borrowed.
+void array_set(value *slot, value i, value v);
+
+// -1, 0 or 1 comparing a and b element by element, then by size. Both must be arrays.
+int array_cmp(value a, value b);
+// [1, 2, 3]
+int array_fprint(FILE *f, value a);
+
+// Builtins, their operands are borrowed and their result is a new reference
+value array_len(value a);
+value array_sum(value a);
+value array_min(value a);
+value array_max(value a);
+value array_dot(value a, value b);
+// Array of n elements equal to v
+value array_fill(value n, value v);
+// Running sums of a, element i is the sum of elements 0 to i
+value array_scan(value a);
+// Sorted copy of a
+value array_sort(value a);
+
+#endif /* _ARRAY_H */
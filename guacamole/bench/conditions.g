@@ -0,0 +1,54 @@
+// condition heavy loops : && / || chains and if/elif ladders on comparisons
+
+funk expensive(k)
+{
+    j = 0;
+    while (j < 20)
+    {
+        j = j + 1;
+    }
+    return k % 3 == 0;
+}
+
+funk classify(v)
+{
+    if (v < 10 || v > 90)
+    {
+        return 0;
+    }
+    elif (v >= 10 && v < 30)
+    {
+        return 1;
+    }
+    elif (v >= 30 && v < 60 && v != 45)
+    {
+        return 2;
+    }
+    else
+    {
+        return 3;
+    }
+}
+
+n = 200000;
+hits = 0;
+i = 0;
+while (i < n)
+{
+    // the right side only runs for one i in 50
+    if (i % 50 == 0 && expensive(i))
+    {
+        hits = hits + 1;
+    }
+    i = i + 1;
+}
+println(hits);
+
+sum = 0;
+i = 0;
+while (i < n && !(sum < 0))
+{
+    sum = sum + classify(i % 100);
+    i = i + 1;
+}
+println(sum);
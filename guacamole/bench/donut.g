@@ -0,0 +1,2 @@
+// donut frames per second : the renderer as a CPU bound smoke test
+donut(500);
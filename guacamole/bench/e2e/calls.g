@@ -0,0 +1,33 @@
+// call heavy code : many small funks calling each other, hot ones JIT compiled
+funk sq(x)
+{
+    return x * x;
+}
+
+funk add3(a, b, c)
+{
+    return a + b + c;
+}
+
+funk mix(a, b)
+{
+    return add3(sq(a), sq(b), a * b) % 1009;
+}
+
+funk step(v)
+{
+    if (v % 2 == 0)
+    {
+        return v / 2;
+    }
+    return 3 * v + 1;
+}
+
+t = 0;
+i = 0;
+while (i < 150000)
+{
+    t = (t + mix(i, t) + step(i)) % 100003;
+    i = i + 1;
+}
+println(t);
@@ -0,0 +1,12 @@
+// flags: --no-jit
+// recursive fib, interpreted : funk calls, scope copies and conditions
+funk fib(n)
+{
+    if (n < 2)
+    {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+
+println(fib(24));
@@ -0,0 +1,418 @@
+// many globals : every funk call copies and merges back a scope of 400 names
+
+g0 = 0;
+g1 = 1;
+g2 = 2;
+g3 = 3;
+g4 = 4;
+g5 = 5;
+g6 = 6;
+g7 = 7;
+g8 = 8;
+g9 = 9;
+g10 = 10;
+g11 = 11;
+g12 = 12;
+g13 = 13;
+g14 = 14;
+g15 = 15;
+g16 = 16;
+g17 = 17;
+g18 = 18;
+g19 = 19;
+g20 = 20;
+g21 = 21;
+g22 = 22;
+g23 = 23;
+g24 = 24;
+g25 = 25;
+g26 = 26;
+g27 = 27;
+g28 = 28;
+g29 = 29;
+g30 = 30;
+g31 = 31;
+g32 = 32;
+g33 = 33;
+g34 = 34;
+g35 = 35;
+g36 = 36;
+g37 = 37;
+g38 = 38;
+g39 = 39;
+g40 = 40;
+g41 = 41;
+g42 = 42;
+g43 = 43;
+g44 = 44;
+g45 = 45;
+g46 = 46;
+g47 = 47;
+g48 = 48;
+g49 = 49;
+g50 = 50;
+g51 = 51;
+g52 = 52;
+g53 = 53;
+g54 = 54;
+g55 = 55;
+g56 = 56;
+g57 = 57;
+g58 = 58;
+g59 = 59;
+g60 = 60;
+g61 = 61;
+g62 = 62;
+g63 = 63;
+g64 = 64;
+g65 = 65;
+g66 = 66;
+g67 = 67;
+g68 = 68;
+g69 = 69;
+g70 = 70;
+g71 = 71;
+g72 = 72;
+g73 = 73;
+g74 = 74;
+g75 = 75;
+g76 = 76;
+g77 = 77;
+g78 = 78;
+g79 = 79;
+g80 = 80;
+g81 = 81;
+g82 = 82;
+g83 = 83;
+g84 = 84;
+g85 = 85;
+g86 = 86;
+g87 = 87;
+g88 = 88;
+g89 = 89;
+g90 = 90;
+g91 = 91;
+g92 = 92;
+g93 = 93;
+g94 = 94;
+g95 = 95;
+g96 = 96;
+g97 = 97;
+g98 = 98;
+g99 = 99;
+g100 = 100;
+g101 = 101;
+g102 = 102;
+g103 = 103;
+g104 = 104;
+g105 = 105;
+g106 = 106;
+g107 = 107;
+g108 = 108;
+g109 = 109;
+g110 = 110;
+g111 = 111;
+g112 = 112;
+g113 = 113;
+g114 = 114;
+g115 = 115;
+g116 = 116;
+g117 = 117;
+g118 = 118;
+g119 = 119;
+g120 = 120;
+g121 = 121;
+g122 = 122;
+g123 = 123;
+g124 = 124;
+g125 = 125;
+g126 = 126;
+g127 = 127;
+g128 = 128;
+g129 = 129;
+g130 = 130;
+g131 = 131;
+g132 = 132;
+g133 = 133;
+g134 = 134;
+g135 = 135;
+g136 = 136;
+g137 = 137;
+g138 = 138;
+g139 = 139;
+g140 = 140;
+g141 = 141;
+g142 = 142;
+g143 = 143;
+g144 = 144;
+g145 = 145;
+g146 = 146;
+g147 = 147;
+g148 = 148;
+g149 = 149;
+g150 = 150;
+g151 = 151;
+g152 = 152;
+g153 = 153;
+g154 = 154;
+g155 = 155;
+g156 = 156;
+g157 = 157;
+g158 = 158;
+g159 = 159;
+g160 = 160;
+g161 = 161;
+g162 = 162;
+g163 = 163;
+g164 = 164;
+g165 = 165;
+g166 = 166;
+g167 = 167;
+g168 = 168;
+g169 = 169;
+g170 = 170;
+g171 = 171;
+g172 = 172;
+g173 = 173;
+g174 = 174;
+g175 = 175;
+g176 = 176;
+g177 = 177;
+g178 = 178;
+g179 = 179;
+g180 = 180;
+g181 = 181;
+g182 = 182;
+g183 = 183;
+g184 = 184;
+g185 = 185;
+g186 = 186;
+g187 = 187;
+g188 = 188;
+g189 = 189;
+g190 = 190;
+g191 = 191;
+g192 = 192;
+g193 = 193;
+g194 = 194;
+g195 = 195;
+g196 = 196;
+g197 = 197;
+g198 = 198;
+g199 = 199;
+g200 = 200;
+g201 = 201;
+g202 = 202;
+g203 = 203;
+g204 = 204;
+g205 = 205;
+g206 = 206;
+g207 = 207;
+g208 = 208;
+g209 = 209;
+g210 = 210;
+g211 = 211;
+g212 = 212;
+g213 = 213;
+g214 = 214;
+g215 = 215;
+g216 = 216;
+g217 = 217;
+g218 = 218;
+g219 = 219;
+g220 = 220;
+g221 = 221;
+g222 = 222;
+g223 = 223;
+g224 = 224;
+g225 = 225;
+g226 = 226;
+g227 = 227;
+g228 = 228;
+g229 = 229;
+g230 = 230;
+g231 = 231;
+g232 = 232;
+g233 = 233;
+g234 = 234;
+g235 = 235;
+g236 = 236;
+g237 = 237;
+g238 = 238;
+g239 = 239;
+g240 = 240;
+g241 = 241;
+g242 = 242;
+g243 = 243;
+g244 = 244;
+g245 = 245;
+g246 = 246;
+g247 = 247;
+g248 = 248;
+g249 = 249;
+g250 = 250;
+g251 = 251;
+g252 = 252;
+g253 = 253;
+g254 = 254;
+g255 = 255;
+g256 = 256;
+g257 = 257;
+g258 = 258;
+g259 = 259;
+g260 = 260;
+g261 = 261;
+g262 = 262;
+g263 = 263;
+g264 = 264;
+g265 = 265;
+g266 = 266;
+g267 = 267;
+g268 = 268;
+g269 = 269;
+g270 = 270;
+g271 = 271;
+g272 = 272;
+g273 = 273;
+g274 = 274;
+g275 = 275;
+g276 = 276;
+g277 = 277;
+g278 = 278;
+g279 = 279;
+g280 = 280;
+g281 = 281;
+g282 = 282;
+g283 = 283;
+g284 = 284;
+g285 = 285;
+g286 = 286;
+g287 = 287;
+g288 = 288;
+g289 = 289;
+g290 = 290;
+g291 = 291;
+g292 = 292;
+g293 = 293;
+g294 = 294;
+g295 = 295;
+g296 = 296;
+g297 = 297;
+g298 = 298;
+g299 = 299;
+g300 = 300;
+g301 = 301;
+g302 = 302;
+g303 = 303;
+g304 = 304;
+g305 = 305;
+g306 = 306;
+g307 = 307;
+g308 = 308;
+g309 = 309;
+g310 = 310;
+g311 = 311;
+g312 = 312;
+g313 = 313;
+g314 = 314;
+g315 = 315;
+g316 = 316;
+g317 = 317;
+g318 = 318;
+g319 = 319;
+g320 = 320;
+g321 = 321;
+g322 = 322;
+g323 = 323;
+g324 = 324;
+g325 = 325;
+g326 = 326;
+g327 = 327;
+g328 = 328;
+g329 = 329;
+g330 = 330;
+g331 = 331;
+g332 = 332;
+g333 = 333;
+g334 = 334;
+g335 = 335;
+g336 = 336;
+g337 = 337;
+g338 = 338;
+g339 = 339;
+g340 = 340;
+g341 = 341;
+g342 = 342;
+g343 = 343;
+g344 = 344;
+g345 = 345;
+g346 = 346;
+g347 = 347;
+g348 = 348;
+g349 = 349;
+g350 = 350;
+g351 = 351;
+g352 = 352;
+g353 = 353;
+g354 = 354;
+g355 = 355;
+g356 = 356;
+g357 = 357;
+g358 = 358;
+g359 = 359;
+g360 = 360;
+g361 = 361;
+g362 = 362;
+g363 = 363;
+g364 = 364;
+g365 = 365;
+g366 = 366;
+g367 = 367;
+g368 = 368;
+g369 = 369;
+g370 = 370;
+g371 = 371;
+g372 = 372;
+g373 = 373;
+g374 = 374;
+g375 = 375;
+g376 = 376;
+g377 = 377;
+g378 = 378;
+g379 = 379;
+g380 = 380;
+g381 = 381;
+g382 = 382;
+g383 = 383;
+g384 = 384;
+g385 = 385;
+g386 = 386;
+g387 = 387;
+g388 = 388;
+g389 = 389;
+g390 = 390;
+g391 = 391;
+g392 = 392;
+g393 = 393;
+g394 = 394;
+g395 = 395;
+g396 = 396;
+g397 = 397;
+g398 = 398;
+g399 = 399;
+
+funk touch(k)
+{
+    g0 = g0 + k;
+    return g399 + k;
+}
+
+s = 0;
+i = 0;
+while (i < 8000)
+{
+    s = s + touch(i) + g200;
+    i = i + 1;
+}
+println(s);
+println(g0);
@@ -0,0 +1,14 @@
+// nested while loops over arithmetic, no funk call
+s = 0;
+i = 0;
+while (i < 600)
+{
+    j = 0;
+    while (j < 600)
+    {
+        s = (s + i * j + j % 7) % 1000003;
+        j = j + 1;
+    }
+    i = i + 1;
+}
+println(s);
@@ -0,0 +1,7 @@
+// print heavy output : one println per iteration
+i = 0;
+while (i < 200000)
+{
+    println(i * 7919 % 100003);
+    i = i + 1;
+}
@@ -0,0 +1,18 @@
+// deep recursion : thousands of nested funk frames, interpreted and JIT compiled
+funk depth(n)
+{
+    if (n == 0)
+    {
+        return 0;
+    }
+    return 1 + depth(n - 1);
+}
+
+s = 0;
+i = 0;
+while (i < 1000)
+{
+    s = s + depth(2000);
+    i = i + 1;
+}
+println(s);
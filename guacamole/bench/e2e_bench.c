@@ -0,0 +1,292 @@
+// End to end benchmark : run .g workloads through the compiler binary
+// After warmup runs, times each workload over repeated runs and reports the
+// median, the 95th percentile and the peak RSS. Results are compared against a
+// baseline file, a median or a peak RSS above it by more than the threshold fails,
+// so does a missing baseline or a workload it has no entry for, or a run that exits non 0.
+// A workload whose first lines hold `// flags: ...` runs with those options.
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_FLAGS 8
+#define MAX_NAME 64
+
+struct result
+{
+    char name[MAX_NAME];
+    double median;
+    double p95;
+    long rss;
+};
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int by_value(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Options of the `// flags:` comment of path, in argv from index 1
+static int read_flags(const char *path, char *buf, size_t size, char **argv)
+{
+    FILE *f = fopen(path, "r");
+    int argc = 1;
+
+    if (!f)
+        return -1;
+
+    while (fgets(buf, size, f) && !strncmp(buf, "//", 2))
+    {
+        if (strncmp(buf, "// flags:", 9))
+            continue;
+
+        for (char *tok = strtok(buf + 9, " \t\n"); tok && argc <= MAX_FLAGS; tok = strtok(NULL, " \t\n"))
+            argv[argc++] = tok;
+        break;
+    }
+
+    fclose(f);
+    return argc;
+}
+
+// One run of argv, its wall time in ms and peak RSS in KB. Returns 0 if it crashed.
+static int run_once(char **argv, double *ms, long *rss)
+{
+    double start = now_ms();
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage ru;
+    if (pid < 0 || wait4(pid, &status, 0, &ru) < 0)
+        return 0;
+
+    *ms = now_ms() - start;
+    *rss = ru.ru_maxrss;
+
+    // a runtime error exits with 1, a spent budget with 124 and a failed exec with 127
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static int bench(const char *compiler, const char *path, int warmup, int runs, struct result *res)
+{
+    char flags[256];
+    char *argv[MAX_FLAGS + 3];
+    int argc = read_flags(path, flags, sizeof(flags), argv);
+
+    if (argc < 0)
+    {
+        fprintf(stderr, "cannot read %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    argv[0] = (char *)compiler;
+    argv[argc++] = (char *)path;
+    argv[argc] = NULL;
+
+    const char *name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    snprintf(res->name, MAX_NAME, "%s", name);
+
+    double *times = calloc(runs, sizeof(double));
+    res->rss = 0;
+    for (int i = 0; i < warmup + runs; i++)
+    {
+        double ms;
+        long rss;
+        if (!run_once(argv, &ms, &rss))
+        {
+            fprintf(stderr, "%s: %s failed\n", name, compiler);
+            free(times);
+            return 0;
+        }
+
+        if (i >= warmup)
+        {
+            times[i - warmup] = ms;
+            res->rss = rss > res->rss ? rss : res->rss;
+        }
+    }
+
+    qsort(times, runs, sizeof(double), by_value);
+    res->median = runs % 2 ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2;
+    // nearest rank
+    res->p95 = times[(95 * runs + 99) / 100 - 1];
+
+    free(times);
+    return 1;
+}
+
+// Baseline entry of name, 0 if there is none
+static int find_baseline(const char *file, const char *name, struct result *base)
+{
+    FILE *f = fopen(file, "r");
+    char line[256];
+    int found = 0;
+
+    if (!f)
+        return 0;
+
+    while (!found && fgets(line, sizeof(line), f))
+    {
+        if (line[0] == '#')
+            continue;
+
+        found = sscanf(line, "%63s %lf %lf %ld", base->name, &base->median, &base->p95, &base->rss) == 4
+                && !strcmp(base->name, name);
+    }
+
+    fclose(f);
+    return found;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-w warmup] [-r runs] [-t threshold %%] [-b baseline] [-s] compiler file.g...\n",
+            name);
+    fprintf(stderr, "  -s  write the results to the baseline file instead of comparing\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int warmup = 2;
+    int runs = 11;
+    double threshold = 10;
+    const char *baseline = NULL;
+    int save = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "w:r:t:b:s")) != -1)
+    {
+        switch (opt)
+        {
+        case 'w':
+            warmup = atoi(optarg);
+            break;
+        case 'r':
+            runs = atoi(optarg) > 0 ? atoi(optarg) : 1;
+            break;
+        case 't':
+            threshold = atof(optarg);
+            break;
+        case 'b':
+            baseline = optarg;
+            break;
+        case 's':
+            save = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (optind + 1 >= argc || (save && !baseline))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // comparing against nothing would pass whatever the timings
+    if (baseline && !save && access(baseline, R_OK))
+    {
+        fprintf(stderr, "cannot read baseline %s: %s (make bench_baseline writes it)\n", baseline, strerror(errno));
+        return 2;
+    }
+
+    // stay on one CPU, migrations are the largest source of noise between runs
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(sched_getcpu(), &set);
+    sched_setaffinity(0, sizeof(set), &set);
+
+    const char *compiler = argv[optind];
+    int count = argc - optind - 1;
+    struct result *results = calloc(count, sizeof(struct result));
+    int failed = 0;
+    int missing = 0;
+
+    printf("%-16s %10s %10s %10s %10s %10s %8s\n", "workload", "median ms", "p95 ms", "rss KB", "base ms",
+           "base KB", "change");
+
+    for (int i = 0; i < count; i++)
+    {
+        struct result *res = &results[i];
+        struct result base;
+
+        if (!bench(compiler, argv[optind + 1 + i], warmup, runs, res))
+            return 2;
+
+        printf("%-16s %10.2f %10.2f %10ld", res->name, res->median, res->p95, res->rss);
+
+        if (save || !baseline)
+        {
+            printf("\n");
+            continue;
+        }
+
+        if (!find_baseline(baseline, res->name, &base))
+        {
+            printf("  NO BASELINE\n");
+            missing++;
+            continue;
+        }
+
+        double change = 100 * (res->median - base.median) / base.median;
+        int slower = change > threshold;
+        int bigger = res->rss > base.rss * (1 + threshold / 100);
+
+        printf(" %10.2f %10ld %+7.1f%%%s%s\n", base.median, base.rss, change, slower ? "  SLOWER" : "",
+               bigger ? "  RSS" : "");
+        failed |= slower || bigger;
+    }
+
+    if (save)
+    {
+        FILE *f = fopen(baseline, "w");
+        if (!f)
+        {
+            fprintf(stderr, "cannot write %s: %s\n", baseline, strerror(errno));
+            return 2;
+        }
+
+        fprintf(f, "# workload median_ms p95_ms rss_kb\n");
+        for (int i = 0; i < count; i++)
+            fprintf(f, "%s %.3f %.3f %ld\n", results[i].name, results[i].median, results[i].p95, results[i].rss);
+        fclose(f);
+        printf("\nbaseline written to %s\n", baseline);
+    }
+    else
+    {
+        if (failed)
+            printf("\nregression above %.1f%% against %s\n", threshold, baseline);
+        if (missing)
+            printf("\n%d workload%s not in %s, run make bench_baseline\n", missing, missing > 1 ? "s" : "", baseline);
+    }
+
+    free(results);
+    return failed || missing;
+}
@@ -0,0 +1,7 @@
+// println throughput : a million lines
+i = 0;
+while (i < 1000000)
+{
+    println(i * 7919);
+    i = i + 1;
+}
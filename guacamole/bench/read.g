@@ -0,0 +1,10 @@
+// read_int throughput : sums the ints of stdin
+s = 0;
+n = 0;
+while (!eof())
+{
+    s = s + read_int();
+    n = n + 1;
+}
+println(n);
+println(s);
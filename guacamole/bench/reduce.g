@@ -0,0 +1,25 @@
+// reduce over a CPU bound funk : collatz steps of 1 to 300000
+funk collatz(n)
+{
+    c = 0;
+    while (n != 1)
+    {
+        if (n % 2 == 0)
+        {
+            n = n / 2;
+        }
+        else
+        {
+            n = 3 * n + 1;
+        }
+        c = c + 1;
+    }
+    return c;
+}
+
+funk steps(i)
+{
+    return collatz(i + 1);
+}
+
+println(reduce(steps, 0, 300000, "+"));
@@ -0,0 +1,108 @@
+// Microbenchmark : scope lookups against definition count
+// Compares the hash table of scope.c with the former linked def_list scan.
+#include "../scope.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOOKUPS 2000000
+
+struct linear_def
+{
+    const char *name;
+    struct linear_def *next;
+};
+
+static struct linear_def *linear_get(struct linear_def *l, const char *name)
+{
+    for (; l; l = l->next)
+    {
+        if (!strcmp(l->name, name))
+            return l;
+    }
+
+    return NULL;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void)
+{
+    int counts[] = {10, 100, 1000, 10000};
+
+    printf("%8s %14s %14s\n", "defs", "table ns/op", "linear ns/op");
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    {
+        int n = counts[c];
+        char **names = calloc(n, sizeof(char *));
+        unsigned int *hashes = calloc(n, sizeof(unsigned int));
+        struct linear_def *list = NULL;
+        struct scope s;
+
+        init_scope(&s);
+        for (int i = 0; i < n; i++)
+        {
+            names[i] = calloc(16, sizeof(char));
+            snprintf(names[i], 16, "var_%d", i);
+            hashes[i] = hash_name(names[i]);
+            putdef(&s, names[i], hashes[i])->val.intval = i;
+
+            struct linear_def *l = calloc(1, sizeof(struct linear_def));
+            l->name = names[i];
+            l->next = list;
+            list = l;
+        }
+
+        // lookups use distinct copies so pointer equality cannot short-circuit strcmp
+        char **keys = calloc(n, sizeof(char *));
+        for (int i = 0; i < n; i++)
+            keys[i] = strdup(names[i]);
+
+        long sum = 0;
+        double t0 = now_ns();
+        for (int i = 0; i < LOOKUPS; i++)
+        {
+            int k = (int)(((unsigned int)i * 7919u) % n);
+            sum += getdef_hashed(&s, keys[k], hashes[k])->val.intval;
+        }
+        double table_ns = (now_ns() - t0) / LOOKUPS;
+
+        int linear_lookups = LOOKUPS / (n / 10 + 1);
+        t0 = now_ns();
+        for (int i = 0; i < linear_lookups; i++)
+        {
+            int k = (int)(((unsigned int)i * 7919u) % n);
+            sum += linear_get(list, keys[k]) != NULL;
+        }
+        double linear_ns = (now_ns() - t0) / linear_lookups;
+
+        printf("%8d %14.1f %14.1f\n", n, table_ns, linear_ns);
+        if (sum == -1)
+            printf("\n");
+
+        while (list)
+        {
+            struct linear_def *tmp = list->next;
+            free(list);
+            list = tmp;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            free(names[i]);
+            free(keys[i]);
+        }
+        free(names);
+        free(keys);
+        free(hashes);
+        clean_scope(&s);
+    }
+
+    return 0;
+}
@@ -0,0 +1,989 @@
+#include "bigint.h"
+#include "array.h"
+#include "fuel.h"
+#include "mem.h"
+#include "out.h"
+#include "str.h"
+#include <limits.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Limbs of the smaller operand from which multiplication splits in halves
+#define KARATSUBA_THRESHOLD 32
+
+// Past this many limbs val_str splits the magnitude by powers of 10, below it divides by
+// 10^9 pass after pass, which takes n^2; the halves split down to CONV_LEAF limbs
+#define CONV_THRESHOLD 768
+#define CONV_LEAF 64
+
+// Past this many limbs a reciprocal is refined by a Newton step rather than divided out
+#define RECIP_THRESHOLD 48
+
+// Sign and magnitude of any value, small ones laid out in buf
+struct view
+{
+    int sign;
+    int size;
+    const uint32_t *limbs;
+    uint32_t buf[2];
+};
+
+static void view_of(value v, struct view *w)
+{
+    if (val_is_small(v))
+    {
+        long n = val_untag(v);
+        unsigned long m = n < 0 ? -(unsigned long)n : (unsigned long)n;
+
+        w->sign = n < 0 ? -1 : 1;
+        w->buf[0] = (uint32_t)m;
+        w->buf[1] = (uint32_t)(m >> 32);
+        w->size = w->buf[1] ? 2 : w->buf[0] ? 1 : 0;
+        w->limbs = w->buf;
+    }
+    else
+    {
+        if (val_is_array(v) || val_is_str(v))
+        {
+            val_fail(val_is_array(v) ? "an array is not a number" : "a string is not a number");
+            // as 0
+            w->sign = 1;
+            w->size = 0;
+            w->limbs = w->buf;
+            return;
+        }
+
+        struct bignum *b = val_big(v);
+        w->sign = b->sign;
+        w->size = b->size;
+        w->limbs = b->limbs;
+    }
+}
+
+static struct bignum *big_new(int size)
+{
+    struct bignum *b = mem_malloc(MEM_BIGNUM, sizeof(struct bignum) + (size + 1) * sizeof(uint32_t));
+    b->refs = 1;
+    b->sign = 1;
+    b->size = size;
+    return b;
+}
+
+// Trim b and demote it when it fits a small int
+static value finish(struct bignum *b)
+{
+    while (b->size && !b->limbs[b->size - 1])
+        b->size -= 1;
+
+    if (b->size <= 2)
+    {
+        unsigned long m = b->limbs[0];
+        if (b->size == 0)
+            m = 0;
+        else if (b->size == 2)
+            m |= (unsigned long)b->limbs[1] << 32;
+
+        if (b->sign > 0 ? m <= (unsigned long)VAL_SMALL_MAX : m <= -(unsigned long)VAL_SMALL_MIN)
+        {
+            long n = b->sign > 0 ? (long)m : -(long)(m - 1) - 1;
+            mem_free(MEM_BIGNUM, b);
+            return VAL_SMALL(n);
+        }
+    }
+
+    return (value)((uintptr_t)b + 1);
+}
+
+void val_release(value v)
+{
+    mem_free(val_is_array(v) ? MEM_ARRAYS : val_is_str(v) ? MEM_STRINGS : MEM_BIGNUM, val_refs(v));
+}
+
+void val_fail(const char *msg)
+{
+    if (!fuel_fail(msg))
+        val_die(msg);
+}
+
+void val_die(const char *msg)
+{
+    // the workers of a reduce may fail together, the first one reports and exits
+    static atomic_flag failing = ATOMIC_FLAG_INIT;
+    while (atomic_flag_test_and_set(&failing))
+        pause();
+
+    out_flush_pending();
+    fflush(stdout);
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+value val_copy(value v)
+{
+    if (!val_is_boxed(v))
+        return v;
+
+    if (val_is_array(v))
+    {
+        struct array *a = val_array(v);
+        value copy = array_new(a->size);
+        memcpy(val_array(copy)->items, a->items, a->size * sizeof(int64_t));
+        return copy;
+    }
+
+    if (val_is_str(v))
+        return str_new(val_string(v)->data, val_string(v)->size);
+
+    struct bignum *b = val_big(v), *copy = big_new(b->size);
+    copy->sign = b->sign;
+    memcpy(copy->limbs, b->limbs, b->size * sizeof(uint32_t));
+    return (value)((uintptr_t)copy + 1);
+}
+
+value val_from_long(long n)
+{
+    if (n >= VAL_SMALL_MIN && n <= VAL_SMALL_MAX)
+        return VAL_SMALL(n);
+
+    unsigned long m = n < 0 ? -(unsigned long)n : (unsigned long)n;
+    struct bignum *b = big_new(2);
+    b->sign = n < 0 ? -1 : 1;
+    b->limbs[0] = (uint32_t)m;
+    b->limbs[1] = (uint32_t)(m >> 32);
+    return finish(b);
+}
+
+int val_to_long(value v, long *out)
+{
+    if (val_is_small(v))
+    {
+        *out = val_untag(v);
+        return 1;
+    }
+
+    if (val_is_array(v) || val_is_str(v))
+        return 0;
+
+    struct bignum *b = val_big(v);
+    if (b->size > 2)
+        return 0;
+
+    unsigned long m = b->limbs[0] | (b->size == 2 ? (unsigned long)b->limbs[1] << 32 : 0);
+    if (b->sign > 0 ? m > LONG_MAX : m > -(unsigned long)LONG_MIN)
+        return 0;
+
+    *out = b->sign > 0 ? (long)m : -(long)(m - 1) - 1;
+    return 1;
+}
+
+// MAGNITUDES
+
+static int mag_cmp(const uint32_t *a, int an, const uint32_t *b, int bn)
+{
+    if (an != bn)
+        return an < bn ? -1 : 1;
+
+    for (int i = an - 1; i >= 0; i--)
+    {
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    }
+
+    return 0;
+}
+
+// x += y with yn <= xn, returns the carry out of x
+static uint32_t mag_add_in(uint32_t *x, int xn, const uint32_t *y, int yn)
+{
+    uint64_t carry = 0;
+
+    for (int i = 0; i < xn && (i < yn || carry); i++)
+    {
+        carry += (uint64_t)x[i] + (i < yn ? y[i] : 0);
+        x[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+
+    return carry;
+}
+
+// x -= y with x >= y
+static void mag_sub_in(uint32_t *x, int xn, const uint32_t *y, int yn)
+{
+    int64_t borrow = 0;
+
+    for (int i = 0; i < xn && (i < yn || borrow); i++)
+    {
+        int64_t t = (int64_t)x[i] - (i < yn ? y[i] : 0) - borrow;
+        borrow = t < 0;
+        x[i] = (uint32_t)(t + (borrow << 32));
+    }
+}
+
+static void mag_mul_school(uint32_t *r, const uint32_t *a, int an, const uint32_t *b, int bn)
+{
+    fuel_charge_words((long)an * bn);
+    memset(r, 0, (an + bn) * sizeof(uint32_t));
+
+    for (int i = 0; i < bn; i++)
+    {
+        uint64_t carry = 0;
+        for (int j = 0; j < an; j++)
+        {
+            carry += (uint64_t)a[j] * b[i] + r[i + j];
+            r[i + j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        r[i + an] = (uint32_t)carry;
+    }
+}
+
+// r (an + bn limbs) = a * b, Karatsuba when both operands are large
+static void mag_mul(uint32_t *r, const uint32_t *a, int an, const uint32_t *b, int bn)
+{
+    if (an < bn)
+    {
+        const uint32_t *t = a;
+        a = b;
+        b = t;
+        int tn = an;
+        an = bn;
+        bn = tn;
+    }
+
+    if (bn < KARATSUBA_THRESHOLD)
+    {
+        mag_mul_school(r, a, an, b, bn);
+        return;
+    }
+
+    int m = (an + 1) / 2;
+
+    if (bn <= m)
+    {
+        // unbalanced : a0 * b + (a1 * b << m)
+        uint32_t *t = mem_malloc(MEM_BIGNUM, (an - m + bn) * sizeof(uint32_t));
+        mag_mul(r, a, m, b, bn);
+        memset(r + m + bn, 0, (an - m) * sizeof(uint32_t));
+        mag_mul(t, a + m, an - m, b, bn);
+        mag_add_in(r + m, an + bn - m, t, an - m + bn);
+        mem_free(MEM_BIGNUM, t);
+        return;
+    }
+
+    // a = a1 B^m + a0, b = b1 B^m + b0 : z1 = (a0 + a1)(b0 + b1) - z0 - z2
+    int a1n = an - m;
+    int b1n = bn - m;
+    uint32_t *sa = mem_malloc(MEM_BIGNUM, (m + 1) * sizeof(uint32_t));
+    uint32_t *sb = mem_malloc(MEM_BIGNUM, (m + 1) * sizeof(uint32_t));
+    uint32_t *z1 = mem_malloc(MEM_BIGNUM, (2 * m + 2) * sizeof(uint32_t));
+
+    mag_mul(r, a, m, b, m);
+    mag_mul(r + 2 * m, a + m, a1n, b + m, b1n);
+
+    memcpy(sa, a, m * sizeof(uint32_t));
+    sa[m] = mag_add_in(sa, m, a + m, a1n);
+    memcpy(sb, b, m * sizeof(uint32_t));
+    sb[m] = mag_add_in(sb, m, b + m, b1n);
+
+    mag_mul(z1, sa, m + 1, sb, m + 1);
+    mag_sub_in(z1, 2 * m + 2, r, 2 * m);
+    mag_sub_in(z1, 2 * m + 2, r + 2 * m, a1n + b1n);
+
+    int zn = 2 * m + 2;
+    while (zn && !z1[zn - 1])
+        zn -= 1;
+    mag_add_in(r + m, an + bn - m, z1, zn);
+
+    mem_free(MEM_BIGNUM, sa);
+    mem_free(MEM_BIGNUM, sb);
+    mem_free(MEM_BIGNUM, z1);
+}
+
+// q (un - vn + 1 limbs) and r (vn limbs, may be NULL) of u / v, vn > 0, un >= vn
+// Knuth's algorithm D
+static void mag_divmod(const uint32_t *u, int un, const uint32_t *v, int vn, uint32_t *q, uint32_t *r)
+{
+    if (vn == 1)
+    {
+        uint64_t k = 0;
+        for (int j = un - 1; j >= 0; j--)
+        {
+            uint64_t t = k << 32 | u[j];
+            q[j] = (uint32_t)(t / v[0]);
+            k = t % v[0];
+        }
+        if (r)
+            r[0] = (uint32_t)k;
+        return;
+    }
+
+    int s = __builtin_clz(v[vn - 1]);
+    uint32_t *nv = mem_malloc(MEM_BIGNUM, vn * sizeof(uint32_t));
+    uint32_t *nu = mem_malloc(MEM_BIGNUM, (un + 1) * sizeof(uint32_t));
+
+    for (int i = vn - 1; i > 0; i--)
+        nv[i] = (v[i] << s) | (s ? v[i - 1] >> (32 - s) : 0);
+    nv[0] = v[0] << s;
+
+    nu[un] = s ? u[un - 1] >> (32 - s) : 0;
+    for (int i = un - 1; i > 0; i--)
+        nu[i] = (u[i] << s) | (s ? u[i - 1] >> (32 - s) : 0);
+    nu[0] = u[0] << s;
+
+    for (int j = un - vn; j >= 0; j--)
+    {
+        uint64_t num = (uint64_t)nu[j + vn] << 32 | nu[j + vn - 1];
+        uint64_t qhat = num / nv[vn - 1];
+        uint64_t rhat = num % nv[vn - 1];
+
+        while (qhat >> 32 || qhat * nv[vn - 2] > (rhat << 32 | nu[j + vn - 2]))
+        {
+            qhat -= 1;
+            rhat += nv[vn - 1];
+            if (rhat >> 32)
+                break;
+        }
+
+        int64_t k = 0;
+        int64_t t;
+        for (int i = 0; i < vn; i++)
+        {
+            uint64_t p = qhat * nv[i];
+            t = (int64_t)nu[i + j] - k - (int64_t)(p & 0xffffffff);
+            nu[i + j] = (uint32_t)t;
+            k = (int64_t)(p >> 32) - (t >> 32);
+        }
+        t = (int64_t)nu[j + vn] - k;
+        nu[j + vn] = (uint32_t)t;
+
+        q[j] = (uint32_t)qhat;
+        if (t < 0)
+        {
+            // qhat was one too large, add v back
+            q[j] -= 1;
+            uint64_t c = 0;
+            for (int i = 0; i < vn; i++)
+            {
+                c += (uint64_t)nu[i + j] + nv[i];
+                nu[i + j] = (uint32_t)c;
+                c >>= 32;
+            }
+            nu[j + vn] += (uint32_t)c;
+        }
+    }
+
+    if (r)
+    {
+        for (int i = 0; i < vn; i++)
+            r[i] = (nu[i] >> s) | (s ? nu[i + 1] << (32 - s) : 0);
+    }
+
+    mem_free(MEM_BIGNUM, nv);
+    mem_free(MEM_BIGNUM, nu);
+}
+
+// OPERATIONS
+
+static value add_signed(value a, value b, int bsign)
+{
+    struct view x, y;
+    view_of(a, &x);
+    view_of(b, &y);
+    y.sign *= bsign;
+
+    fuel_charge_words(x.size > y.size ? x.size : y.size);
+
+    struct bignum *r;
+    if (x.sign == y.sign || !y.size)
+    {
+        if (x.size < y.size)
+        {
+            struct view *big = &y, *small = &x;
+            r = big_new(big->size + 1);
+            memcpy(r->limbs, big->limbs, big->size * sizeof(uint32_t));
+            r->limbs[big->size] = mag_add_in(r->limbs, big->size, small->limbs, small->size);
+            r->sign = y.sign;
+        }
+        else
+        {
+            r = big_new(x.size + 1);
+            memcpy(r->limbs, x.limbs, x.size * sizeof(uint32_t));
+            r->limbs[x.size] = mag_add_in(r->limbs, x.size, y.limbs, y.size);
+            r->sign = x.size ? x.sign : y.sign;
+        }
+    }
+    else
+    {
+        int c = mag_cmp(x.limbs, x.size, y.limbs, y.size);
+        struct view *big = c >= 0 ? &x : &y;
+        struct view *small = c >= 0 ? &y : &x;
+
+        r = big_new(big->size);
+        memcpy(r->limbs, big->limbs, big->size * sizeof(uint32_t));
+        mag_sub_in(r->limbs, big->size, small->limbs, small->size);
+        r->sign = big->sign;
+    }
+
+    val_drop(a);
+    val_drop(b);
+    return finish(r);
+}
+
+value big_add(value a, value b)
+{
+    if (val_is_str(a) || val_is_str(b))
+        return str_concat(a, b);
+
+    return add_signed(a, b, 1);
+}
+
+value big_sub(value a, value b)
+{
+    return add_signed(a, b, -1);
+}
+
+value big_neg(value a)
+{
+    return add_signed(0, a, -1);
+}
+
+value big_mul(value a, value b)
+{
+    struct view x, y;
+    view_of(a, &x);
+    view_of(b, &y);
+
+    struct bignum *r = big_new(x.size + y.size);
+    if (x.size && y.size)
+        mag_mul(r->limbs, x.limbs, x.size, y.limbs, y.size);
+    else
+        r->size = 0;
+    r->sign = x.sign * y.sign;
+
+    val_drop(a);
+    val_drop(b);
+    return finish(r);
+}
+
+static value divmod(value a, value b, int rem)
+{
+    struct view x, y;
+    view_of(a, &x);
+    view_of(b, &y);
+
+    // an executable dies of the signal, what it printed is shown first
+    if (!y.size)
+    {
+        val_drop(a);
+        val_drop(b);
+        if (fuel_fail("division by zero"))
+            return 0;
+
+        out_flush_pending();
+        fflush(stdout);
+        raise(SIGFPE);
+        return 0;
+    }
+
+    if (mag_cmp(x.limbs, x.size, y.limbs, y.size) < 0)
+    {
+        val_drop(b);
+        if (rem)
+            return a;
+
+        val_drop(a);
+        return 0;
+    }
+
+    fuel_charge_words((long)(x.size - y.size + 1) * y.size);
+
+    struct bignum *q = big_new(x.size - y.size + 1);
+    struct bignum *r = rem ? big_new(y.size) : NULL;
+
+    mag_divmod(x.limbs, x.size, y.limbs, y.size, q->limbs, rem ? r->limbs : NULL);
+    q->sign = x.sign * y.sign;
+
+    val_drop(a);
+    val_drop(b);
+
+    if (!rem)
+        return finish(q);
+
+    // the remainder takes the sign of the dividend, like C
+    mem_free(MEM_BIGNUM, q);
+    r->sign = x.sign;
+    return finish(r);
+}
+
+value big_div(value a, value b)
+{
+    return divmod(a, b, 0);
+}
+
+value big_mod(value a, value b)
+{
+    return divmod(a, b, 1);
+}
+
+int big_cmp(value a, value b)
+{
+    // interned literals and shared values
+    if (a == b)
+        return 0;
+    if (val_is_array(a) && val_is_array(b))
+        return array_cmp(a, b);
+    if (val_is_str(a) && val_is_str(b))
+        return str_cmp(a, b);
+
+    struct view x, y;
+    view_of(a, &x);
+    view_of(b, &y);
+
+    if (!x.size && !y.size)
+        return 0;
+    if (x.sign != y.sign || !x.size || !y.size)
+    {
+        int sx = x.size ? x.sign : 0;
+        int sy = y.size ? y.sign : 0;
+        return (sx > sy) - (sx < sy);
+    }
+
+    return x.sign * mag_cmp(x.limbs, x.size, y.limbs, y.size);
+}
+
+value val_pow(value a, value b)
+{
+    long n;
+
+    if (val_cmp(b, 0) < 0)
+    {
+        // |a| > 1 makes 1 / a ^ -b a fraction
+        value r = 0;
+        if (a == VAL_SMALL(1))
+            r = a;
+        else if (a == VAL_SMALL(-1))
+            r = val_mod(val_ref(b), VAL_SMALL(2)) ? a : VAL_SMALL(1);
+
+        val_drop(a);
+        val_drop(b);
+        return r;
+    }
+
+    if (!val_to_long(b, &n))
+    {
+        if (a == 0 || a == VAL_SMALL(1) || a == VAL_SMALL(-1))
+        {
+            value r = a == VAL_SMALL(-1) && val_mod(val_ref(b), VAL_SMALL(2)) ? a : VAL_SMALL(a != 0);
+            val_drop(b);
+            return r;
+        }
+
+        val_drop(a);
+        val_drop(b);
+        val_fail("exponent too large");
+        return 0;
+    }
+
+    value r = VAL_SMALL(1);
+    while (n)
+    {
+        if (n & 1)
+            r = val_mul(r, val_ref(a));
+        n >>= 1;
+        if (n)
+            a = val_mul(a, val_ref(a));
+    }
+
+    val_drop(a);
+    return r;
+}
+
+// TEXT
+
+static const char digit_pairs[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                                  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                                  "8081828384858687888990919293949596979899";
+
+// 9 decimal digits of chunk, zero padded, ending at end
+static void put_chunk(char *end, uint32_t chunk)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        memcpy(end - 2 * (i + 1), digit_pairs + 2 * (chunk % 100), 2);
+        chunk /= 100;
+    }
+    end[-9] = '0' + chunk;
+}
+
+char *val_digits(char *end, long n)
+{
+    unsigned long m = n < 0 ? -(unsigned long)n : (unsigned long)n;
+
+    while (m >= 100)
+    {
+        end -= 2;
+        memcpy(end, digit_pairs + 2 * (m % 100), 2);
+        m /= 100;
+    }
+    if (m >= 10)
+    {
+        end -= 2;
+        memcpy(end, digit_pairs + 2 * m, 2);
+    }
+    else
+        *--end = '0' + m;
+
+    if (n < 0)
+        *--end = '-';
+
+    return end;
+}
+
+static const uint32_t one = 1;
+
+static int mag_size(const uint32_t *a, int n)
+{
+    while (n && !a[n - 1])
+        n -= 1;
+
+    return n;
+}
+
+// Settle q (qn limbs), within a few of u / d, to the quotient, and put the remainder
+// in r (dn limbs); u and d are trimmed
+static void mag_div_fix(const uint32_t *u, int un, const uint32_t *d, int dn, uint32_t *q, int qn, uint32_t *r)
+{
+    int pn = dn + qn;
+    uint32_t *p = mem_malloc(MEM_BIGNUM, pn * sizeof(uint32_t));
+    uint32_t *t = mem_malloc(MEM_BIGNUM, un * sizeof(uint32_t));
+
+    mag_mul(p, d, dn, q, qn);
+    while (mag_cmp(p, mag_size(p, pn), u, un) > 0)
+    {
+        mag_sub_in(p, pn, d, dn);
+        mag_sub_in(q, qn, &one, 1);
+    }
+
+    memcpy(t, u, un * sizeof(uint32_t));
+    mag_sub_in(t, un, p, mag_size(p, pn));
+    while (mag_cmp(t, mag_size(t, un), d, dn) >= 0)
+    {
+        mag_sub_in(t, un, d, dn);
+        mag_add_in(q, qn, &one, 1);
+    }
+
+    memset(r, 0, dn * sizeof(uint32_t));
+    memcpy(r, t, (un < dn ? un : dn) * sizeof(uint32_t));
+    mem_free(MEM_BIGNUM, p);
+    mem_free(MEM_BIGNUM, t);
+}
+
+// B^2k / d within a few, in k + 2 limbs, for d of k limbs and B = 2^32
+static uint32_t *mag_recip(const uint32_t *d, int k)
+{
+    uint32_t *x = mem_malloc(MEM_BIGNUM, (k + 2) * sizeof(uint32_t));
+
+    if (k <= RECIP_THRESHOLD)
+    {
+        uint32_t *u = mem_calloc(MEM_BIGNUM, 2 * k + 1, sizeof(uint32_t));
+        u[2 * k] = 1;
+        fuel_charge_words((long)(k + 2) * k);
+        mag_divmod(u, 2 * k + 1, d, k, x, NULL);
+        mem_free(MEM_BIGNUM, u);
+        return x;
+    }
+
+    // y ~ B^2h / dh for the top h limbs dh of d : x0 = y B^(k - h) is off by about
+    // B^(2 - h) relatively, the Newton step x0 + x0 (B^2k - d x0) / B^2k squares that
+    // and leaves it off by a few
+    int h = (k + 7) / 2;
+    uint32_t *y = mag_recip(d + k - h, h);
+    int yn = mag_size(y, h + 2);
+
+    // e = |B^2k - d x0| / B^(k - h) = |B^(k + h) - d y|
+    int en = k + yn;
+    uint32_t *e = mem_malloc(MEM_BIGNUM, en * sizeof(uint32_t));
+    mag_mul(e, d, k, y, yn);
+    int above = mag_size(e, en) > k + h;
+    if (above)
+        mag_sub_in(e + k + h, en - k - h, &one, 1);
+    else
+    {
+        // d y < B^(k + h) : its complement in k + h limbs, plus 1
+        for (int i = 0; i < k + h; i++)
+            e[i] = ~e[i];
+        mag_add_in(e, k + h, &one, 1);
+    }
+    en = mag_size(e, en);
+
+    // x0 (B^2k - d x0) / B^2k = y e / B^2h
+    memset(x, 0, (k + 2) * sizeof(uint32_t));
+    memcpy(x + k - h, y, yn * sizeof(uint32_t));
+    if (en && yn + en > 2 * h)
+    {
+        uint32_t *c = mem_malloc(MEM_BIGNUM, (yn + en) * sizeof(uint32_t));
+        mag_mul(c, y, yn, e, en);
+        int cn = mag_size(c + 2 * h, yn + en - 2 * h);
+        if (above)
+            mag_sub_in(x, k + 2, c + 2 * h, cn);
+        else
+            mag_add_in(x, k + 2, c + 2 * h, cn);
+        mem_free(MEM_BIGNUM, c);
+    }
+
+    mem_free(MEM_BIGNUM, y);
+    mem_free(MEM_BIGNUM, e);
+    return x;
+}
+
+// q (un - k + 1 limbs) and r (k limbs) of u / d for k <= un <= 2k, given inv = mag_recip(d, k)
+// (Barrett) : (u / B^(k - 1)) inv / B^(k + 1) is within a few of the quotient
+static void mag_divmod_inv(const uint32_t *u, int un, const uint32_t *d, int k, const uint32_t *inv, int invn,
+                           uint32_t *q, uint32_t *r)
+{
+    int qn = un - k + 1;
+    int tn = qn + invn;
+    uint32_t *t = mem_malloc(MEM_BIGNUM, tn * sizeof(uint32_t));
+
+    mag_mul(t, u + k - 1, qn, inv, invn);
+    memset(q, 0, qn * sizeof(uint32_t));
+    if (tn > k + 1)
+        memcpy(q, t + k + 1, (tn - k - 1 < qn ? tn - k - 1 : qn) * sizeof(uint32_t));
+    mem_free(MEM_BIGNUM, t);
+
+    mag_div_fix(u, un, d, k, q, qn, r);
+}
+
+// 10^(9 * 2^i) and, once a split needs it, its reciprocal
+struct powers
+{
+    int levels;
+    uint32_t *pow[40];
+    int pown[40];
+    uint32_t *inv[40];
+};
+
+// Digits of x (xn limbs, x < 10^width) zero padded to width, ending at end; x is used up.
+// Past CONV_LEAF limbs, x < pow[level]^2 splits in halves of 9 * 2^level digits.
+// 0 when charged and the budget runs out.
+static int put_digits(uint32_t *x, int xn, char *end, long width, struct powers *pw, int level, int charged)
+{
+    xn = mag_size(x, xn);
+    if (xn > CONV_LEAF && level >= 0)
+    {
+        long half = width / 2;
+        const uint32_t *d = pw->pow[level];
+        int k = pw->pown[level];
+
+        if (mag_cmp(x, xn, d, k) < 0)
+        {
+            memset(end - width, '0', half);
+            return put_digits(x, xn, end, half, pw, level - 1, charged);
+        }
+
+        if (!pw->inv[level])
+            pw->inv[level] = mag_recip(d, k);
+
+        uint32_t *q = mem_malloc(MEM_BIGNUM, (xn - k + 1) * sizeof(uint32_t));
+        uint32_t *r = mem_malloc(MEM_BIGNUM, k * sizeof(uint32_t));
+        mag_divmod_inv(x, xn, d, k, pw->inv[level], k + 2, q, r);
+        int ok = !(charged && fuel.out) && put_digits(r, k, end, half, pw, level - 1, charged) &&
+                 put_digits(q, xn - k + 1, end - half, half, pw, level - 1, charged);
+        mem_free(MEM_BIGNUM, q);
+        mem_free(MEM_BIGNUM, r);
+        return ok;
+    }
+
+    // 9 digits per pass : each pass divides the whole magnitude by 10^9 once
+    char *p = end;
+    while (xn)
+    {
+        uint64_t rem = 0;
+        for (int j = xn - 1; j >= 0; j--)
+        {
+            uint64_t cur = rem << 32 | x[j];
+            x[j] = (uint32_t)(cur / 1000000000);
+            rem = cur % 1000000000;
+        }
+        put_chunk(p, (uint32_t)rem);
+        p -= 9;
+        // the passes take n^2 in all, the clock is read while they go
+        if (charged)
+        {
+            fuel_charge_words(xn);
+            if (__builtin_expect(fuel.out, 0))
+                return 0;
+        }
+        xn = mag_size(x, xn);
+    }
+    memset(end - width, '0', p - (end - width));
+    return 1;
+}
+
+// Decimal text of v, NULL when charged and the budget runs out before it is done
+static char *to_str(value v, int charged)
+{
+    if (val_is_small(v))
+    {
+        char buf[VAL_DIGITS];
+        char *d = val_digits(buf + VAL_DIGITS, val_untag(v));
+        int n = buf + VAL_DIGITS - d;
+        char *s = mem_malloc(MEM_BIGNUM, n + 1);
+        memcpy(s, d, n);
+        s[n] = 0;
+        return s;
+    }
+
+    struct bignum *b = val_big(v);
+    int n = b->size;
+    struct powers pw = { .levels = 0 };
+    long width = (long)(n * 32 / 29 + 2) * 9;
+
+    // a large magnitude starts split in halves by the smallest 10^(9 * 2^i) whose square exceeds it
+    if (n > CONV_THRESHOLD)
+    {
+        pw.pow[0] = mem_malloc(MEM_BIGNUM, sizeof(uint32_t));
+        pw.pow[0][0] = 1000000000;
+        pw.pown[0] = 1;
+        pw.levels = 1;
+        while (n > 2 * pw.pown[pw.levels - 1] - 2)
+        {
+            int i = pw.levels++;
+            pw.pow[i] = mem_malloc(MEM_BIGNUM, 2 * pw.pown[i - 1] * sizeof(uint32_t));
+            mag_mul(pw.pow[i], pw.pow[i - 1], pw.pown[i - 1], pw.pow[i - 1], pw.pown[i - 1]);
+            pw.pown[i] = mag_size(pw.pow[i], 2 * pw.pown[i - 1]);
+        }
+        width = 18L << (pw.levels - 1);
+    }
+
+    char *s = mem_malloc(MEM_BIGNUM, width + 2);
+    uint32_t *t = mem_malloc(MEM_BIGNUM, n * sizeof(uint32_t));
+    memcpy(t, b->limbs, n * sizeof(uint32_t));
+    int ok = put_digits(t, n, s + 1 + width, width, &pw, pw.levels - 1, charged);
+    mem_free(MEM_BIGNUM, t);
+    for (int i = 0; i < pw.levels; i++)
+    {
+        mem_free(MEM_BIGNUM, pw.pow[i]);
+        if (pw.inv[i])
+            mem_free(MEM_BIGNUM, pw.inv[i]);
+    }
+
+    if (!ok)
+    {
+        mem_free(MEM_BIGNUM, s);
+        return NULL;
+    }
+
+    // a bignum is not 0, so some digit is not
+    char *d = s + 1;
+    while (*d == '0')
+        d++;
+    if (b->sign < 0)
+        *--d = '-';
+    long len = s + 1 + width - d;
+    memmove(s, d, len);
+    s[len] = 0;
+    return s;
+}
+
+char *val_str(value v)
+{
+    return to_str(v, 0);
+}
+
+char *val_str_charged(value v)
+{
+    return to_str(v, 1);
+}
+
+int val_fprint_short(FILE *f, value v)
+{
+    if (val_is_small(v) || val_is_array(v) || val_is_str(v) || val_big(v)->size <= VAL_SHORT_LIMBS)
+        return val_fprint(f, v);
+
+    struct bignum *b = val_big(v);
+    long bits = (long)b->size * 32 - __builtin_clz(b->limbs[b->size - 1]);
+    // 10^low <= |v| < 10^(low + 3) : |v| / 10^(low - 15) fits a long and has 16 to 18 digits
+    long low = (long)((bits - 1) * 0.30102999566398) - 1;
+    value abs = b->sign < 0 ? val_neg(val_ref(v)) : val_ref(v);
+    long head, tail;
+    val_to_long(val_div(val_ref(abs), val_pow(VAL_SMALL(10), val_from_long(low - 15))), &head);
+    val_to_long(val_mod(abs, VAL_SMALL(1000000000000000L)), &tail);
+
+    long digits = low - 15;
+    for (long h = head; h; h /= 10)
+        digits++;
+    while (head >= 1000000000000000L)
+        head /= 10;
+
+    return fprintf(f, "%s%ld...%015ld (%ld digits)", b->sign < 0 ? "-" : "", head, tail, digits);
+}
+
+int val_fprint(FILE *f, value v)
+{
+    if (val_is_small(v))
+    {
+        char buf[VAL_DIGITS];
+        char *d = val_digits(buf + VAL_DIGITS, val_untag(v));
+        int n = buf + VAL_DIGITS - d;
+        return fwrite(d, 1, n, f) == (size_t)n ? n : -1;
+    }
+    if (val_is_array(v))
+        return array_fprint(f, v);
+    if (val_is_str(v))
+        return str_fprint(f, v);
+
+    char *s = val_str(v);
+    int ret = fputs(s, f) < 0 ? -1 : (int)strlen(s);
+    mem_free(MEM_BIGNUM, s);
+    return ret;
+}
+
+value val_parse(const char *s)
+{
+    int neg = *s == '-';
+    if (neg)
+        s++;
+
+    int len = strlen(s);
+    if (len <= 18)
+    {
+        long n = strtol(s, NULL, 10);
+        return val_from_long(neg ? -n : n);
+    }
+
+    // 9 digits at a time : t = t * 10^9 + chunk
+    struct bignum *b = big_new(len / 9 + 2);
+    int n = 0;
+    int first = len % 9 ? len % 9 : 9;
+
+    for (int i = 0; i < len;)
+    {
+        int count = i ? 9 : first;
+        uint32_t chunk = 0;
+        uint32_t scale = 1;
+        for (int j = 0; j < count; j++, i++)
+        {
+            chunk = chunk * 10 + (s[i] - '0');
+            scale *= 10;
+        }
+
+        uint64_t carry = chunk;
+        for (int j = 0; j < n; j++)
+        {
+            carry += (uint64_t)b->limbs[j] * scale;
+            b->limbs[j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        if (carry)
+            b->limbs[n++] = (uint32_t)carry;
+    }
+
+    b->size = n;
+    b->sign = neg ? -1 : 1;
+    return finish(b);
+}
@@ -0,0 +1,220 @@
+#ifndef _BIGINT_H
+#define _BIGINT_H
+#include <stdint.h>
+#include <stdio.h>
+
+// Arbitrary precision integers
+//
+// A value is one machine word. An even word is a small int shifted left by one,
+// a word ending in binary 001 points (plus 1) to a heap bignum, one ending in 011
+// to an array (array.h), 101 and 111 are strings (str.h). Results leaving the
+// small range are promoted (detected with the overflow builtins) and bignums
+// coming back into it are demoted, so every integer has exactly one
+// representation and 0 is 0. Bignums are immutable, bignums, arrays and long
+// strings are reference counted.
+//
+// Operations consume their operands and return a new reference, except
+// val_cmp and val_fprint which only borrow them.
+
+typedef intptr_t value;
+
+// Magnitude in 32 bit limbs, least significant first, no leading zero limb
+struct bignum
+{
+    int refs;
+    int sign;
+    int size;
+    uint32_t limbs[];
+};
+
+#define VAL_SMALL_MIN (INTPTR_MIN / 2)
+#define VAL_SMALL_MAX (INTPTR_MAX / 2)
+
+// Small int n, n must be in [VAL_SMALL_MIN, VAL_SMALL_MAX]
+#define VAL_SMALL(n) ((value)((uintptr_t)(n) << 1))
+
+static inline int val_is_small(value v)
+{
+    return !(v & 1);
+}
+
+static inline long val_untag(value v)
+{
+    return v >> 1;
+}
+
+static inline int val_is_array(value v)
+{
+    return (v & 7) == 3;
+}
+
+static inline int val_is_str(value v)
+{
+    return (v & 5) == 5;
+}
+
+// Whether v points to a reference counted block : a bignum, an array or a string too long to be inline
+static inline int val_is_boxed(value v)
+{
+    return !val_is_small(v) && (v & 7) != 7;
+}
+
+static inline struct bignum *val_big(value v)
+{
+    return (struct bignum *)(uintptr_t)(v - 1);
+}
+
+// Reference count of a boxed value, every block starts with it
+static inline int *val_refs(value v)
+{
+    return (int *)(uintptr_t)(v & ~(value)7);
+}
+
+// Free a boxed value whose last reference is dropped
+void val_release(value v);
+
+static inline value val_ref(value v)
+{
+    if (val_is_boxed(v))
+        *val_refs(v) += 1;
+
+    return v;
+}
+
+static inline void val_drop(value v)
+{
+    if (val_is_boxed(v) && !--*val_refs(v))
+        val_release(v);
+}
+
+// Runtime error : the interpreter stops its run (fuel_fail), so the caller returns
+// a value that is dropped unseen. Elsewhere what was printed so far, then msg on
+// stderr, and exit with 1 as val_die.
+void val_fail(const char *msg);
+
+// Error no run goes on after (out of memory) : exit with 1 after msg
+void val_die(const char *msg) __attribute__((noreturn));
+
+// Store v in slot, releasing what it held
+static inline void val_assign(value *slot, value v)
+{
+    value old = *slot;
+    *slot = v;
+    val_drop(old);
+}
+
+// Move the value out of slot, leaving 0
+static inline value val_take(value *slot)
+{
+    value v = *slot;
+    *slot = 0;
+    return v;
+}
+
+// v in blocks of its own, a new reference : reference counts are not atomic,
+// a value another thread reads is copied first
+value val_copy(value v);
+
+value val_from_long(long n);
+// Whether v fits a long, stored in out
+int val_to_long(value v, long *out);
+
+// Decimal literal, with an optional leading '-'
+value val_parse(const char *s);
+// Decimal text of v, to free
+char *val_str(value v);
+// val_str charging the budget as it goes, NULL when it runs out before the text is
+// done : the quadratic conversion of a long bignum stops with the run
+char *val_str_charged(value v);
+// Bytes the decimal text of a long takes at most
+#define VAL_DIGITS 20
+// Decimal text of n ending at end, two digits at a time, returns where it starts
+char *val_digits(char *end, long n);
+int val_fprint(FILE *f, value v);
+// Bignums past VAL_SHORT_LIMBS limbs (about 1200 digits)
+#define VAL_SHORT_LIMBS 128
+// val_fprint, but a bignum past VAL_SHORT_LIMBS as its first and last 15 digits and
+// how many there are, "123...456 (5000 digits)", without converting all of them
+int val_fprint_short(FILE *f, value v);
+
+// Slow paths, for bignum operands or results
+value big_add(value a, value b);
+value big_sub(value a, value b);
+value big_mul(value a, value b);
+value big_div(value a, value b);
+value big_mod(value a, value b);
+value big_neg(value a);
+int big_cmp(value a, value b);
+
+static inline value val_add(value a, value b)
+{
+    value r;
+    if (val_is_small(a) && val_is_small(b) && !__builtin_add_overflow(a, b, &r))
+        return r;
+
+    return big_add(a, b);
+}
+
+static inline value val_sub(value a, value b)
+{
+    value r;
+    if (val_is_small(a) && val_is_small(b) && !__builtin_sub_overflow(a, b, &r))
+        return r;
+
+    return big_sub(a, b);
+}
+
+static inline value val_mul(value a, value b)
+{
+    value r;
+    if (val_is_small(a) && val_is_small(b) && !__builtin_mul_overflow(val_untag(a), b, &r))
+        return r;
+
+    return big_mul(a, b);
+}
+
+// Truncated division like C, dividing by 0 is a runtime error (SIGFPE in an executable)
+static inline value val_div(value a, value b)
+{
+    if (val_is_small(a) && val_is_small(b) && b)
+        return val_from_long(val_untag(a) / val_untag(b));
+
+    return big_div(a, b);
+}
+
+static inline value val_mod(value a, value b)
+{
+    if (val_is_small(a) && val_is_small(b) && b)
+        return VAL_SMALL(val_untag(a) % val_untag(b));
+
+    return big_mod(a, b);
+}
+
+static inline value val_neg(value a)
+{
+    value r;
+    if (val_is_small(a) && !__builtin_sub_overflow(0, a, &r))
+        return r;
+
+    return big_neg(a);
+}
+
+// a ^ b, exact; a negative b gives the integer part of 1 / a ^ -b
+value val_pow(value a, value b);
+
+// -1, 0 or 1 as a < b, a == b or a > b
+static inline int val_cmp(value a, value b)
+{
+    if (val_is_small(a) && val_is_small(b))
+        return (a > b) - (a < b);
+
+    return big_cmp(a, b);
+}
+
+static inline value val_not(value a)
+{
+    val_drop(a);
+    return VAL_SMALL(a == 0);
+}
+
+#endif /* _BIGINT_H */
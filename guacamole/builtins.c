@@ -1,83 +1,321 @@
 #include "builtins.h"
+#include "array.h"
+#include "fuel.h"
+#include "str.h"
+#include <errno.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
-int create_builtin(struct scope *s, char *name)
+static int call_print(struct scope *s, value *args)
 {
-    struct def_list *dl = calloc(1, sizeof(struct def_list));
+    return _print(&s->out, args[0]);
+}
+
+static int call_println(struct scope *s, value *args)
+{
+    return _println(&s->out, args[0]);
+}
+
+static int call_donut(struct scope *s, value *args)
+{
+    return _donut(&s->out, args[0]);
+}
+
+static int call_read_int(struct scope *s, value *args)
+{
+    val_assign(&s->current_val, _read_int(&s->in));
+    return 1;
+}
+
+static int call_eof(struct scope *s, value *args)
+{
+    val_assign(&s->current_val, _eof(&s->in));
+    return 1;
+}
+
+static int call_len(struct scope *s, value *args)
+{
+    val_assign(&s->current_val, _len(args[0]));
+    return 1;
+}
+
+static int call_sum(struct scope *s, value *args)
+{
+    val_assign(&s->current_val, _sum(args[0]));
+    return 1;
+}
+
+static int call_min(struct scope *s, value *args)
+{
+    val_assign(&s->current_val, _min(args[0]));
+    return 1;
+}
+
+static int call_max(struct scope *s, value *args)
+{
+    val_assign(&s->current_val, _max(args[0]));
+    return 1;
+}
+
+static int call_dot(struct scope *s, value *args)
+{
+    val_assign(&s->current_val, _dot(args[0], args[1]));
+    return 1;
+}
+
+static int call_fill(struct scope *s, value *args)
+{
+    val_assign(&s->current_val, _fill(args[0], args[1]));
+    return 1;
+}
+
+static int call_scan(struct scope *s, value *args)
+{
+    val_assign(&s->current_val, _scan(args[0]));
+    return 1;
+}
+
+static int call_sort(struct scope *s, value *args)
+{
+    val_assign(&s->current_val, _sort(args[0]));
+    return 1;
+}
 
-    char *tmp = calloc(1, sizeof(char) * (strlen(name) + 1));
-    strcpy(tmp, name);
+static const struct builtin builtins[] = {
+    {"print", 1, call_print, 0},
+    {"println", 1, call_println, 0},
+    {"donut", 1, call_donut, 0, 1},
+    {"read_int", 0, call_read_int, 0, 0, 0, 1},
+    {"eof", 0, call_eof, 0, 0, 0, 1},
+    {"len", 1, call_len, 1},
+    {"sum", 1, call_sum, 1},
+    {"min", 1, call_min, 1},
+    {"max", 1, call_max, 1},
+    {"dot", 2, call_dot, 1},
+    {"fill", 2, call_fill, 1},
+    {"scan", 1, call_scan, 1},
+    {"sort", 1, call_sort, 1},
+    {"reduce", 4, NULL, 0, 0, 1},
+};
+
+int create_builtin(struct scope *s, const struct builtin *b)
+{
+    struct def_entry *dl = putdef(s, b->name, hash_name(b->name));
 
-    dl->name = tmp;
-    dl->builtin = 1;
+    dl->builtin = b;
     dl->type = _func;
-    dl->next = s->defs;
-    s->defs = dl;
 
     return 1;
 }
 
+const struct builtin *find_builtin(const char *name)
+{
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++)
+    {
+        if (!strcmp(builtins[i].name, name))
+            return &builtins[i];
+    }
+
+    return NULL;
+}
+
 void register_builtins(struct scope *s)
 {
-    create_builtin(s, "print");
-    create_builtin(s, "println");
-    create_builtin(s, "donut");
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++)
+        create_builtin(s, &builtins[i]);
 }
 
-int _print(int val)
+int _print(struct out *out, value val)
 {
-    return printf("%d ", val);
+    int n = out_value(out, val);
+    out_char(out, ' ');
+    return n + 1;
 }
 
-int _println(int val)
+int _println(struct out *out, value val)
 {
-    return printf("%d\n", val);
+    int n = out_value(out, val);
+    out_char(out, '\n');
+    return n + 1;
 }
 
-int _donut()
+// Steps of the donut sweeps : i around the tube, j around the axis
+#define DONUT_I 628
+#define DONUT_J 210
+// 80 x 22 cells, a new line replacing the first of each row
+#define DONUT_CELLS 1760
+
+// sin and cos of the angles the sweeps go through, stepped like the original floats
+static void donut_angles(float *sins, float *coss, int n, float step)
 {
-    int k;
-    double sin(), cos();
-    float A = 0, B = 0, i, j, z[1760];
-    char b[1760];
-    printf("\x1b[2J");
-    for (;;)
+    float a = 0;
+    for (int k = 0; k < n; k++, a += step)
     {
-        memset(b, 32, 1760);
-        memset(z, 0, 7040);
-        for (j = 0; 6.28 > j; j += 0.03)
+        sins[k] = sin(a);
+        coss[k] = cos(a);
+    }
+}
+
+// All of n bytes to f, one write() when it has a file descriptor
+static int donut_write(FILE *f, const char *s, long n)
+{
+    int fd = fileno(f);
+    if (fd < 0)
+        return fwrite(s, 1, n, f) == (size_t)n && !fflush(f);
+
+    while (n > 0)
+    {
+        long w = write(fd, s, n);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return 0;
+        s += w;
+        n -= w;
+    }
+
+    return 1;
+}
+
+int _donut(struct out *o, value frames)
+{
+    if (!val_is_small(frames) || val_untag(frames) < 0)
+    {
+        val_fail("donut expects a number of frames");
+        return 0;
+    }
+
+    // frames are written straight to the FILE, after everything printed before
+    out_flush(o);
+
+    float sin_i[DONUT_I], cos_i[DONUT_I], sin_j[DONUT_J], cos_j[DONUT_J];
+    donut_angles(sin_i, cos_i, DONUT_I, 0.01);
+    donut_angles(sin_j, cos_j, DONUT_J, 0.03);
+
+    // one sweep of i, computed for every step before any is plotted so it vectorizes
+    float ms[DONUT_I];
+    int xs[DONUT_I], ys[DONUT_I], ns[DONUT_I];
+
+    // the screen is cleared with the first frame only
+    char screen[4 + 3 + DONUT_CELLS + 1] = "\x1b[2J\x1b[d";
+    char *b = screen + 7;
+    float z[DONUT_CELLS];
+
+    long n = val_untag(frames), frame;
+    float A = 0, B = 0;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    // a frame is a step of the budget
+    for (frame = 0; (!n || frame < n) && fuel_charge_long(); frame++)
+    {
+        float sinA = sin(A), cosA = cos(A), sinB = sin(B), cosB = cos(B);
+
+        memset(b, 32, DONUT_CELLS);
+        memset(z, 0, sizeof(z));
+        for (int j = 0; j < DONUT_J; j++)
         {
-            for (i = 0; 6.28 > i; i += 0.01)
+            float sinj = sin_j[j], cosj = cos_j[j], cosj2 = cosj + 2;
+
+            for (int i = 0; i < DONUT_I; i++)
             {
-                float sini = sin(i),
-                      cosj = cos(j),
-                      sinA = sin(A),
-                      sinj = sin(j),
-                      cosA = cos(A),
-                      cosj2 = cosj + 2,
+                float sini = sin_i[i],
+                      cosi = cos_i[i],
                       mess = 1 / (sini * cosj2 * sinA + sinj * cosA + 5),
-                      cosi = cos(i),
-                      cosB = cos(B),
-                      sinB = sin(B),
                       t = sini * cosj2 * cosA - sinj * sinA;
-                int x = 40 + 30 * mess * (cosi * cosj2 * cosB - t * sinB),
-                    y = 12 + 15 * mess * (cosi * cosj2 * sinB + t * cosB),
-                    o = x + 80 * y,
-                    N = 8 * ((sinj * sinA - sini * cosj * cosA) * cosB - sini * cosj * sinA - sinj * cosA - cosi * cosj * sinB);
-                if (22 > y && y > 0 && x > 0 && 80 > x && mess > z[o])
+                xs[i] = 40 + 30 * mess * (cosi * cosj2 * cosB - t * sinB);
+                ys[i] = 12 + 15 * mess * (cosi * cosj2 * sinB + t * cosB);
+                ns[i] = 8 * ((sinj * sinA - sini * cosj * cosA) * cosB - sini * cosj * sinA - sinj * cosA - cosi * cosj * sinB);
+                ms[i] = mess;
+            }
+
+            for (int i = 0; i < DONUT_I; i++)
+            {
+                int x = xs[i], y = ys[i], c = x + 80 * y;
+                if (22 > y && y > 0 && x > 0 && 80 > x && ms[i] > z[c])
                 {
-                    z[o] = mess;
-                    b[o] = ".,-~:;=!*#$@"[N > 0 ? N : 0];
+                    z[c] = ms[i];
+                    b[c] = ".,-~:;=!*#$@"[ns[i] > 0 ? ns[i] : 0];
                 }
             }
         }
-        printf("\x1b[d");
-        for (k = 0; 1761 > k; k++)
-            putchar(k % 80 ? b[k] : 10);
+
+        for (int k = 0; k < DONUT_CELLS; k += 80)
+            b[k] = '\n';
+        b[DONUT_CELLS] = '\n';
+
+        const char *s = frame ? screen + 4 : screen;
+        if (!donut_write(o->f, s, screen + sizeof(screen) - s))
+            break;
+
         A += 0.04;
         B += 0.02;
     }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ms_spent = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    fprintf(stderr, "donut: %ld frames in %.0f ms, %.1f fps\n", frame, ms_spent, ms_spent > 0 ? frame * 1e3 / ms_spent : 0);
     return 1;
 }
+
+value _read_int(struct in *in)
+{
+    return in_int(in);
+}
+
+value _eof(struct in *in)
+{
+    return VAL_SMALL(in_eof(in));
+}
+
+value _len(value a)
+{
+    if (val_is_str(a))
+        return VAL_SMALL(str_len(a));
+    if (!val_is_array(a))
+    {
+        val_fail("len expects an array or a string");
+        return 0;
+    }
+
+    return array_len(a);
+}
+
+value _sum(value a)
+{
+    return array_sum(a);
+}
+
+value _min(value a)
+{
+    return array_min(a);
+}
+
+value _max(value a)
+{
+    return array_max(a);
+}
+
+value _dot(value a, value b)
+{
+    return array_dot(a, b);
+}
+
+value _fill(value n, value v)
+{
+    return array_fill(n, v);
+}
+
+value _scan(value a)
+{
+    return array_scan(a);
+}
+
+value _sort(value a)
+{
+    return array_sort(a);
+}
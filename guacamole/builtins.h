@@ -2,16 +2,50 @@
 #define _BUILTINS_H
 #include "my_calc.h"
 
+// Built-in function entry : name, number of args and C implementation
+struct builtin
+{
+    const char *name;
+    int arity;
+    int (*fn)(struct scope *s, value *args);
+    // the value only depends on the args and fn leaves it in s->current_val,
+    // otherwise the call has effects and its value is its last arg
+    int pure;
+    // how many of the last args can be left out, fn gets 0 for them
+    int optional;
+    // the first arg names a funk and the evaluator runs the call itself (reduce), fn is NULL
+    int funk;
+    // the value is read from the input given first, fn leaves it in s->current_val
+    int reads;
+};
+
 // Register all built-ins to scope
 void register_builtins(struct scope *s);
 
+// Built-in named name, NULL if there is none
+const struct builtin *find_builtin(const char *name);
+
 // Print with 2 surrounding spaces
-int _print(int val);
+int _print(struct out *out, value val);
 
 // Print with new lines
-int _println(int val);
+int _println(struct out *out, value val);
+
+// DONUT, frames times then reports the frame rate on stderr, forever when frames is 0
+int _donut(struct out *out, value frames);
+
+// Next int of the input, 1 when only white space is left in it
+value _read_int(struct in *in);
+value _eof(struct in *in);
 
-// DONUT
-int _donut();
+// Array builtins (array.h), returning a new reference, len takes a string too
+value _len(value a);
+value _sum(value a);
+value _min(value a);
+value _max(value a);
+value _dot(value a, value b);
+value _fill(value n, value v);
+value _scan(value a);
+value _sort(value a);
 
 #endif /* _BUILTINS_H */
@@ -0,0 +1,256 @@
+#define _GNU_SOURCE
+#include "callstack.h"
+#include "mem.h"
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+// Distinct call sites a backtrace shows
+#define CALLSTACK_TRACE 16
+
+static long max_depth = CALLSTACK_DEFAULT_DEPTH;
+
+_Thread_local struct call_stack call_stack;
+
+// stack of callstack_run on this thread, NULL when running on the thread's own
+static _Thread_local char *run_stack;
+
+void callstack_configure(long depth)
+{
+    max_depth = depth;
+}
+
+// Bytes of stack for the max depth
+static size_t stack_size(void)
+{
+    size_t size = 4 * CALLSTACK_RESERVE;
+    if (max_depth > (long)((SIZE_MAX - size) / CALLSTACK_FRAME_BYTES))
+        return SIZE_MAX & ~(size_t)4095;
+    return size + max_depth * CALLSTACK_FRAME_BYTES;
+}
+
+void callstack_attr(pthread_attr_t *attr)
+{
+    pthread_attr_init(attr);
+    pthread_attr_setstacksize(attr, stack_size());
+}
+
+// The run on the stack of callstack_run, one per thread
+static _Thread_local struct
+{
+    ucontext_t caller;
+    int (*fn)(void *);
+    void *arg;
+    int ret;
+} run;
+
+static void run_fn(void)
+{
+    run.ret = run.fn(run.arg);
+}
+
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+// Sanitizers do not follow a switch of stack : the run gets a thread of its own,
+// with at most this stack, as AddressSanitizer takes a larger one for a corrupted one
+#define SANITIZER_STACK (60 << 20)
+
+struct thread_run
+{
+    int (*fn)(void *);
+    void *arg;
+    int ret;
+};
+
+static void *run_thread(void *arg)
+{
+    struct thread_run *r = arg;
+    sigset_t prof;
+    sigemptyset(&prof);
+    sigaddset(&prof, SIGPROF);
+    pthread_sigmask(SIG_UNBLOCK, &prof, NULL);
+
+    r->ret = r->fn(r->arg);
+    return NULL;
+}
+
+static int run_on_thread(int (*fn)(void *), void *arg)
+{
+    struct thread_run r = {fn, arg, 0};
+    size_t size = stack_size() < SANITIZER_STACK ? stack_size() : SANITIZER_STACK;
+    pthread_attr_t attr;
+    pthread_t thread;
+
+    // the samples of --sample must interrupt the run, not this thread waiting for it
+    sigset_t prof, saved;
+    sigemptyset(&prof);
+    sigaddset(&prof, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &prof, &saved);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, size);
+    int failed = pthread_create(&thread, &attr, run_thread, &r);
+    pthread_attr_destroy(&attr);
+    if (!failed)
+        pthread_join(thread, NULL);
+
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    // no thread : the calls are limited by the stack of this one
+    return failed ? fn(arg) : r.ret;
+}
+#endif
+
+// A second thread would make malloc and stdio take their locks for the whole
+// run, the stack is switched on this one instead
+int callstack_run(int (*fn)(void *), void *arg)
+{
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+    return run_on_thread(fn, arg);
+#endif
+
+    size_t size = stack_size();
+    char *stack = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+
+    // no room for such a stack : the largest one the memory holds
+    while (stack == MAP_FAILED && size > 8 * CALLSTACK_RESERVE)
+    {
+        size = (size / 2) & ~(size_t)4095;
+        stack = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    }
+
+    ucontext_t callee;
+    if (stack == MAP_FAILED || getcontext(&callee))
+    {
+        if (stack != MAP_FAILED)
+            munmap(stack, size);
+        // the calls are limited by the stack of this thread
+        return fn(arg);
+    }
+
+    // a guard page under the stack
+    mprotect(stack, 4096, PROT_NONE);
+
+    callee.uc_stack.ss_sp = stack;
+    callee.uc_stack.ss_size = size;
+    callee.uc_link = &run.caller;
+    makecontext(&callee, run_fn, 0);
+
+    run.fn = fn;
+    run.arg = arg;
+    run_stack = stack;
+    swapcontext(&run.caller, &callee);
+    run_stack = NULL;
+
+    munmap(stack, size);
+    return run.ret;
+}
+
+void callstack_start(void)
+{
+    pthread_attr_t attr;
+    void *low;
+    size_t size;
+
+    call_stack.size = 0;
+    call_stack.next = 0;
+    call_stack.limit = NULL;
+    if (run_stack)
+    {
+        call_stack.limit = run_stack + CALLSTACK_RESERVE;
+        return;
+    }
+    if (pthread_getattr_np(pthread_self(), &attr))
+        return;
+
+    if (!pthread_attr_getstack(&attr, &low, &size))
+        call_stack.limit = (char *)low + (size > 2 * CALLSTACK_RESERVE ? CALLSTACK_RESERVE : size / 2);
+    pthread_attr_destroy(&attr);
+}
+
+void callstack_end(void)
+{
+    mem_free(MEM_CALLS, call_stack.calls);
+    call_stack.calls = NULL;
+    call_stack.size = 0;
+    call_stack.next = 0;
+    call_stack.cap = 0;
+}
+
+// A runtime error with the calls running, the call from ast first (when not
+// NULL), a run of calls from the same site on one line
+static void fail(const char *why, struct ast *ast)
+{
+    char *msg;
+    size_t len;
+    FILE *f = open_memstream(&msg, &len);
+
+    fprintf(f, "%s, innermost call first:", why);
+
+    int shown = 0;
+    for (long i = call_stack.size - !ast; i >= 0 && shown < CALLSTACK_TRACE; shown++)
+    {
+        struct ast *site = i == call_stack.size ? ast : call_stack.calls[i];
+        long n = 0;
+        while (i >= 0 && (i == call_stack.size ? ast : call_stack.calls[i]) == site)
+        {
+            n++;
+            i--;
+        }
+
+        fprintf(f, "\n  line %d: %s", site->line, site->val.strval);
+        if (n > 1)
+            fprintf(f, " x %ld", n);
+        if (shown == CALLSTACK_TRACE - 1 && i >= 0)
+            fprintf(f, "\n  ... and %ld calls more", i + 1);
+    }
+
+    fclose(f);
+    val_fail(msg);
+    free(msg);
+}
+
+void callstack_grow(struct ast *ast)
+{
+    char why[64];
+
+    if (call_stack.size >= max_depth)
+    {
+        snprintf(why, sizeof(why), "max depth of %ld calls reached", max_depth);
+        fail(why, ast);
+    }
+
+    if ((char *)__builtin_frame_address(0) < call_stack.limit)
+    {
+        snprintf(why, sizeof(why), "out of stack after %d calls", call_stack.size);
+        fail(why, ast);
+    }
+
+    if (call_stack.size == call_stack.cap)
+    {
+        call_stack.cap = call_stack.cap ? 2 * call_stack.cap : 64;
+        if (call_stack.cap > max_depth)
+            call_stack.cap = max_depth;
+        // and the call that failed, pushed before the run unwinds
+        call_stack.calls = mem_reallocarray(MEM_CALLS, call_stack.calls, call_stack.cap + 1, sizeof(struct ast *));
+    }
+
+    call_stack.next = call_stack.size + CALLSTACK_CHECK < call_stack.cap ? call_stack.size + CALLSTACK_CHECK
+                                                                          : call_stack.cap;
+}
+
+void callstack_nested(struct ast *ast)
+{
+    char msg[96];
+
+    // the calls running took most of the stack, or their nodes did
+    if (call_stack.size)
+    {
+        snprintf(msg, sizeof(msg), "out of stack after %d calls", call_stack.size);
+        fail(msg, NULL);
+        return;
+    }
+
+    snprintf(msg, sizeof(msg), "out of stack in an expression or block nested too deeply, line %d", ast->line);
+    val_fail(msg);
+}
@@ -0,0 +1,82 @@
+#ifndef _CALLSTACK_H
+#define _CALLSTACK_H
+#include "my_calc.h"
+#include <pthread.h>
+
+// Funk calls of the evaluator and the stack they run on
+//
+// The evaluator, check_ast and the parser recurse on the C stack. The
+// compiler runs them on a stack sized for --max-depth calls, CALLSTACK_FRAME_BYTES
+// each, so deep programs are only limited by memory; the workers of --jobs and
+// reduce get the same stack. Every funk call the evaluator
+// makes pushes its call site, and a call past the max depth, or one finding less
+// than CALLSTACK_RESERVE bytes of C stack left, is a runtime error with the calls
+// running, innermost first, instead of a segfault. The stack left is read every
+// CALLSTACK_CHECK calls, so a call costs a compare and a store. Funks compiled by the JIT
+// check the stack left at their entry and bail out to the interpreter, which
+// reports. Expressions and blocks nested deeper than the stack holds are a parse
+// or check error, or stop the evaluator the same way (callstack_low).
+
+#define CALLSTACK_DEFAULT_DEPTH 100000
+#define CALLSTACK_FRAME_BYTES 2048
+// C stack kept for builtins, the calls between two checks and the error report
+#define CALLSTACK_RESERVE (256 << 10)
+#define CALLSTACK_CHECK 16
+
+struct call_stack
+{
+    // call sites of the funk calls running, innermost last
+    struct ast **calls;
+    int size;
+    // size of the next check, never past cap
+    int next;
+    int cap;
+    // lowest address a call may start from, NULL when unknown
+    char *limit;
+};
+
+extern _Thread_local struct call_stack call_stack;
+
+// Calls at most, CALLSTACK_DEFAULT_DEPTH by default
+void callstack_configure(long max_depth);
+
+// Attributes of a thread that evaluates, its stack holds the max depth
+void callstack_attr(pthread_attr_t *attr);
+
+// fn(arg) on such a stack, on this thread, returns what fn returned
+int callstack_run(int (*fn)(void *), void *arg);
+
+// Start counting the calls of this thread, from the stack it has left
+void callstack_start(void);
+// Release the calls of this thread
+void callstack_end(void);
+
+// Check the stack left and the depth, room for CALLSTACK_CHECK more calls, or
+// a runtime error, from the call site ast
+void callstack_grow(struct ast *ast);
+
+// Less than CALLSTACK_RESERVE bytes of C stack left, for the recursions that are
+// not funk calls
+static inline int callstack_low(void)
+{
+    return (char *)__builtin_frame_address(0) < call_stack.limit;
+}
+
+// The evaluator is out of stack in the nodes nested under ast : a runtime error
+void callstack_nested(struct ast *ast);
+
+// A funk call from the call site ast
+static inline void callstack_push(struct ast *ast)
+{
+    if (__builtin_expect(call_stack.size == call_stack.next, 0))
+        callstack_grow(ast);
+
+    call_stack.calls[call_stack.size++] = ast;
+}
+
+static inline void callstack_pop(void)
+{
+    call_stack.size--;
+}
+
+#endif /* _CALLSTACK_H */
@@ -1,8 +1,22 @@
 #include "my_parser.h"
 #include "my_calc.h"
+#include "callstack.h"
+#include "jit.h"
+#include "emit_c.h"
+#include "fuel.h"
+#include "loopopt.h"
+#include "profile.h"
+#include "reduce.h"
+#include "sampler.h"
+#include "stats.h"
+#include "mem.h"
 #include <error.h>
+#include <getopt.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #define CNRM  "\x1B[0m"
 #define CRED  "\x1B[31m"
@@ -21,7 +35,7 @@ char *readfile(char *filename)
     numbytes = ftell(textfile);
     fseek(textfile, 0L, SEEK_SET);
 
-    text = calloc(numbytes + 1, sizeof(char));
+    text = mem_calloc(MEM_SOURCE, numbytes + 1, sizeof(char));
     if (text == NULL)
         return NULL;
 
@@ -31,58 +45,652 @@ char *readfile(char *filename)
     return text;
 }
 
-int main(int argc, char *argv[])
+// --stats report, 1 as text and 2 as JSON
+static void report_stats(int stats, struct parser *p)
+{
+    fflush(stdout);
+    if (stats == 2)
+        stats_print_json(stderr, p);
+    else if (stats)
+        stats_print(stderr, p);
+    stats_free();
+}
+
+// Position and message of a parse or check error
+static void print_error(FILE *f, struct parser *p, struct error_scope *err_s)
 {
+    fprintf(f, "\n%sERROR:%s\n", CRED, CNRM);
 
-    if (argc < 2)
+    if (err_s->begin != -1)
     {
-        printf("Filename argument expected.\n");
-        return 0;
+        p->last_pos = err_s->begin;
+    }
+    // gestion d'erreur
+    char *errline = get_line_error(p);
+    struct position pos;
+    count_lines(p, &pos);
+    fprintf(f, "line: %d, col: %d\n", pos.line, pos.col);
+    fprintf(f, "%s\n", errline);
+    for (int i = 0; i < pos.col - 1; i += 1)
+        fprintf(f, " ");
+    if (err_s->begin != -1)
+    {
+        for (int i = 0; i < (err_s->end-err_s->begin); i++)
+        {
+            fprintf(f, "%s^", CRED);
+        }
+        fprintf(f, "%s\n", CNRM);
+        
+        fprintf(f, "err : %s\n", err_s->err);
+    } else {
+        fprintf(f, "%s^%s\n", CRED, CNRM);
+    }
+    free(errline);
+}
+
+// Why the budget stopped the run and the step it refused
+static void print_stop(FILE *f, struct parser *p)
+{
+    fprintf(f, "\n%sSTOPPED:%s %s budget spent after %ld steps, %.0f ms\n", CRED, CNRM, fuel.timeout ? "time" : "step",
+            fuel.steps, fuel.ms);
+    if (!fuel.at)
+        return;
+
+    p->last_pos = fuel.at->begin;
+    char *errline = get_line_error(p);
+    struct position pos;
+    count_lines(p, &pos);
+    fprintf(f, "line: %d, col: %d\n", pos.line, pos.col);
+    fprintf(f, "%s\n", errline);
+    for (int i = 0; i < pos.col - 1; i += 1)
+        fprintf(f, " ");
+    fprintf(f, "%s^%s\n", CRED, CNRM);
+
+    if (fuel.at->type == _funcdef)
+        fprintf(f, "at : a call of funk %s\n", fuel.at->val.strval);
+    else if (fuel.at->type == _funccall)
+        fprintf(f, "at : a call of %s\n", fuel.at->val.strval);
+    else if (fuel.at->type == _opmath)
+        fprintf(f, "at : this %s of long operands\n", fuel.at->val.strval);
+    else
+        fprintf(f, "at : the next turn of this loop\n");
+    free(errline);
+}
+
+// The value the run had when its budget stopped it, a long bignum cut short
+static void print_partial(FILE *f)
+{
+    value v = fuel_finish();
+    fprintf(f, "\nPartial result : ");
+    val_fprint_short(f, v);
+    fprintf(f, "\n");
+    val_drop(v);
+}
+
+// The runtime error that stopped the run, as the process would have printed it
+static void print_fail(FILE *f)
+{
+    fprintf(f, "%s\n", fuel.error);
+}
+
+// Braces opened minus braces closed by line, outside comments and strings
+static int brace_depth(const char *line)
+{
+    int depth = 0;
+    int quoted = 0;
+    for (; *line && (quoted || !(line[0] == '/' && line[1] == '/')); line++)
+    {
+        if (quoted && *line == '\\' && line[1])
+            line++;
+        else if (*line == '"')
+            quoted = !quoted;
+        else if (!quoted)
+            depth += (*line == '{') - (*line == '}');
+    }
+
+    return depth;
+}
+
+// Read eval print loop : every input is checked and run against the definitions
+// of the previous ones, without parsing them again. An input goes on over the
+// next lines while it has open braces. An input with a runtime error is undone
+// and the session goes on.
+static void repl(void)
+{
+    struct session ss;
+    session_init(&ss);
+    int tty = isatty(STDIN_FILENO);
+
+    char *line = NULL;
+    size_t cap = 0;
+    char *input = NULL;
+    size_t len = 0;
+    int depth = 0;
+
+    while (1)
+    {
+        if (tty)
+        {
+            printf(len ? "... " : "> ");
+            fflush(stdout);
+        }
+
+        ssize_t n = getline(&line, &cap, stdin);
+        if (n < 0)
+            break;
+
+        input = realloc(input, len + n + 1);
+        memcpy(input + len, line, n + 1);
+        len += n;
+        depth += brace_depth(line);
+        if (depth > 0)
+            continue;
+
+        if (strspn(input, " \t\r\n") < len)
+        {
+            struct parser *p = new_parser(input);
+            struct error_scope err_s;
+
+            if (!session_eval(&ss, p, &err_s))
+            {
+                fflush(stdout);
+                print_error(stderr, p, &err_s);
+            }
+            else if (fuel.error)
+            {
+                fflush(stdout);
+                print_fail(stderr);
+            }
+            else
+            {
+                struct ast *chunk = ss.chunks[ss.size - 1];
+                // a funk definition has no value to show
+                if (chunk->size && chunk->edges[chunk->size - 1]->type != _funcdef)
+                {
+                    printf("= ");
+                    val_fprint(stdout, ss.run.current_val);
+                    printf("\n");
+                }
+            }
+
+            clean_parser(p);
+        }
+
+        len = 0;
+        depth = 0;
     }
 
-    char *content = readfile(argv[1]);
+    if (tty)
+        printf("\n");
+
+    free(line);
+    free(input);
+    session_clean(&ss);
+    fuel_end();
+}
+
+// A script of --jobs : run by a worker, printed by the main thread in input order
+struct job
+{
+    char *path;
+    char *out;
+    size_t out_size;
+    char *err;
+    size_t err_size;
+    int ok;
+    // its budget stopped it
+    int stopped;
+    int done;
+};
+
+struct pool
+{
+    struct job *jobs;
+    int count;
+    // first job no worker took yet
+    int next;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+};
+
+// Everything the script prints and its result go to j->out, errors to j->err
+static void run_job(struct job *j)
+{
+    FILE *out = open_memstream(&j->out, &j->out_size);
+    FILE *err = open_memstream(&j->err, &j->err_size);
+    char *content = readfile(j->path);
 
-    struct ast ast;
+    if (!content)
+    {
+        fprintf(err, "\n%sERROR:%s could not read %s\n", CRED, CNRM, j->path);
+        fclose(out);
+        fclose(err);
+        return;
+    }
+
+    struct ast ast = {0};
     struct scope s;
     struct error_scope err_s;
     struct parser *p = new_parser(content);
-    if (my_calc(p, &ast, &err_s) && eval(&ast, &s))
+
+    if (my_calc(p, &ast, &err_s) && eval(&ast, &s, out))
     {
-        printf("\nResult : %ld\n", s.current_val);
+        // a runtime error fails this script only, the others go on
+        if (fuel.error)
+        {
+            print_fail(err);
+        }
+        else if (fuel.out)
+        {
+            print_partial(out);
+            print_stop(err, p);
+            j->stopped = 1;
+        }
+        else
+        {
+            fprintf(out, "\nResult : ");
+            val_fprint(out, s.current_val);
+            fprintf(out, "\n");
+        }
+        val_drop(s.current_val);
+        j->ok = !fuel.error;
     }
     else
     {
-        fprintf(stderr, "\n%sERROR:%s\n", CRED, CNRM);
+        print_error(err, p, &err_s);
+    }
+
+    fuel_end();
+    clean_parser(p);
+    clean_ast(&ast);
+    mem_free(MEM_SOURCE, content);
+    fclose(out);
+    fclose(err);
+}
+
+static void *worker(void *arg)
+{
+    struct pool *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->next < pool->count)
+    {
+        struct job *j = &pool->jobs[pool->next++];
+        pthread_mutex_unlock(&pool->lock);
+
+        run_job(j);
+
+        pthread_mutex_lock(&pool->lock);
+        j->done = 1;
+        pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
 
-        if (err_s.begin != -1)
+// Run the scripts of paths on nthreads threads. Each one is printed once it
+// finished and every script before it was printed, a script failing does not stop
+// the others. Returns 0 if all of them ran to their end, FUEL_STATUS if they ran
+// but a budget stopped some.
+static int run_jobs(char **paths, int count, int nthreads)
+{
+    struct pool pool = {calloc(count, sizeof(struct job)), count, 0};
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.done, NULL);
+
+    for (int i = 0; i < count; i++)
+        pool.jobs[i].path = paths[i];
+
+    if (nthreads > count)
+        nthreads = count;
+    pthread_t *threads = calloc(nthreads, sizeof(pthread_t));
+    pthread_attr_t attr;
+    callstack_attr(&attr);
+    int started = 0;
+    for (int i = 0; i < nthreads; i++)
+        started += !pthread_create(&threads[started], &attr, worker, &pool);
+    pthread_attr_destroy(&attr);
+    // no thread could start : the scripts run on this one
+    if (!started)
+        worker(&pool);
+
+    int failed = 0;
+    int stopped = 0;
+    for (int i = 0; i < count; i++)
+    {
+        struct job *j = &pool.jobs[i];
+
+        pthread_mutex_lock(&pool.lock);
+        while (!j->done)
+            pthread_cond_wait(&pool.done, &pool.lock);
+        pthread_mutex_unlock(&pool.lock);
+
+        printf("%s==> %s <==\n", i ? "\n" : "", j->path);
+        fwrite(j->out, 1, j->out_size, stdout);
+        fflush(stdout);
+        fwrite(j->err, 1, j->err_size, stderr);
+        failed |= !j->ok;
+        stopped |= j->stopped;
+
+        free(j->out);
+        free(j->err);
+    }
+
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+    free(pool.jobs);
+    pthread_cond_destroy(&pool.done);
+    pthread_mutex_destroy(&pool.lock);
+
+    return failed ? 1 : stopped ? FUEL_STATUS : 0;
+}
+
+struct run_options
+{
+    int interactive;
+    int emit;
+    char *exe;
+    int jobs;
+    int prof;
+    char *folded;
+    int stats;
+    int hz;
+    char **files;
+    int count;
+};
+
+// The REPL, the jobs or the one file the options ask for
+static int run(void *arg)
+{
+    struct run_options *o = arg;
+
+    if (o->interactive)
+    {
+        repl();
+        if (mem_tracking)
+            mem_report(stderr);
+        return 0;
+    }
+
+    if (o->jobs)
+        return run_jobs(o->files, o->count, o->jobs);
+
+    // native code has no line to attribute its time to, and counts no call
+    if (o->prof || o->stats)
+        jit_configure(0);
+
+    stats_begin(PHASE_READFILE);
+    char *content = readfile(o->files[0]);
+    stats_end(PHASE_READFILE);
+
+    if (!content)
+    {
+        fprintf(stderr, "\n%sERROR:%s could not read %s\n", CRED, CNRM, o->files[0]);
+        return 1;
+    }
+
+    struct ast ast = {0};
+    struct scope s;
+    struct error_scope err_s;
+    struct parser *p = new_parser(content);
+    int parsed = 0;
+    int status = 1;
+    if (o->emit || o->exe)
+        parsed = my_calc(p, &ast, &err_s);
+
+    if (parsed && (!o->emit || emit_c(&ast, stdout, o->files[0], &err_s))
+        && (!o->exe || build_native(&ast, o->files[0], o->exe, &err_s)))
+    {
+        report_stats(o->stats, p);
+        clean_parser(p);
+        clean_ast(&ast);
+        mem_free(MEM_SOURCE, content);
+        if (mem_tracking)
+            mem_report(stderr);
+        return 0;
+    }
+    else if (!o->emit && !o->exe && my_calc(p, &ast, &err_s) && (!o->prof || profile_start(content))
+             && (!o->hz || sampler_start(o->hz, content)) && eval(&ast, &s, stdout))
+    {
+        if (o->prof)
+            profile_stop();
+        if (o->hz)
+            sampler_stop();
+
+        if (fuel.error)
         {
-            p->last_pos = err_s.begin;
+            fflush(stdout);
+            print_fail(stderr);
         }
-        // gestion d'erreur
-        char *errline = get_line_error(p);
-        struct position pos;
-        count_lines(p, &pos);
-        fprintf(stderr, "line: %d, col: %d\n", pos.line, pos.col);
-        fprintf(stderr, "%s\n", errline);
-        for (int i = 0; i < pos.col - 1; i += 1)
-            fprintf(stderr, " ");
-        if (err_s.begin != -1)
+        else if (fuel.out)
         {
-            for (int i = 0; i < (err_s.end-err_s.begin); i++)
-            {
-                fprintf(stderr, "%s^", CRED);
-            }
-            fprintf(stderr, "%s\n", CNRM);
-            
-            fprintf(stderr, "err : %s\n", err_s.err);
-        } else {
-            fprintf(stderr, "%s^%s\n", CRED, CNRM);
+            print_partial(stdout);
+            fflush(stdout);
+            print_stop(stderr, p);
+            status = FUEL_STATUS;
+        }
+        else
+        {
+            printf("\nResult : ");
+            val_fprint(stdout, s.current_val);
+            printf("\n");
+            status = 0;
+        }
+        val_drop(s.current_val);
+
+        if (o->prof)
+        {
+            fflush(stdout);
+            profile_report(stderr);
+
+            FILE *f;
+            if (o->folded && (!(f = fopen(o->folded, "w")) || !profile_folded(f) || fclose(f)))
+                fprintf(stderr, "\n%sERROR:%s could not write %s\n", CRED, CNRM, o->folded);
+            profile_free();
+        }
+
+        if (o->hz)
+        {
+            fflush(stdout);
+            sampler_report(stderr);
+            sampler_free();
         }
-        free(errline);
+    }
+    else if (parsed && err_s.begin == -1)
+    {
+        // the program was fine, cc already reported why it failed
+        fprintf(stderr, "\n%sERROR:%s could not build %s\n", CRED, CNRM, o->exe);
+    }
+    else
+    {
+        print_error(stderr, p, &err_s);
     }
 
+    fuel_end();
+    report_stats(o->stats, p);
     clean_parser(p);
     clean_ast(&ast);
-    free(content);
-    return 1;
+    mem_free(MEM_SOURCE, content);
+    // after every release, live bytes left are leaks
+    if (mem_tracking)
+        mem_report(stderr);
+    return status;
+}
+
+static void usage(char *name)
+{
+    printf("Usage: %s [options] file.g\n", name);
+    printf("       %s --repl\n", name);
+    printf("       %s --jobs N file.g...\n", name);
+    printf("  --repl              read, check and run statements and funks from stdin one by one\n");
+    printf("  --jobs N            run every file on N threads, printing their output and result in order\n");
+    printf("  --threads N         worker threads of reduce (default one per CPU)\n");
+    printf("  --emit-c            print the program as C instead of running it\n");
+    printf("  -o FILE             compile the program to the native executable FILE\n");
+    printf("  --no-jit            interpret every funk\n");
+    printf("  --no-loop-opt       evaluate while blocks as written\n");
+    printf("  --jit-threshold N   calls before a funk is compiled (default %d)\n", JIT_DEFAULT_THRESHOLD);
+    printf("  --profile           report time and evaluations per funk and line on stderr (interprets every funk)\n");
+    printf("  --folded FILE       with --profile, write folded call stacks for flamegraph tools to FILE\n");
+    printf("  --sample[=HZ]       sample the running node and funk calls HZ times per CPU second (default %d)\n",
+           SAMPLER_DEFAULT_HZ);
+    printf("  --max-steps N       stop after N loop turns and calls, exit status %d\n", FUEL_STATUS);
+    printf("  --timeout-ms N      stop after N ms of wall time, exit status %d\n", FUEL_STATUS);
+    printf("  --max-depth N       funk calls running at most, with a stack to hold them (default %d)\n",
+           CALLSTACK_DEFAULT_DEPTH);
+    printf("  --mem-stats         report live, peak and total bytes allocated by each subsystem on stderr\n");
+    printf("  --stats[=json]      report phase timings and runtime counters on stderr, as text or JSON\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static struct option options[] = {
+        {"emit-c", no_argument, 0, 'c'},
+        {"repl", no_argument, 0, 'r'},
+        {"jobs", required_argument, 0, 'j'},
+        {"threads", required_argument, 0, 'T'},
+        {"no-jit", no_argument, 0, 'n'},
+        {"no-loop-opt", no_argument, 0, 'l'},
+        {"jit-threshold", required_argument, 0, 't'},
+        {"profile", no_argument, 0, 'p'},
+        {"folded", required_argument, 0, 'f'},
+        {"stats", optional_argument, 0, 's'},
+        {"sample", optional_argument, 0, 'S'},
+        {"mem-stats", no_argument, 0, 'm'},
+        {"max-steps", required_argument, 0, 'M'},
+        {"timeout-ms", required_argument, 0, 'W'},
+        {"max-depth", required_argument, 0, 'D'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0},
+    };
+
+    int emit = 0;
+    int interactive = 0;
+    int jobs = 0;
+    char *exe = NULL;
+    int prof = 0;
+    char *folded = NULL;
+    int stats = 0;
+    int hz = 0;
+    long max_steps = 0;
+    long timeout_ms = 0;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "ho:", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            emit = 1;
+            break;
+        case 'r':
+            interactive = 1;
+            break;
+        case 'j':
+            jobs = atoi(optarg);
+            if (jobs <= 0)
+            {
+                usage(argv[0]);
+                return 0;
+            }
+            break;
+        case 'T':
+            if (atoi(optarg) <= 0)
+            {
+                usage(argv[0]);
+                return 0;
+            }
+            reduce_configure(atoi(optarg));
+            break;
+        case 'o':
+            exe = optarg;
+            break;
+        case 'n':
+            jit_configure(0);
+            break;
+        case 'l':
+            loop_opt_configure(0);
+            break;
+        case 't':
+            jit_configure(atoi(optarg) > 0 ? atoi(optarg) : 1);
+            break;
+        case 'p':
+            prof = 1;
+            break;
+        case 'f':
+            prof = 1;
+            folded = optarg;
+            break;
+        case 'm':
+            mem_tracking = 1;
+            break;
+        case 'M':
+        case 'W':
+            if (atol(optarg) <= 0)
+            {
+                usage(argv[0]);
+                return 0;
+            }
+            *(opt == 'M' ? &max_steps : &timeout_ms) = atol(optarg);
+            break;
+        case 'D':
+            if (atol(optarg) <= 0)
+            {
+                usage(argv[0]);
+                return 0;
+            }
+            callstack_configure(atol(optarg));
+            break;
+        case 'S':
+            hz = optarg ? atoi(optarg) : SAMPLER_DEFAULT_HZ;
+            if (hz <= 0)
+            {
+                usage(argv[0]);
+                return 0;
+            }
+            break;
+        case 's':
+            if (optarg && strcmp(optarg, "json") && strcmp(optarg, "text"))
+            {
+                usage(argv[0]);
+                return 0;
+            }
+            stats = optarg && !strcmp(optarg, "json") ? 2 : 1;
+            stats_enabled = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 0;
+        }
+    }
+
+    // reports and diagnostics cover the whole process, not one script
+    if (jobs && (interactive || emit || exe || prof || hz || stats || mem_tracking))
+    {
+        printf("--jobs cannot be used with --repl, --emit-c, -o, --profile, --sample, --stats or --mem-stats.\n");
+        return 0;
+    }
+
+    // native code and REPL inputs run without a budget
+    if ((max_steps || timeout_ms) && (interactive || emit || exe))
+    {
+        printf("--max-steps and --timeout-ms cannot be used with --repl, --emit-c or -o.\n");
+        return 0;
+    }
+    fuel_configure(max_steps, timeout_ms);
+    // a runtime error stops the run, which reports it, instead of the process
+    fuel_traps = 1;
+
+    if (!interactive && optind >= argc)
+    {
+        printf("Filename argument expected.\n");
+        return 0;
+    }
+
+    struct run_options o = {interactive, emit, exe, jobs, prof, folded, stats, hz, argv + optind, argc - optind};
+    // the evaluator recurses on the stack of this run, sized for --max-depth
+    return callstack_run(run, &o);
 }
@@ -0,0 +1,859 @@
+#include "emit_c.h"
+#include "builtins.h"
+#include "callstack.h"
+#include "str.h"
+#include "mem.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#ifndef GUAC_SRCDIR
+#define GUAC_SRCDIR "."
+#endif
+
+// sources of the runtime linked into native executables
+static const char *runtime_sources[] = {"builtins.c", "scope.c", "bigint.c", "array.c", "str.c", "out.c", "in.c", "fuel.c", "mem.c"};
+
+// Set of names, borrowed from the AST
+struct name_set
+{
+    const char **names;
+    int size;
+};
+
+struct cfunk
+{
+    struct ast *def;
+    // C symbol f_<name>_<n>, n counting the earlier funks of the same name
+    char cname[64];
+    struct name_set args;
+    struct name_set locals;
+    // every name read, written or bound by the funk
+    struct name_set mentions;
+    struct name_set calls;
+    int recursive;
+};
+
+struct cprog
+{
+    struct cfunk *funks;
+    int nfunks;
+    // names assigned by top level code
+    struct name_set globals;
+    // names living in a C global, bound dynamically like the interpreter scopes
+    struct name_set dynamic;
+    struct error_scope *err_s;
+};
+
+// Emission context : the funk being emitted (NULL for main)
+struct cctx
+{
+    struct cprog *prog;
+    struct cfunk *funk;
+    FILE *o;
+};
+
+static int set_has(struct name_set *set, const char *name)
+{
+    for (int i = 0; i < set->size; i++)
+    {
+        if (!strcmp(set->names[i], name))
+            return 1;
+    }
+
+    return 0;
+}
+
+static void set_add(struct name_set *set, const char *name)
+{
+    if (set_has(set, name))
+        return;
+
+    set->names = reallocarray(set->names, set->size + 1, sizeof(char *));
+    set->names[set->size] = name;
+    set->size += 1;
+}
+
+// ANALYSIS
+
+static int defs_of(struct cprog *p, const char *name);
+
+// Builtin called by name, NULL when a funk of the program shadows it
+static const struct builtin *builtin_of(struct cprog *p, const char *name)
+{
+    return defs_of(p, name) ? NULL : find_builtin(name);
+}
+
+static int collect_funk(struct cprog *p, struct cfunk *f, struct ast *ast)
+{
+    if (ast->type == _funcdef)
+        return throw_err(ast, p->err_s, "--emit-c does not support funks defined inside funks!");
+
+    // an element assignment needs the array, it does not define it
+    if (ast->type == _opeq && ast->edges[0]->type == _var && !set_has(&f->args, ast->edges[0]->val.strval))
+        set_add(&f->locals, ast->edges[0]->val.strval);
+    if (ast->type == _var || ast->type == _index)
+        set_add(&f->mentions, ast->val.strval);
+    if (ast->type == _funccall && !builtin_of(p, ast->val.strval))
+        set_add(&f->calls, ast->val.strval);
+
+    for (int i = 0; i < ast->size; i++)
+    {
+        if (!collect_funk(p, f, ast->edges[i]))
+            return 0;
+    }
+
+    return 1;
+}
+
+static int collect_top(struct cprog *p, struct ast *ast)
+{
+    if (ast->type == _funcdef)
+    {
+        p->funks = reallocarray(p->funks, p->nfunks + 1, sizeof(struct cfunk));
+        struct cfunk *f = &p->funks[p->nfunks];
+        memset(f, 0, sizeof(struct cfunk));
+        f->def = ast;
+
+        int same = 0;
+        for (int i = 0; i < p->nfunks; i++)
+        {
+            if (!strcmp(p->funks[i].def->val.strval, ast->val.strval))
+                same += 1;
+        }
+        snprintf(f->cname, sizeof(f->cname), "f_%.40s_%d", ast->val.strval, same);
+        p->nfunks += 1;
+
+        for (int i = 0; i < ast->edges[0]->size; i++)
+        {
+            set_add(&f->args, ast->edges[0]->edges[i]->val.strval);
+            set_add(&f->mentions, ast->edges[0]->edges[i]->val.strval);
+        }
+
+        return collect_funk(p, f, ast->edges[1]);
+    }
+
+    if (ast->type == _opeq)
+        set_add(&p->globals, ast->edges[0]->val.strval);
+
+    for (int i = 0; i < ast->size; i++)
+    {
+        if (!collect_top(p, ast->edges[i]))
+            return 0;
+    }
+
+    return 1;
+}
+
+static int defs_of(struct cprog *p, const char *name)
+{
+    int n = 0;
+    for (int i = 0; i < p->nfunks; i++)
+    {
+        if (!strcmp(p->funks[i].def->val.strval, name))
+            n += 1;
+    }
+
+    return n;
+}
+
+// reduce runs copies of a funk on threads of the interpreter, native code has neither
+static int no_reduce(struct cprog *p, struct ast *ast)
+{
+    const struct builtin *b;
+    if (ast->type == _funccall && (b = builtin_of(p, ast->val.strval)) && b->funk)
+        return throw_err(ast, p->err_s, "--emit-c does not support reduce!");
+
+    for (int i = 0; i < ast->size; i++)
+    {
+        if (!no_reduce(p, ast->edges[i]))
+            return 0;
+    }
+
+    return 1;
+}
+
+// A call in a return may go to a funk defined later, the C function it calls must exist
+static int calls_defined(struct cprog *p, struct ast *ast)
+{
+    if (ast->type == _funccall && !builtin_of(p, ast->val.strval))
+    {
+        int found = 0;
+        for (int i = 0; i < p->nfunks; i++)
+        {
+            struct ast *def = p->funks[i].def;
+            found |= !strcmp(def->val.strval, ast->val.strval) && def->edges[0]->size == ast->size;
+        }
+        if (!found)
+            return throw_err(ast, p->err_s, "--emit-c does not support a call to a funk never defined with its args!");
+    }
+
+    for (int i = 0; i < ast->size; i++)
+    {
+        if (!calls_defined(p, ast->edges[i]))
+            return 0;
+    }
+
+    return 1;
+}
+
+static int reaches(struct cprog *p, struct cfunk *from, struct cfunk *to, char *seen)
+{
+    for (int i = 0; i < from->calls.size; i++)
+    {
+        for (int j = 0; j < p->nfunks; j++)
+        {
+            struct cfunk *g = &p->funks[j];
+            if (seen[j] || strcmp(g->def->val.strval, from->calls.names[i]))
+                continue;
+            if (g == to)
+                return 1;
+
+            seen[j] = 1;
+            if (reaches(p, g, to, seen))
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+// A funk call copies the caller scope in and writes the non-arg names back :
+// this is dynamic scoping. A name only becomes a plain C local of f when no
+// other code can see it, otherwise it lives in a C global with args saved and
+// restored around the call, which behaves exactly like the interpreter.
+static int is_private(struct cprog *p, struct cfunk *f, const char *name)
+{
+    if (set_has(&p->globals, name))
+        return 0;
+
+    for (int i = 0; i < p->nfunks; i++)
+    {
+        if (&p->funks[i] != f && set_has(&p->funks[i].mentions, name))
+            return 0;
+    }
+
+    if (set_has(&f->args, name))
+        return 1;
+
+    return set_has(&f->locals, name) && !f->recursive;
+}
+
+// EMISSION
+
+static void indent(struct cctx *c, int depth)
+{
+    for (int i = 0; i < depth; i++)
+        fprintf(c->o, "    ");
+}
+
+static void gen_name(struct cctx *c, const char *name)
+{
+    if (c->funk && !set_has(&c->prog->dynamic, name))
+        fprintf(c->o, "l_%s", name);
+    else
+        fprintf(c->o, "v_%s", name);
+}
+
+static int has_call(struct ast *ast)
+{
+    if (ast->type == _funccall)
+        return 1;
+
+    for (int i = 0; i < ast->size; i++)
+    {
+        if (has_call(ast->edges[i]))
+            return 1;
+    }
+
+    return 0;
+}
+
+static void gen_expr(struct cctx *c, struct ast *ast);
+
+// A string literal, built on its first use then shared like an interned one
+static void gen_string(struct cctx *c, value v)
+{
+    char buf[STR_INLINE + 1];
+    const char *bytes = str_bytes(v, buf);
+    long n = str_len(v);
+
+    fprintf(c->o, "({ static value _k; if (!_k) _k = str_new(\"");
+    for (long i = 0; i < n; i++)
+    {
+        unsigned char b = bytes[i];
+        if (b < ' ' || b > '~' || b == '"' || b == '\\' || b == '?')
+            fprintf(c->o, "\\%03o", b);
+        else
+            fputc(b, c->o);
+    }
+    fprintf(c->o, "\", %ldL); val_ref(_k); })", n);
+}
+
+// C text around the operands of a binary operator, operands and result are owned values
+static void op_parts(struct ast *ast, const char **pre, const char **mid, const char **post)
+{
+    const char *op = ast->val.strval;
+    static const char *calls[][2] = {
+        {"+", "val_add("}, {"-", "val_sub("}, {"*", "val_mul("}, {"/", "val_div("}, {"%%", "val_mod("},
+        {"^", "val_pow("}};
+    static const char *comps[][2] = {
+        {"==", ") == 0)"}, {"!=", ") != 0)"}, {"<=", ") <= 0)"}, {"<", ") < 0)"}, {">=", ") >= 0)"}, {">", ") > 0)"}};
+
+    *mid = ", ";
+    *post = ")";
+
+    if (ast->type == _opcomp)
+    {
+        *pre = "VAL_SMALL(gcmp(";
+        for (size_t i = 0; i < sizeof(comps) / sizeof(comps[0]); i++)
+        {
+            if (!strcmp(op, comps[i][0]))
+                *post = comps[i][1];
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof(calls) / sizeof(calls[0]); i++)
+    {
+        if (!strcmp(op, calls[i][0]))
+            *pre = calls[i][1];
+    }
+}
+
+static void gen_call(struct cctx *c, struct ast *ast)
+{
+    const char *name = ast->val.strval;
+    const struct builtin *b = builtin_of(c->prog, name);
+
+    // arguments are evaluated left to right like the interpreter
+    fprintf(c->o, "({ ");
+    for (int i = 0; i < ast->size; i++)
+    {
+        fprintf(c->o, "value _a%d = ", i);
+        gen_expr(c, ast->edges[i]);
+        fprintf(c->o, "; ");
+    }
+
+    // builtins with effects write to the buffer given first, pure ones and those reading the input return their value
+    int out = b && !b->pure;
+    if (b && b->pure)
+        fprintf(c->o, "value _v = _%s(", name);
+    else if (b && b->reads)
+        fprintf(c->o, "value _v = _%s(&scan_in", name);
+    else if (b)
+        fprintf(c->o, "_%s(&print_out", name);
+    else if (defs_of(c->prog, name) > 1)
+        fprintf(c->o, "fp_%s(", name);
+    else
+        fprintf(c->o, "f_%s_0(", name);
+
+    for (int i = 0; i < ast->size; i++)
+        fprintf(c->o, i || out ? ", _a%d" : "_a%d", i);
+    // args a builtin can do without are 0
+    for (int i = ast->size; b && i < b->arity; i++)
+        fprintf(c->o, i || out ? ", 0" : "0");
+
+    // funks own their args, a builtin borrows them and leaves the last one as current value
+    if (!b)
+        fprintf(c->o, "); })");
+    else if (b->pure || b->reads)
+    {
+        fprintf(c->o, "); ");
+        for (int i = 0; i < ast->size; i++)
+            fprintf(c->o, "val_drop(_a%d); ", i);
+        fprintf(c->o, "_v; })");
+    }
+    else if (ast->size)
+    {
+        fprintf(c->o, "); ");
+        for (int i = 0; i < ast->size - 1; i++)
+            fprintf(c->o, "val_drop(_a%d); ", i);
+        fprintf(c->o, "_a%d; })", ast->size - 1);
+    }
+    else
+        fprintf(c->o, "); val_ref(cur); })");
+}
+
+static void gen_expr(struct cctx *c, struct ast *ast)
+{
+    switch (ast->type)
+    {
+    case _const:
+        if (val_is_small(ast->val.intval))
+            fprintf(c->o, "VAL_SMALL(%ldL)", val_untag(ast->val.intval));
+        else if (val_is_str(ast->val.intval))
+            gen_string(c, ast->val.intval);
+        else
+        {
+            char *digits = val_str(ast->val.intval);
+            fprintf(c->o, "val_parse(\"%s\")", digits);
+            mem_free(MEM_BIGNUM, digits);
+        }
+        return;
+    case _var:
+        fprintf(c->o, "val_ref(");
+        gen_name(c, ast->val.strval);
+        fprintf(c->o, ")");
+        return;
+    case _opuna:
+        if (ast->val.strval[0] != '+')
+            fprintf(c->o, ast->val.strval[0] == '-' ? "val_neg(" : "val_not(");
+        gen_expr(c, ast->edges[0]);
+        if (ast->val.strval[0] != '+')
+            fprintf(c->o, ")");
+        return;
+    case _funccall:
+        gen_call(c, ast);
+        return;
+    case _index:
+        fprintf(c->o, "({ value _i = ");
+        gen_expr(c, ast->edges[0]);
+        fprintf(c->o, "; value _e = array_get(");
+        gen_name(c, ast->val.strval);
+        fprintf(c->o, ", _i); val_drop(_i); _e; })");
+        return;
+    case _array:
+        // elements are evaluated left to right like the interpreter
+        fprintf(c->o, "({ value _x[%d]; ", ast->size ? ast->size : 1);
+        for (int i = 0; i < ast->size; i++)
+        {
+            fprintf(c->o, "_x[%d] = ", i);
+            gen_expr(c, ast->edges[i]);
+            fprintf(c->o, "; ");
+        }
+        fprintf(c->o, "value _r = array_from(_x, %d); ", ast->size);
+        for (int i = 0; i < ast->size; i++)
+            fprintf(c->o, "val_drop(_x[%d]); ", i);
+        fprintf(c->o, "_r; })");
+        return;
+    default:
+        break;
+    }
+
+    // && and || stop at their left operand when it decides, like C
+    if (ast->type == _oplogic)
+    {
+        fprintf(c->o, "VAL_SMALL(gtruth(");
+        gen_expr(c, ast->edges[0]);
+        fprintf(c->o, ast->val.strval[0] == '&' ? ") && gtruth(" : ") || gtruth(");
+        gen_expr(c, ast->edges[1]);
+        fprintf(c->o, "))");
+        return;
+    }
+
+    const char *pre = "", *mid = "", *post = "";
+    op_parts(ast, &pre, &mid, &post);
+
+    // operands are evaluated left to right when calls are involved
+    if (has_call(ast->edges[0]) || has_call(ast->edges[1]))
+    {
+        fprintf(c->o, "({ value _l = ");
+        gen_expr(c, ast->edges[0]);
+        fprintf(c->o, "; value _r = ");
+        gen_expr(c, ast->edges[1]);
+        fprintf(c->o, "; %s_l%s_r%s; })", pre, mid, post);
+        return;
+    }
+
+    fprintf(c->o, "%s", pre);
+    gen_expr(c, ast->edges[0]);
+    fprintf(c->o, "%s", mid);
+    gen_expr(c, ast->edges[1]);
+    fprintf(c->o, "%s", post);
+}
+
+// cur = E;
+static void gen_cur(struct cctx *c, struct ast *ast, int depth)
+{
+    indent(c, depth);
+    fprintf(c->o, "val_assign(&cur, ");
+    gen_expr(c, ast);
+    fprintf(c->o, ");\n");
+}
+
+static int has_return(struct ast *ast)
+{
+    if (ast->type == _opcontrol && !strcmp(ast->val.strval, "return"))
+        return 1;
+
+    for (int i = 0; i < ast->size; i++)
+    {
+        if (has_return(ast->edges[i]))
+            return 1;
+    }
+
+    return 0;
+}
+
+static void gen_stmt(struct cctx *c, struct ast *ast, int depth);
+
+static void gen_compound(struct cctx *c, struct ast *ast, int depth)
+{
+    for (int i = 0; i < ast->size; i++)
+        gen_stmt(c, ast->edges[i], depth);
+}
+
+static void gen_ifelse(struct cctx *c, struct ast *ast, int i, int depth)
+{
+    struct ast *branch = ast->edges[i];
+
+    if (!strcmp(branch->val.strval, "else"))
+    {
+        gen_compound(c, branch->edges[0], depth);
+        return;
+    }
+
+    gen_cur(c, branch->edges[0], depth);
+    indent(c, depth);
+    fprintf(c->o, "if (cur)\n");
+    indent(c, depth);
+    fprintf(c->o, "{\n");
+    gen_compound(c, branch->edges[1], depth + 1);
+    indent(c, depth);
+    fprintf(c->o, "}\n");
+
+    if (i + 1 < ast->size)
+    {
+        indent(c, depth);
+        fprintf(c->o, "else\n");
+        indent(c, depth);
+        fprintf(c->o, "{\n");
+        gen_ifelse(c, ast, i + 1, depth + 1);
+        indent(c, depth);
+        fprintf(c->o, "}\n");
+    }
+}
+
+static void gen_stmt(struct cctx *c, struct ast *ast, int depth)
+{
+    switch (ast->type)
+    {
+    case _funcdef:
+        if (defs_of(c->prog, ast->val.strval) > 1)
+        {
+            for (int i = 0; i < c->prog->nfunks; i++)
+            {
+                if (c->prog->funks[i].def == ast)
+                {
+                    indent(c, depth);
+                    fprintf(c->o, "fp_%s = %s;\n", ast->val.strval, c->prog->funks[i].cname);
+                }
+            }
+        }
+        return;
+    case _opeq:
+        if (ast->edges[0]->type == _index)
+        {
+            // index, then value, like the interpreter
+            indent(c, depth);
+            fprintf(c->o, "{\n");
+            indent(c, depth + 1);
+            fprintf(c->o, "value _i = ");
+            gen_expr(c, ast->edges[0]->edges[0]);
+            fprintf(c->o, ";\n");
+            gen_cur(c, ast->edges[1], depth + 1);
+            indent(c, depth + 1);
+            fprintf(c->o, "array_set(&");
+            gen_name(c, ast->edges[0]->val.strval);
+            fprintf(c->o, ", _i, cur);\n");
+            indent(c, depth + 1);
+            fprintf(c->o, "val_drop(_i);\n");
+            indent(c, depth);
+            fprintf(c->o, "}\n");
+            return;
+        }
+
+        // x = x + e, cur lets go of x so a string held once is appended to in place
+        if (ast->val.strval[0] == '+')
+        {
+            indent(c, depth);
+            fprintf(c->o, "{ value _r = ");
+            gen_expr(c, ast->edges[1]->edges[1]);
+            fprintf(c->o, "; val_assign(&cur, 0); ");
+            gen_name(c, ast->edges[0]->val.strval);
+            fprintf(c->o, " = val_add(");
+            gen_name(c, ast->edges[0]->val.strval);
+            fprintf(c->o, ", _r); }\n");
+            indent(c, depth);
+            fprintf(c->o, "val_assign(&cur, val_ref(");
+            gen_name(c, ast->edges[0]->val.strval);
+            fprintf(c->o, "));\n");
+            return;
+        }
+
+        indent(c, depth);
+        fprintf(c->o, "val_assign(&");
+        gen_name(c, ast->edges[0]->val.strval);
+        fprintf(c->o, ", ");
+        gen_expr(c, ast->edges[1]);
+        fprintf(c->o, ");\n");
+        indent(c, depth);
+        fprintf(c->o, "val_assign(&cur, val_ref(");
+        gen_name(c, ast->edges[0]->val.strval);
+        fprintf(c->o, "));\n");
+        return;
+    case _opcontrol:
+        // while blocks are C loops, return leaves through the cleanup of the funk
+        if (!strcmp(ast->val.strval, "return"))
+        {
+            gen_cur(c, ast->edges[0], depth);
+            indent(c, depth);
+            fprintf(c->o, "goto out;\n");
+            return;
+        }
+
+        indent(c, depth);
+        fprintf(c->o, !strcmp(ast->val.strval, "break") ? "break;\n" : "continue;\n");
+        return;
+    case _block:
+        if (!strcmp(ast->val.strval, "ifelse"))
+            gen_ifelse(c, ast, 0, depth);
+        return;
+    case _loop:
+    {
+        struct ast *body = ast->edges[1];
+
+        if (!body->size)
+        {
+            gen_cur(c, ast->edges[0], depth);
+            return;
+        }
+
+        indent(c, depth);
+        fprintf(c->o, "for (;;)\n");
+        indent(c, depth);
+        fprintf(c->o, "{\n");
+        gen_cur(c, ast->edges[0], depth + 1);
+        indent(c, depth + 1);
+        fprintf(c->o, "if (!cur)\n");
+        indent(c, depth + 2);
+        fprintf(c->o, "break;\n");
+
+        gen_compound(c, body, depth + 1);
+
+        indent(c, depth);
+        fprintf(c->o, "}\n");
+        return;
+    }
+    default:
+        gen_cur(c, ast, depth);
+        return;
+    }
+}
+
+static void gen_params(struct cctx *c, struct cfunk *f)
+{
+    fprintf(c->o, "(");
+    for (int i = 0; i < f->args.size; i++)
+    {
+        fprintf(c->o, i ? ", value " : "value ");
+        if (set_has(&c->prog->dynamic, f->args.names[i]))
+            fprintf(c->o, "p_%s", f->args.names[i]);
+        else
+            fprintf(c->o, "l_%s", f->args.names[i]);
+    }
+    fprintf(c->o, f->args.size ? ")" : "void)");
+}
+
+static void gen_funk(struct cctx *c, struct cfunk *f)
+{
+    struct name_set *dyn = &c->prog->dynamic;
+
+    c->funk = f;
+    fprintf(c->o, "\nstatic value %s", f->cname);
+    gen_params(c, f);
+    fprintf(c->o, "\n{\n    value cur = 0;\n");
+    // recursion stops as in the interpreter instead of overflowing the stack
+    if (f->recursive)
+        fprintf(c->o, "    if (++calls > %d || (char *)__builtin_frame_address(0) < stack_limit)\n        deep();\n",
+                CALLSTACK_DEFAULT_DEPTH);
+
+    for (int i = 0; i < f->args.size; i++)
+    {
+        const char *a = f->args.names[i];
+        if (set_has(dyn, a))
+            fprintf(c->o, "    value s_%s = v_%s;\n    v_%s = p_%s;\n", a, a, a, a);
+    }
+    for (int i = 0; i < f->locals.size; i++)
+    {
+        if (!set_has(dyn, f->locals.names[i]))
+            fprintf(c->o, "    value l_%s = 0;\n", f->locals.names[i]);
+    }
+
+    gen_compound(c, f->def->edges[1], 1);
+    if (has_return(f->def->edges[1]))
+        fprintf(c->o, "out:\n");
+
+    for (int i = 0; i < f->args.size; i++)
+    {
+        const char *a = f->args.names[i];
+        if (set_has(dyn, a))
+            fprintf(c->o, "    val_drop(v_%s);\n    v_%s = s_%s;\n", a, a, a);
+        else
+            fprintf(c->o, "    val_drop(l_%s);\n", a);
+    }
+    for (int i = 0; i < f->locals.size; i++)
+    {
+        if (!set_has(dyn, f->locals.names[i]))
+            fprintf(c->o, "    val_drop(l_%s);\n", f->locals.names[i]);
+    }
+    if (f->recursive)
+        fprintf(c->o, "    calls--;\n");
+    fprintf(c->o, "    return cur;\n}\n");
+    c->funk = NULL;
+}
+
+int emit_c(struct ast *ast, FILE *out, const char *source, struct error_scope *err_s)
+{
+    struct cprog p;
+    memset(&p, 0, sizeof(struct cprog));
+    p.err_s = err_s;
+
+    int ret = collect_top(&p, ast) && no_reduce(&p, ast) && calls_defined(&p, ast);
+
+    if (ret)
+    {
+        struct cctx c = {&p, NULL, out};
+        char *seen = calloc(p.nfunks + 1, sizeof(char));
+
+        for (int i = 0; i < p.nfunks; i++)
+        {
+            memset(seen, 0, p.nfunks);
+            p.funks[i].recursive = reaches(&p, &p.funks[i], &p.funks[i], seen);
+        }
+        free(seen);
+
+        for (int i = 0; i < p.globals.size; i++)
+            set_add(&p.dynamic, p.globals.names[i]);
+        for (int i = 0; i < p.nfunks; i++)
+        {
+            struct cfunk *f = &p.funks[i];
+            for (int j = 0; j < f->mentions.size; j++)
+            {
+                if (!is_private(&p, f, f->mentions.names[j]))
+                    set_add(&p.dynamic, f->mentions.names[j]);
+            }
+            for (int j = 0; j < f->locals.size; j++)
+            {
+                if (!is_private(&p, f, f->locals.names[j]))
+                    set_add(&p.dynamic, f->locals.names[j]);
+            }
+        }
+
+        fprintf(out, "// Generated by guacamole from %s\n", source);
+        fprintf(out, "#include \"array.h\"\n#include \"builtins.h\"\n#include \"str.h\"\n#include <stdio.h>\n#include <sys/resource.h>\n\n");
+        fprintf(out, "static inline __attribute__((unused)) int gcmp(value l, value r)\n"
+                     "{ int c = val_cmp(l, r); val_drop(l); val_drop(r); return c; }\n");
+        fprintf(out, "static inline __attribute__((unused)) int gtruth(value v)\n"
+                     "{ val_drop(v); return v != 0; }\n\n");
+        // calls of recursive funks running, the stack they may reach
+        fprintf(out, "static long calls;\nstatic char *stack_limit;\n");
+        fprintf(out, "static __attribute__((unused, noinline)) void deep(void)\n"
+                     "{\n    char msg[64];\n"
+                     "    if (calls > %d)\n        snprintf(msg, sizeof(msg), \"max depth of %d calls reached\");\n"
+                     "    else\n        snprintf(msg, sizeof(msg), \"out of stack after %%ld calls\", calls - 1);\n"
+                     "    val_die(msg);\n}\n\n",
+                CALLSTACK_DEFAULT_DEPTH, CALLSTACK_DEFAULT_DEPTH);
+
+        fprintf(out, "static struct out print_out;\nstatic struct in scan_in;\n");
+        for (int i = 0; i < p.dynamic.size; i++)
+            fprintf(out, "static value v_%s;\n", p.dynamic.names[i]);
+
+        for (int i = 0; i < p.nfunks; i++)
+        {
+            struct cfunk *f = &p.funks[i];
+            fprintf(out, "static value %s", f->cname);
+            gen_params(&c, f);
+            fprintf(out, ";\n");
+
+            if (defs_of(&p, f->def->val.strval) > 1 && !strcmp(f->cname + strlen(f->cname) - 2, "_0"))
+            {
+                fprintf(out, "static value (*fp_%s)", f->def->val.strval);
+                gen_params(&c, f);
+                fprintf(out, ";\n");
+            }
+        }
+
+        for (int i = 0; i < p.nfunks; i++)
+            gen_funk(&c, &p.funks[i]);
+
+        fprintf(out, "\nint main(void)\n{\n    value cur = 0;\n    out_open(&print_out, stdout);\n    in_open(&scan_in, stdin);\n");
+        fprintf(out, "    struct rlimit rl;\n    getrlimit(RLIMIT_STACK, &rl);\n"
+                     "    rlim_t size = rl.rlim_cur < (1L << 30) ? rl.rlim_cur : (1L << 30);\n"
+                     "    stack_limit = (char *)__builtin_frame_address(0) - size + %d;\n",
+                CALLSTACK_RESERVE);
+        gen_compound(&c, ast, 1);
+        fprintf(out, "    out_close(&print_out);\n    in_close(&scan_in);\n    printf(\"\\nResult : \");\n    val_fprint(stdout, cur);\n    printf(\"\\n\");\n    return 0;\n}\n");
+    }
+
+    for (int i = 0; i < p.nfunks; i++)
+    {
+        free(p.funks[i].args.names);
+        free(p.funks[i].locals.names);
+        free(p.funks[i].mentions.names);
+        free(p.funks[i].calls.names);
+    }
+    free(p.funks);
+    free(p.globals.names);
+    free(p.dynamic.names);
+
+    return ret;
+}
+
+int build_native(struct ast *ast, const char *source, const char *exe, struct error_scope *err_s)
+{
+    char path[] = "/tmp/guacamole_XXXXXX.c";
+    int fd = mkstemps(path, 2);
+    if (fd < 0)
+        return 0;
+
+    FILE *out = fdopen(fd, "w");
+    int ret = emit_c(ast, out, source, err_s);
+    fclose(out);
+
+    if (ret)
+    {
+        const char *dir = getenv("GUAC_SRCDIR") ? getenv("GUAC_SRCDIR") : GUAC_SRCDIR;
+        const char *cc = getenv("CC") ? getenv("CC") : "cc";
+        int nsources = sizeof(runtime_sources) / sizeof(runtime_sources[0]);
+        char **argv = calloc(nsources + 12, sizeof(char *));
+        int argc = 0;
+
+        char *include = calloc(strlen(dir) + 3, sizeof(char));
+        sprintf(include, "-I%s", dir);
+
+        argv[argc++] = (char *)cc;
+        argv[argc++] = "-O2";
+        argv[argc++] = "-fwrapv";
+        argv[argc++] = include;
+        argv[argc++] = path;
+        for (int i = 0; i < nsources; i++)
+        {
+            argv[argc] = calloc(strlen(dir) + strlen(runtime_sources[i]) + 2, sizeof(char));
+            sprintf(argv[argc++], "%s/%s", dir, runtime_sources[i]);
+        }
+        argv[argc++] = "-lm";
+        argv[argc++] = "-o";
+        argv[argc++] = (char *)exe;
+
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            execvp(cc, argv);
+            _exit(127);
+        }
+
+        int status = 0;
+        ret = pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+        for (int i = 0; i < nsources; i++)
+            free(argv[5 + i]);
+        free(include);
+        free(argv);
+    }
+
+    unlink(path);
+    return ret;
+}
@@ -0,0 +1,13 @@
+#ifndef _EMIT_C_H
+#define _EMIT_C_H
+#include "my_calc.h"
+#include <stdio.h>
+
+// Lower a checked AST to a standalone C translation unit calling builtins.c
+// Returns 0 and fills err_s on constructs the backend does not support.
+int emit_c(struct ast *ast, FILE *out, const char *source, struct error_scope *err_s);
+
+// Emit the C of ast to a temporary file and build it with the system cc into exe
+int build_native(struct ast *ast, const char *source, const char *exe, struct error_scope *err_s);
+
+#endif /* _EMIT_C_H */
@@ -0,0 +1,58 @@
+// arrays : literals, indexing, copy on write, the vector builtins and sort,
+// sizes around the 4 element lanes of the kernels
+a = [5, -3, 8, 0, 2];
+println(a);
+println(a[0] + a[4]);
+a[1] = a[2] * 10;
+println(a);
+b = a;
+b[0] = 99;
+println(a);
+println(b);
+println(a == b);
+b[0] = 5;
+println(a == b);
+
+funk bump(v) { v[0] = v[0] + 1; return v; }
+c = bump(a);
+println(a[0]);
+println(c[0]);
+
+println(len(a));
+println(sum(a));
+println(min(a));
+println(max(a));
+println(dot(a, a));
+println(scan(a));
+println(sort(a));
+println(a);
+println(sort([3, 3, -1, 9223372036854775807, -9223372036854775807, 0, 3]));
+println(sort([]));
+println(len(fill(0, 7)));
+println(fill(3, -2));
+
+// every length from 0 to 12 covers the vector body and its tail
+n = 0;
+while (n <= 12) {
+    v = fill(n, 1);
+    i = 0;
+    while (i < n) {
+        v[i] = (i * 7919) % 13 - 6;
+        i = i + 1;
+    }
+    print(n);
+    print(sum(v));
+    if (n > 0) {
+        print(min(v));
+        print(max(v));
+    }
+    print(dot(v, scan(v)));
+    println(sort(v));
+    n = n + 1;
+}
+
+// sum and dot past 64 bits give bignums
+big = fill(4, 9223372036854775807);
+println(sum(big));
+println(dot(big, big));
+println(a[5]);
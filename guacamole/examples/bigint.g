@@ -0,0 +1,47 @@
+// ints past 64 bits : the small int boundaries, truncated division, % with the
+// sign of the dividend, and products large enough for Karatsuba
+max = 9223372036854775807;
+min = -max - 1;
+println(max + 1);
+println(min - 1);
+println(max * 2);
+println(min * -1);
+println(-min);
+println(max + 1 - 1 == max);
+println(2 ^ 64);
+println(2 ^ 127 - 1);
+println((-3) ^ 41);
+println(2 ^ -1);
+
+println(7 / 2);
+println(-7 / 2);
+println(7 / -2);
+println(-7 / -2);
+println(7 % 3);
+println(-7 % 3);
+println(7 % -3);
+println(-7 % -3);
+println(min / -1);
+println(min % -1);
+
+big = 10 ^ 30 + 7;
+println(big / 1000000007);
+println(big % 1000000007);
+println(-big / 1000000007);
+println(-big % 1000000007);
+println(big / -(10 ^ 15));
+println(big % -(10 ^ 15));
+println((big * big) / big == big);
+println(big / (big * 3) + big % (big * 3));
+
+// 700 and 1400 digit factors, past the Karatsuba threshold of 32 limbs
+a = 3 ^ 1470 + 11;
+b = 7 ^ 1650 - 13;
+p = a * b;
+println(p == b * a);
+println(p / a == b);
+println(p % a);
+println(p % 1000000007);
+println((a + 1) * (a - 1) == a * a - 1);
+println((a * a) % 998244353);
+println(-p % 1000000007);
@@ -0,0 +1,105 @@
+// libguacamole regression test : make lib_check builds it against libguacamole.a
+// and compares what it prints with embed.out
+#include "../guacamole.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *source =
+    "n = 10;\n"
+    "big = 9223372036854775807;\n"
+    "funk scale(x) { println(x); return x * n; }\n"
+    "funk bump() { n = n + 1; return n; }\n"
+    "funk grow() { return big + 1; }\n"
+    "funk sum3(a, b, c) { return a + b + c; }\n"
+    "funk ratio(a, b) { n = 0; return a / b; }\n"
+    "funk pick(i) { t = [4, 5, 6]; return t[i]; }\n"
+    "funk deep(k) { return deep(k + 1) + 1; }\n"
+    "n;\n";
+
+static void report(struct guac_program *prog, const char *what, int ok, long r)
+{
+    if (ok)
+        printf("%s = %ld\n", what, r);
+    else
+        printf("%s : %s\n", what, guac_error(prog));
+}
+
+int main(void)
+{
+    char err[128], out[8];
+    long r = 0;
+    int ok;
+
+    // errors of the source come back in err, cut to its size
+    if (guac_compile("x = ;", err, sizeof(err)))
+        return 1;
+    printf("compile error : %s\n", err[0] ? "reported" : "missing");
+    if (guac_compile("y = undefined_name;", err, 4) || err[3])
+        return 1;
+
+    struct guac_program *prog = guac_compile(source, err, sizeof(err));
+    if (!prog)
+    {
+        printf("%s\n", err);
+        return 1;
+    }
+
+    ok = guac_run(prog, &r);
+    report(prog, "run", ok, r);
+
+    ok = guac_call(prog, "sum3", (long[]){1, 2, 3}, 3, &r);
+    report(prog, "sum3(1, 2, 3)", ok, r);
+    ok = guac_call(prog, "sum3", (long[]){1, 2}, 2, &r);
+    report(prog, "sum3(1, 2)", ok, r);
+    ok = guac_call(prog, "nothing", NULL, 0, &r);
+    report(prog, "nothing()", ok, r);
+    ok = guac_call(prog, "println", (long[]){1}, 1, &r);
+    report(prog, "println(1)", ok, r);
+    ok = guac_call(prog, "grow", NULL, 0, &r);
+    report(prog, "grow()", ok, r);
+
+    // a runtime error fails the call, the program goes on
+    ok = guac_call(prog, "ratio", (long[]){10, 0}, 2, &r);
+    report(prog, "ratio(10, 0)", ok, r);
+    ok = guac_get_global(prog, "n", &r);
+    report(prog, "n after the error", ok, r);
+    ok = guac_call(prog, "pick", (long[]){3}, 1, &r);
+    report(prog, "pick(3)", ok, r);
+    ok = guac_call(prog, "pick", (long[]){2}, 1, &r);
+    report(prog, "pick(2)", ok, r);
+    ok = guac_call(prog, "deep", (long[]){0}, 1, &r);
+    printf("deep(0) : %s\n", !ok && strstr(guac_error(prog), "innermost call first") ? "the calls running" : "no trace");
+    ok = guac_reset(prog);
+
+    // globals last between calls until a reset
+    for (int i = 0; i < 3; i++)
+    {
+        ok = guac_call(prog, "bump", NULL, 0, &r);
+        report(prog, "bump()", ok, r);
+    }
+    ok = guac_get_global(prog, "n", &r);
+    report(prog, "n", ok, r);
+    ok = guac_reset(prog);
+    ok = ok && guac_get_global(prog, "n", &r);
+    report(prog, "n after reset", ok, r);
+    ok = guac_get_global(prog, "big", &r);
+    report(prog, "big", ok, r);
+    ok = guac_get_global(prog, "scale", &r);
+    report(prog, "scale as a global", ok, r);
+
+    // the capture keeps size - 1 bytes and counts them all
+    guac_capture(prog, out, sizeof(out));
+    guac_set_global(prog, "n", 3);
+    ok = guac_call(prog, "scale", (long[]){14}, 1, &r);
+    report(prog, "scale(14)", ok, r);
+    ok = guac_call(prog, "scale", (long[]){123456}, 1, &r);
+    report(prog, "scale(123456)", ok, r);
+    printf("captured \"%s\" of %zu bytes\n", out, guac_output_length(prog));
+    guac_capture(prog, NULL, 0);
+
+    ok = guac_call(prog, "scale", (long[]){-1}, 1, &r);
+    report(prog, "scale(-1)", ok, r);
+
+    guac_free(prog);
+    return 0;
+}
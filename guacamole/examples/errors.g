@@ -0,0 +1,5 @@
+// a runtime error stops the run : what was printed before it stays, its message goes to stderr
+t = [1, 2, 3];
+println(t[2]);
+t[1] = t[3];
+println("not reached");
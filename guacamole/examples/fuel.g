@@ -0,0 +1,19 @@
+// flags: --max-steps 2500
+// a budget spent in a hot funk : make jit_check wants the same stop, step and
+// partial result from native code as from the interpreter
+funk sq(x) { return x * x; }
+funk walk(n) {
+  i = 0; s = 0;
+  while (i < n) {
+    i = i + 1;
+    if (i % 3 == 0) { continue; }
+    if (i > 2 && sq(i) > 10 || i == 1) { s = s + sq(i % 7); }
+  }
+  return s;
+}
+t = 0; k = 0;
+while (k < 100) {
+  t = t + walk(k) + sq(walk(k % 5));
+  k = k + 1;
+}
+println(t);
@@ -0,0 +1,4 @@
+// flags: --max-steps 3000
+// a partial result too long to print in full : its first and last digits and how many there are
+x = 3;
+while (1) { x = x * x; }
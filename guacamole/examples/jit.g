@@ -0,0 +1,32 @@
+// exercises the funk JIT : locals, loops, break/continue, recursion and calls
+funk sq(x) { return x * x; }
+funk sum(n) {
+  i = 0; s = 0;
+  while (i < n) {
+    i = i + 1;
+    if (i % 3 == 0) { continue; }
+    if (i > 50) { break; }
+    s = s + sq(i) - (i ^ 2) / 2 + -i % 5;
+  }
+  return s;
+}
+funk many(a, b, c, d, e, f) { return a - b * c + d / e - f + !a + (a > b) + (c <= d && e != f) + (0 || a == 1); }
+funk even(n) { if (n == 0) { return 1; } else { return odd(n - 1); } }
+funk odd(n) { if (n == 0) { return 0; } else { return even(n - 1); } }
+funk last(n) { if (n > 5) { n = n * 2; } elif (n > 2) { n = n + 100; } else { n; } }
+funk empty_if(n) { if (n > 100) { } }
+funk both(x, t0) { return (3 >= x) && t0; }
+k = 0;
+while (k < 10) {
+  println(sum(k * 7));
+  println(many(k, 2, 3, k + 1, 2, 6));
+  println(even(k) + odd(k) * 10);
+  println(last(k));
+  println(empty_if(k));
+  println(both(k, k % 2));
+  k = k + 1;
+}
+i = 5;
+funk usesi(n) { i = n; return i; }
+println(usesi(3));
+println(i);
@@ -0,0 +1,101 @@
+// loop optimizations : hoisted invariants, * and ^ by a counter, counted
+// loops, and the loops they must leave alone
+k = 3;
+s = 0;
+i = 0;
+while (i < 10) {
+    s = s + i * k + k * 7 + 2 ^ i;
+    i = i + 1;
+}
+println(s);
+
+// a counter going down and by steps, past 64 bits
+p = 0;
+i = 40;
+while (i > 0) {
+    p = p + 3 ^ i + i * 9223372036854775807;
+    i = i - 3;
+}
+println(p);
+
+// a name assigned in the loop through a funk is not invariant
+funk set_k(v) { k = v; return 0; }
+s = 0;
+i = 0;
+while (i < 6) {
+    s = s + k * 10;
+    set_k(i);
+    i = i + 1;
+}
+println(s);
+
+// a counter assigned twice is not a counter
+s = 0;
+i = 0;
+while (i < 20) {
+    s = s + i * 5;
+    if (i % 4 == 0) {
+        i = i + 2;
+    }
+    i = i + 1;
+}
+println(s);
+
+// the invariant of an inner loop is computed again for each outer trip
+s = 0;
+j = 1;
+while (j <= 4) {
+    i = 0;
+    while (i < j) {
+        s = s + j * j * 100 + i ^ j;
+        i = i + 1;
+    }
+    j = j + 1;
+}
+println(s);
+
+// the bound changes inside the loop, and a break leaves early
+n = 10;
+c = 0;
+i = 0;
+while (i < n) {
+    c = c + i * 2;
+    if (i == 3) {
+        n = 6;
+    }
+    i = i + 1;
+}
+println(c);
+println(i);
+i = 0;
+while (i < 1000) {
+    if (i * i > 50) {
+        break;
+    }
+    i = i + 1;
+}
+println(i);
+
+// negative bases and exponents starting at 0
+s = 0;
+i = 0;
+while (i < 7) {
+    s = s * 10 + (0 - 2) ^ i + 0 * i;
+    i = i + 1;
+}
+println(s);
+
+// a loop run in a funk, entered again with other values
+funk tri(n, m) {
+    t = 0;
+    i = 1;
+    while (i <= n) {
+        t = t + i * m;
+        i = i + 1;
+    }
+    return t;
+}
+println(tri(10, 1));
+println(tri(10, 2));
+println(tri(0, 5));
+println(tri(100, 0 - 1));
@@ -0,0 +1,18 @@
+// flags: --max-depth 1
+// nesting that fits the smallest stack : parentheses, blocks, calls as args,
+// and a funk whose expression is too deep for the JIT, run hot
+x = ((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((1 + 2))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))));
+println(x);
+d = 0;
+if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; if (d < 100) { d = d + 1; println(d); } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } } 
+println(d);
+funk f(a) { return a * 2 % 1000003; }
+println(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(f(1)))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))));
+funk deep(a) { return ((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((((a + 1)))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))))); }
+s = 0;
+i = 0;
+while (i < 300) {
+    s = s + deep(i);
+    i = i + 1;
+}
+println(s);
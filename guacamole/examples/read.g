@@ -0,0 +1,6 @@
+// read_int from examples/read.in : signs, leading zeros, ints past 64 bits, an int the
+// input ends in without a newline, then one more read at the end of the input
+while (!eof()) {
+    println(read_int());
+}
+println(read_int());
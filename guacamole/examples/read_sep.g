@@ -0,0 +1,4 @@
+// ints are separated by white space : "1-2" in examples/read_sep.in is an error, not 1
+// then -2
+println(read_int());
+println(read_int());
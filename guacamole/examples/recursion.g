@@ -0,0 +1,16 @@
+// flags: --max-depth 1000
+// recursion below the max depth, then one without end that stops at it
+funk down(n) {
+    if (n == 0) {
+        return 0;
+    }
+    return down(n - 1) + 1;
+}
+funk even(n) { if (n == 0) { return 1; } return odd(n - 1); }
+funk odd(n) { if (n == 0) { return 0; } return even(n - 1); }
+println(down(900));
+println(even(901));
+funk forever(n) {
+    return forever(n + 1);
+}
+println(forever(0));
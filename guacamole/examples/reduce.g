@@ -0,0 +1,30 @@
+// flags: --threads 4
+// reduce : the same result for any number of threads, and a funk that assigns
+// a variable its caller defines after the check is stopped before it runs
+funk sq(x) { return x * x; }
+funk collatz(n) {
+    steps = 0;
+    while (n != 1) {
+        if (n % 2 == 0) {
+            n = n / 2;
+        } else {
+            n = 3 * n + 1;
+        }
+        steps = steps + 1;
+    }
+    return steps;
+}
+println(reduce(sq, 0, 100, "+"));
+println(reduce(sq, 1, 30, "*"));
+println(reduce(collatz, 1, 1000, "max"));
+println(reduce(collatz, 2, 1000, "min"));
+// long enough for the workers to start after the first calls
+println(reduce(collatz, 1, 5000, "max"));
+println(reduce(sq, 5, 5, "+"));
+println(reduce(sq, 5, 5, "*"));
+
+funk keep(x) { t = x * x; return t; }
+funk r() { return reduce(keep, 0, 100, "+"); }
+println(r());
+t = 1;
+println(r());
@@ -0,0 +1,3 @@
+// what a funk returns is checked like any expression : t0 is never assigned
+funk f(x) { return (3 >= x) && t0; }
+f(1);
@@ -0,0 +1,26 @@
+// names a funk assigns are those of its callers, a funk may be defined again
+x = 1;
+funk setx(v) { x = v; return x; }
+funk readx() { return x; }
+funk twice(x) { return readx() * 2; }
+println(setx(5));
+println(x);
+println(twice(21));
+println(x);
+funk f(n) { return n + 1; }
+println(f(1));
+funk f(n) { return n * 10; }
+println(f(2));
+funk counter(n) {
+    i = 0;
+    total = 0;
+    while (i < n) {
+        i = i + 1;
+        if (i % 2 == 0) { continue; }
+        total = total + i;
+        if (total > 40) { break; }
+    }
+    return total;
+}
+println(counter(5));
+println(counter(100));
@@ -0,0 +1,53 @@
+// strings : short ones kept in the value, long ones shared and appended
+// in place, comparisons and escapes
+a = "1234567";
+b = a + "8";
+println(len(a));
+println(len(b));
+println(b);
+s = "";
+println(len(s));
+s = s + "ab";
+c = s;
+s = s + "cd";
+println(c);
+println(s);
+
+// appending to a shared buffer leaves the other name alone
+x = "a long string, past seven bytes";
+y = x;
+x = x + "!";
+println(y);
+println(x);
+println(len(x) - len(y));
+
+funk shout(t) { t = t + "?"; return t; }
+z = shout(y);
+println(y);
+println(z);
+
+// growing one string in a loop
+w = "";
+i = 0;
+while (i < 100) {
+    w = w + "xy";
+    i = i + 1;
+}
+println(len(w));
+v = w;
+w = w + "z";
+println(len(v));
+println(len(w));
+
+println("abc" == "abc");
+println("abc" == "abd");
+println("abc" != "ab");
+println("abc" < "abd");
+println("ab" < "abc");
+println("b" > "abc");
+println("seven b" <= "seven b");
+println("a long literal here" == "a long literal here");
+println("tab\there \"quoted\" back\\slash");
+println("two\nlines");
+println(len("\n\t\\"));
+println("a" + 1);
@@ -0,0 +1,3 @@
+// a variable is defined by its assignment, once its value is computed : u = 5 + u reads an undefined u
+u = 5 + u;
+u;
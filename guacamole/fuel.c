@@ -0,0 +1,145 @@
+#include "fuel.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int fuel_limited = 0;
+int fuel_traps = 0;
+
+static long max_steps = 0;
+static long timeout_ms = 0;
+
+// runs that never called fuel_start, the library and reduce workers, have no limit
+_Thread_local struct fuel fuel = {LONG_MAX, LONG_MAX};
+
+static _Thread_local struct timespec start;
+
+void fuel_configure(long steps, long ms)
+{
+    max_steps = steps;
+    timeout_ms = ms;
+    fuel_limited = steps || ms;
+}
+
+static double elapsed_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) * 1e3 + (now.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+// Steps the next slice may take
+static long next_slice(void)
+{
+    long slice = timeout_ms ? FUEL_SLICE : LONG_MAX;
+    if (max_steps && max_steps - fuel.spent < slice)
+        slice = max_steps - fuel.spent;
+    return slice;
+}
+
+void fuel_start(void)
+{
+    val_drop(fuel.partial);
+    free(fuel.error);
+    fuel = (struct fuel){0};
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fuel.slice = fuel_limited ? next_slice() : LONG_MAX;
+    fuel.left = fuel.slice;
+}
+
+int fuel_refill(void)
+{
+    if (!fuel.out)
+    {
+        fuel.spent += fuel.slice;
+        fuel.slice = next_slice();
+        fuel.timeout = timeout_ms && elapsed_ms() >= timeout_ms;
+        fuel.out = fuel.slice <= 0 || fuel.timeout;
+    }
+
+    if (fuel.out)
+    {
+        fuel.slice = 0;
+        fuel.left = -1;
+        return 0;
+    }
+
+    // this step is the first of the slice
+    fuel.left = fuel.slice - 1;
+    return 1;
+}
+
+int fuel_charge_steps(long n)
+{
+    for (;;)
+    {
+        long take = n < fuel.left ? n : fuel.left;
+        if (take > 0)
+        {
+            fuel.left -= take;
+            n -= take;
+        }
+        if (n <= 0)
+            return 1;
+
+        // the slice is spent, the refill charges the next step
+        if (!fuel_charge())
+            return 0;
+        n -= 1;
+    }
+}
+
+int fuel_charge_long(void)
+{
+    if (!fuel_charge())
+        return 0;
+
+    // the slice ends with this step
+    if (fuel_limited)
+    {
+        fuel.slice -= fuel.left;
+        fuel.left = 0;
+    }
+    return 1;
+}
+
+void fuel_stop(const struct ast *at, value v)
+{
+    if (fuel.at)
+        return;
+
+    fuel.at = at;
+    fuel.steps = fuel.spent;
+    fuel.ms = elapsed_ms();
+    fuel.partial = val_ref(v);
+}
+
+value fuel_finish(void)
+{
+    value v = fuel.partial;
+    fuel.partial = 0;
+    return v;
+}
+
+void fuel_end(void)
+{
+    val_drop(fuel_finish());
+    free(fuel.error);
+    fuel.error = NULL;
+}
+
+int fuel_fail(const char *msg)
+{
+    if (!fuel_traps)
+        return 0;
+
+    if (!fuel.error)
+        fuel.error = strdup(msg);
+
+    // every later step is refused
+    fuel.out = 1;
+    fuel.slice = 0;
+    fuel.left = -1;
+    return 1;
+}
@@ -0,0 +1,102 @@
+#ifndef _FUEL_H
+#define _FUEL_H
+#include "bigint.h"
+
+struct ast;
+
+// Execution budget of --max-steps and --timeout-ms
+//
+// A step is a loop back-edge, a funk call, a builtin call or a frame of donut(),
+// never a node, so charging one is a decrement of a thread local counter. The
+// bignum and array kernels charge a step more for every FUEL_WORDS limbs or
+// elements they go over, so a long operation counts against both limits; the
+// decimal conversion of println charges as it goes and gives up once it is
+// spent. The counter holds what is left of a slice of FUEL_SLICE steps at most,
+// when it is spent fuel_refill counts the slice against the budget and reads the
+// clock, so the timeout is checked every FUEL_SLICE steps. Once the budget is spent the
+// counter stays empty : the evaluator unwinds with EVAL_STOP, every later step
+// fails the same way, so nothing is printed, called or looped over afterwards.
+// A runtime error of the interpreter (val_fail) stops the run the same way, with
+// its message in fuel.error, so the REPL, the library and --jobs go on after it.
+// With a budget, funks compiled by the JIT charge their back-edges and calls too
+// and stop where the interpreter would when it is spent.
+
+#define FUEL_SLICE (1 << 12)
+
+// Limbs or elements a kernel goes over for a step
+#define FUEL_WORDS 64
+
+// Exit status of a program stopped by its budget, as timeout(1)
+#define FUEL_STATUS 124
+
+struct fuel
+{
+    // steps left in the slice, negative once the budget is spent
+    long left;
+    long slice;
+    // steps of the slices before this one
+    long spent;
+    // the budget is spent, by the clock when timeout is set
+    int out;
+    int timeout;
+    // first step refused : node, steps run, wall time and value at that point
+    const struct ast *at;
+    long steps;
+    double ms;
+    value partial;
+    // message of the runtime error that stopped the run, NULL without one
+    char *error;
+};
+
+extern _Thread_local struct fuel fuel;
+
+// 1 when a budget is set, the JIT then charges steps
+extern int fuel_limited;
+
+// 1 when runtime errors stop the run instead of ending the process, set by the
+// interpreter and the library, never in an executable built by -o
+extern int fuel_traps;
+
+// Steps and milliseconds of wall time of every run, 0 for no limit
+void fuel_configure(long max_steps, long timeout_ms);
+
+// Start the budget of a run on this thread
+void fuel_start(void);
+
+// A new slice once the counter ran out, 0 when the budget is spent
+int fuel_refill(void);
+
+// Charge one step, 0 when the budget is spent
+static inline int fuel_charge(void)
+{
+    return __builtin_expect(--fuel.left >= 0, 1) || fuel_refill();
+}
+
+// Charge n steps at once, 0 when the budget is spent
+int fuel_charge_steps(long n);
+
+// Charge the work of a kernel over n words : the operation completes and the
+// evaluator stops after it once the budget is spent
+static inline void fuel_charge_words(long n)
+{
+    if (__builtin_expect(fuel_limited && n >= FUEL_WORDS, 0))
+        fuel_charge_steps(n / FUEL_WORDS);
+}
+
+// Charge a step that takes long (a frame of donut), the next one reads the clock
+int fuel_charge_long(void);
+
+// Record the first step refused, at the node at with v the current value (borrowed)
+void fuel_stop(const struct ast *at, value v);
+
+// The value recorded by fuel_stop, given to the caller, and the end of the run
+value fuel_finish(void);
+
+// Release what the run left on this thread, its partial value and its error
+void fuel_end(void);
+
+// Stop the run for the runtime error msg, the first one is kept. Returns 0 when
+// errors end the process instead.
+int fuel_fail(const char *msg);
+
+#endif /* _FUEL_H */
@@ -0,0 +1,261 @@
+#define _GNU_SOURCE
+#include "guacamole.h"
+#include "fuel.h"
+#include "mem.h"
+#include "my_calc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct guac_program
+{
+    struct session ss;
+    // the top level ran and ss.saved holds what it left
+    int ran;
+    const char *error;
+    // message of the last runtime error, error points to it
+    char *run_error;
+    // captured output, out is NULL while it goes to stdout
+    FILE *out;
+    char *buf;
+    size_t size;
+    size_t stored;
+    size_t written;
+};
+
+struct guac_program *guac_compile(const char *source, char *err, size_t err_size)
+{
+    struct guac_program *prog = calloc(1, sizeof(struct guac_program));
+    struct parser *p = new_parser(source);
+    struct error_scope err_s;
+
+    // a runtime error fails the call that made it, not the host
+    fuel_traps = 1;
+    session_init(&prog->ss);
+    // the only chunk
+    prog->ss.open = 0;
+    if (session_load(&prog->ss, p, &err_s))
+    {
+        clean_parser(p);
+        return prog;
+    }
+
+    if (err_size)
+    {
+        struct position pos;
+        if (err_s.begin != -1)
+            p->last_pos = err_s.begin;
+        count_lines(p, &pos);
+        snprintf(err, err_size, "line %d, col %d: %s", pos.line, pos.col,
+                 err_s.begin != -1 ? err_s.err : "syntax error");
+    }
+
+    clean_parser(p);
+    guac_free(prog);
+    return NULL;
+}
+
+void guac_free(struct guac_program *prog)
+{
+    if (!prog)
+        return;
+
+    guac_capture(prog, NULL, 0);
+    session_clean(&prog->ss);
+    free(prog->run_error);
+    free(prog);
+}
+
+static int fail(struct guac_program *prog, const char *error)
+{
+    prog->error = error;
+    return 0;
+}
+
+// The runtime error that stopped the evaluation, what it left dropped
+static int fail_run(struct guac_program *prog)
+{
+    free(prog->run_error);
+    prog->run_error = fuel.error;
+    fuel.error = NULL;
+    fuel_end();
+    return fail(prog, prog->run_error);
+}
+
+// Value of the last evaluation in *result
+static int result_of(struct guac_program *prog, long *result)
+{
+    long n;
+
+    if (!val_to_long(prog->ss.run.current_val, &n))
+        return fail(prog, "the value does not fit a long");
+    if (result)
+        *result = n;
+
+    return 1;
+}
+
+// The capture holds everything printed when an evaluation returns
+static void flush_output(struct guac_program *prog)
+{
+    out_flush(&prog->ss.run.out);
+}
+
+int guac_run(struct guac_program *prog, long *result)
+{
+    fuel_start();
+    int ok = session_run(&prog->ss);
+    flush_output(prog);
+
+    session_save(&prog->ss);
+    prog->ran = 1;
+
+    if (fuel.error)
+        return fail_run(prog);
+    if (!ok)
+        return fail(prog, "the top level failed");
+
+    return result_of(prog, result);
+}
+
+static int ensure_ran(struct guac_program *prog)
+{
+    return prog->ran || guac_run(prog, NULL);
+}
+
+int guac_call(struct guac_program *prog, const char *name, const long *args, int nargs, long *result)
+{
+    if (!ensure_ran(prog))
+        return 0;
+
+    struct def_entry *e = getdef(&prog->ss.run, name);
+    if (!e || e->type != _func || e->builtin || e->val.astptr->size < 2)
+        return fail(prog, "no such funk");
+
+    struct ast *func = e->val.astptr;
+    if (func->edges[0]->size != nargs)
+        return fail(prog, "wrong number of args");
+
+    value *vals = mem_calloc(MEM_ARGS, nargs + 1, sizeof(value));
+    for (int i = 0; i < nargs; i++)
+        vals[i] = val_from_long(args[i]);
+
+    fuel_start();
+    int ok = call_funk(func, &prog->ss.run, vals);
+    flush_output(prog);
+
+    for (int i = 0; i < nargs; i++)
+        val_drop(vals[i]);
+    mem_free(MEM_ARGS, vals);
+
+    if (fuel.error)
+        return fail_run(prog);
+    if (!ok)
+        return fail(prog, "the funk failed");
+
+    return result_of(prog, result);
+}
+
+// Global variable entry of name, NULL (and the error set) if there is none
+static struct def_entry *global(struct guac_program *prog, const char *name)
+{
+    if (!ensure_ran(prog))
+        return NULL;
+
+    struct def_entry *e = getdef(&prog->ss.run, name);
+    if (!e || e->type != _int)
+    {
+        fail(prog, "no such global");
+        return NULL;
+    }
+
+    return e;
+}
+
+int guac_get_global(struct guac_program *prog, const char *name, long *value)
+{
+    struct def_entry *e = global(prog, name);
+
+    if (!e)
+        return 0;
+    if (!val_to_long(e->val.intval, value))
+        return fail(prog, "the value does not fit a long");
+
+    return 1;
+}
+
+int guac_set_global(struct guac_program *prog, const char *name, long value)
+{
+    struct def_entry *e = global(prog, name);
+
+    if (!e)
+        return 0;
+
+    val_drop(e->val.intval);
+    e->val.intval = val_from_long(value);
+
+    return 1;
+}
+
+int guac_reset(struct guac_program *prog)
+{
+    if (!prog->ran)
+        return guac_run(prog, NULL);
+
+    session_restore(&prog->ss);
+
+    return 1;
+}
+
+// Keeps what fits in buf, counts everything
+static ssize_t capture_write(void *cookie, const char *data, size_t n)
+{
+    struct guac_program *prog = cookie;
+    size_t room = prog->size - 1 - prog->stored;
+    size_t kept = n < room ? n : room;
+
+    memcpy(prog->buf + prog->stored, data, kept);
+    prog->stored += kept;
+    prog->buf[prog->stored] = 0;
+    prog->written += n;
+
+    return n;
+}
+
+int guac_capture(struct guac_program *prog, char *buf, size_t size)
+{
+    // what is still buffered goes where it was printed to
+    out_close(&prog->ss.run.out);
+    if (prog->out)
+        fclose(prog->out);
+
+    prog->out = NULL;
+    out_open(&prog->ss.run.out, stdout);
+    prog->buf = buf;
+    prog->size = size;
+    prog->stored = 0;
+    prog->written = 0;
+
+    if (!buf)
+        return 1;
+    if (!size)
+        return fail(prog, "empty capture buffer");
+
+    buf[0] = 0;
+    cookie_io_functions_t io = {.write = capture_write};
+    if (!(prog->out = fopencookie(prog, "w", io)))
+        return fail(prog, "cannot open the capture stream");
+    out_open(&prog->ss.run.out, prog->out);
+
+    return 1;
+}
+
+size_t guac_output_length(struct guac_program *prog)
+{
+    return prog->written;
+}
+
+const char *guac_error(struct guac_program *prog)
+{
+    return prog->error ? prog->error : "no error";
+}
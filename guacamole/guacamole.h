@@ -0,0 +1,47 @@
+#ifndef _GUACAMOLE_H
+#define _GUACAMOLE_H
+#include <stddef.h>
+
+// libguacamole : run Guacamole programs from C
+//
+// guac_compile parses and checks a source once. The program runs its top level
+// (funk definitions and the initial globals) on the first guac_run or guac_call,
+// then its funks can be called any number of times, each call only evaluating
+// the funk. What calls do to the globals lasts until guac_reset or guac_run.
+// Every function returns 1 on success and 0 on failure, guac_error says why. A
+// runtime error fails the call that made it, what the call assigned before stays.
+// A program must not be used by two threads at once, different programs can.
+
+#define GUAC_API __attribute__((visibility("default")))
+
+struct guac_program;
+
+// Parsed and checked source, NULL on error with its position and message in err
+// (truncated to err_size bytes)
+GUAC_API struct guac_program *guac_compile(const char *source, char *err, size_t err_size);
+GUAC_API void guac_free(struct guac_program *prog);
+
+// Run the top level from no definition, result (when not NULL) gets the value
+// of its last statement
+GUAC_API int guac_run(struct guac_program *prog, long *result);
+
+// Call funk name with its nargs args, result (when not NULL) gets its value
+GUAC_API int guac_call(struct guac_program *prog, const char *name, const long *args, int nargs, long *result);
+
+// Global variable defined by the top level
+GUAC_API int guac_get_global(struct guac_program *prog, const char *name, long *value);
+GUAC_API int guac_set_global(struct guac_program *prog, const char *name, long value);
+
+// Globals and funks back to what the top level left, without running it again
+GUAC_API int guac_reset(struct guac_program *prog);
+
+// From now on, print and println write to buf, which always holds a NUL terminated
+// string and keeps the first size - 1 bytes. A NULL buf writes to stdout again.
+GUAC_API int guac_capture(struct guac_program *prog, char *buf, size_t size);
+// Bytes written since guac_capture, more than size - 1 when the output was cut
+GUAC_API size_t guac_output_length(struct guac_program *prog);
+
+// Reason of the last failure on prog
+GUAC_API const char *guac_error(struct guac_program *prog);
+
+#endif /* _GUACAMOLE_H */
@@ -0,0 +1,166 @@
+#include "in.h"
+#include "mem.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void in_open(struct in *i, FILE *f)
+{
+    i->f = f;
+    i->pos = 0;
+    i->len = 0;
+    i->buf = NULL;
+}
+
+void in_close(struct in *i)
+{
+    mem_free(MEM_INPUT, i->buf);
+    i->buf = NULL;
+    i->pos = i->len = 0;
+}
+
+// The next bytes of the FILE in the buffer, 0 at the end of the input
+static int refill(struct in *i)
+{
+    if (!i->buf)
+    {
+        i->buf = mem_malloc(MEM_INPUT, IN_BUFFER);
+        if (!i->buf)
+            val_die("out of memory");
+    }
+
+    int fd = fileno(i->f);
+    long n;
+    if (fd < 0)
+        n = fread(i->buf, 1, IN_BUFFER, i->f);
+    else
+    {
+        while ((n = read(fd, i->buf, IN_BUFFER)) < 0 && errno == EINTR)
+            ;
+    }
+
+    i->pos = 0;
+    i->len = n > 0 ? n : 0;
+    return i->len;
+}
+
+static inline int is_space(int c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline int is_digit(int c)
+{
+    return (unsigned)(c - '0') < 10;
+}
+
+// First byte after white space, not taken, -1 at the end of the input
+static int skip_space(struct in *i)
+{
+    for (;;)
+    {
+        while (i->pos < i->len && is_space(i->buf[i->pos]))
+            i->pos++;
+        if (i->pos < i->len)
+            return (unsigned char)i->buf[i->pos];
+        if (!refill(i))
+            return -1;
+    }
+}
+
+int in_eof(struct in *i)
+{
+    return skip_space(i) < 0;
+}
+
+// Digits of a number past 18 of them, m the value of the first ones
+static value long_int(struct in *i, int neg, unsigned long m)
+{
+    char first[VAL_DIGITS];
+    char *d = val_digits(first + VAL_DIGITS, m);
+    long len = first + VAL_DIGITS - d, cap = 64;
+    char *text = mem_malloc(MEM_BIGNUM, cap);
+
+    text[0] = '-';
+    memcpy(text + 1, d, len);
+    len++;
+
+    while (i->pos < i->len || refill(i))
+    {
+        if (!is_digit(i->buf[i->pos]))
+            break;
+        if (len + 1 == cap)
+            text = mem_reallocarray(MEM_BIGNUM, text, cap *= 2, 1);
+        text[len++] = i->buf[i->pos++];
+    }
+    text[len] = 0;
+
+    value v = val_parse(neg ? text : text + 1);
+    mem_free(MEM_BIGNUM, text);
+    return v;
+}
+
+value in_int(struct in *i)
+{
+    int c = skip_space(i);
+    int neg = c == '-';
+    if (neg)
+    {
+        i->pos++;
+        c = i->pos < i->len || refill(i) ? (unsigned char)i->buf[i->pos] : -1;
+    }
+
+    if (c < 0 && !neg)
+    {
+        val_fail("read_int at the end of the input");
+        return 0;
+    }
+    if (!is_digit(c))
+    {
+        val_fail("read_int expects an int in the input");
+        return 0;
+    }
+
+    // below 10^18 the value fits, the digits are taken until the buffer ends
+    unsigned long m = 0;
+    int digits = 0;
+    int big = 0;
+    for (;;)
+    {
+        const char *p = i->buf + i->pos, *end = i->buf + i->len;
+        if (end - p > 18 - digits)
+            end = p + 18 - digits;
+        while (p < end && is_digit(*p))
+            m = m * 10 + (*p++ - '0');
+
+        digits += p - (i->buf + i->pos);
+        i->pos = p - i->buf;
+        if (p < i->buf + i->len && !is_digit(*p))
+            break;
+        if (digits < 18)
+        {
+            if (!refill(i))
+                break;
+            continue;
+        }
+
+        // a 19th digit makes a bignum
+        if ((i->pos < i->len || refill(i)) && is_digit(i->buf[i->pos]))
+            big = 1;
+        break;
+    }
+
+    value v = big ? long_int(i, neg, m) : val_from_long(neg ? -(long)m : (long)m);
+
+    // the digits end at the end of the input or before a byte in the buffer : "1-2" is
+    // not 1 then -2
+    if (i->pos < i->len && !is_space(i->buf[i->pos]))
+    {
+        val_drop(v);
+        val_fail("read_int expects white space after an int");
+        return 0;
+    }
+
+    return v;
+}
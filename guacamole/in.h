@@ -0,0 +1,39 @@
+#ifndef _IN_H
+#define _IN_H
+#include "bigint.h"
+#include <stdio.h>
+
+// Buffered input of read_int and eof
+//
+// Every interpreter reads its FILE through its own IN_BUFFER bytes, taken with
+// read() on its file descriptor, so a pipe or a terminal hands over what it has
+// without waiting for the buffer to fill, and memory stays the same whatever the
+// size of the input. Ints are scanned straight from the buffer without scanf or
+// a lock, a number going across two reads included; past 18 digits its text is
+// collected and parsed as a bignum. Bytes of the FILE already buffered by stdio
+// (the code read by the REPL) are not seen.
+
+#define IN_BUFFER (1 << 16)
+
+struct in
+{
+    FILE *f;
+    int pos;
+    int len;
+    // allocated on the first read
+    char *buf;
+};
+
+// i reads from f, nothing is allocated yet
+void in_open(struct in *i, FILE *f);
+// Release the buffer, what it holds is lost
+void in_close(struct in *i);
+
+// 1 when nothing but white space is left, which it skips
+int in_eof(struct in *i);
+// Next int, after white space : digits with an optional '-', followed by white
+// space or the end of the input. Anything else or the end of the input stops the
+// program with an error.
+value in_int(struct in *i);
+
+#endif /* _IN_H */
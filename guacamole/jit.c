@@ -0,0 +1,1083 @@
+#include "jit.h"
+#include "callstack.h"
+#include "fuel.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int jit_threshold = JIT_DEFAULT_THRESHOLD;
+
+void jit_configure(int threshold)
+{
+    jit_threshold = threshold;
+}
+
+#if defined(__linux__) && defined(__x86_64__)
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+#define JIT_MAX_ARGS 6
+// Deeper expressions and blocks stay interpreted : native code pushes a word for
+// every level, on the stack the evaluator checks only at calls
+#define JIT_MAX_NESTING 256
+
+enum
+{
+    JIT_COLD,
+    JIT_ANALYZED,
+    JIT_READY,
+    JIT_UNSUPPORTED,
+};
+
+// Growable list of name nodes (_var asts)
+struct name_list
+{
+    struct ast **names;
+    int size;
+};
+
+// Values stay tagged words in JIT code, small ints only : a result leaving the
+// small range bails out of every native frame and the call is interpreted again
+typedef value (*jit_entry)(value, value, value, value, value, value);
+
+struct jit_func
+{
+    int state;
+    int calls;
+    unsigned long epoch;
+    struct ast *def;
+
+    // entry point, JIT code calls through this field so callees can be patched
+    jit_entry code;
+    void *map;
+    size_t maplen;
+
+    struct name_list args;
+    struct name_list locals;
+    // locals of this funk and of every funk it may call
+    struct name_list guard;
+    // resolved callees, one per _funccall reached
+    struct jit_func **callees;
+    int ncallees;
+    // stack limit of the thread the code was compiled on, the code checks it
+    char **stack_limit;
+};
+
+// Compilation batch, every funk analyzed for one hot root
+struct batch
+{
+    struct jit_func **funcs;
+    int size;
+    struct scope *s;
+    unsigned long epoch;
+    // nodes above the one analyzed
+    int nesting;
+};
+
+struct code_buf
+{
+    unsigned char *data;
+    int size;
+    int cap;
+    // 8 byte words pushed on top of the frame, to keep calls 16 byte aligned
+    int depth;
+    // jumps to the bail out stub
+    int *bails;
+    int nbails;
+};
+
+// Returned by native code that bailed out on an overflow, small ints are even
+#define JIT_BAIL 1
+
+static int has_name(struct name_list *l, struct ast *name)
+{
+    for (int i = 0; i < l->size; i++)
+    {
+        if (!strcmp(l->names[i]->val.strval, name->val.strval))
+            return 1;
+    }
+
+    return 0;
+}
+
+static void add_name(struct name_list *l, struct ast *name)
+{
+    if (has_name(l, name))
+        return;
+
+    l->names = reallocarray(l->names, l->size + 1, sizeof(struct ast *));
+    l->names[l->size] = name;
+    l->size += 1;
+}
+
+static void release_code(struct jit_func *jf)
+{
+    if (jf->map)
+        munmap(jf->map, jf->maplen);
+
+    free(jf->args.names);
+    free(jf->locals.names);
+    free(jf->guard.names);
+    free(jf->callees);
+
+    jf->map = NULL;
+    jf->code = NULL;
+    memset(&jf->args, 0, sizeof(struct name_list));
+    memset(&jf->locals, 0, sizeof(struct name_list));
+    memset(&jf->guard, 0, sizeof(struct name_list));
+    jf->callees = NULL;
+    jf->ncallees = 0;
+}
+
+void jit_free(struct jit_func *jf)
+{
+    if (!jf)
+        return;
+
+    release_code(jf);
+    free(jf);
+}
+
+static struct jit_func *get_jit(struct ast *f)
+{
+    if (!f->jit)
+    {
+        f->jit = calloc(1, sizeof(struct jit_func));
+        f->jit->def = f;
+    }
+
+    return f->jit;
+}
+
+// ANALYSIS
+
+static int analyze_func(struct batch *b, struct jit_func *jf);
+
+// Collect locals (assigned names) and check every construct is supported
+static int collect_locals(struct jit_func *jf, struct ast *ast)
+{
+    if (ast->type == _funcdef)
+        return 0;
+
+    if (ast->type == _loop && (ast->size != 2 || ast->edges[1]->size == 0))
+        return 0;
+
+    if (ast->type == _opeq)
+    {
+        if (ast->size != 2 || ast->edges[0]->type != _var)
+            return 0;
+        if (!has_name(&jf->args, ast->edges[0]))
+            add_name(&jf->locals, ast->edges[0]);
+    }
+
+    for (int i = 0; i < ast->size; i++)
+    {
+        if (!collect_locals(jf, ast->edges[i]))
+            return 0;
+    }
+
+    return 1;
+}
+
+static int analyze_node(struct batch *b, struct jit_func *jf, struct ast *ast)
+{
+    switch (ast->type)
+    {
+    case _const:
+        return val_is_small(ast->val.intval);
+    case _var:
+        return has_name(&jf->args, ast) || has_name(&jf->locals, ast);
+    case _opuna:
+        if (ast->size != 1)
+            return 0;
+        break;
+    case _opmath:
+    case _opcomp:
+    case _oplogic:
+        if (ast->size != 2)
+            return 0;
+        break;
+    case _funccall:
+    {
+        if (ast->size > JIT_MAX_ARGS || has_name(&jf->args, ast) || has_name(&jf->locals, ast))
+            return 0;
+
+        struct def_entry *def = getdef(b->s, ast->val.strval);
+        if (!def || def->builtin || def->type != _func || def->val.astptr->edges[0]->size != ast->size)
+            return 0;
+
+        struct jit_func *callee = get_jit(def->val.astptr);
+        if (!analyze_func(b, callee))
+            return 0;
+
+        jf->callees = reallocarray(jf->callees, jf->ncallees + 1, sizeof(struct jit_func *));
+        jf->callees[jf->ncallees] = callee;
+        jf->ncallees += 1;
+        break;
+    }
+    case _opeq:
+        return analyze_node(b, jf, ast->edges[1]);
+    case _opcontrol:
+    case _block:
+    case _loop:
+    case _compound:
+        break;
+    default:
+        return 0;
+    }
+
+    if (b->nesting == JIT_MAX_NESTING)
+        return 0;
+
+    b->nesting += 1;
+    int ret = 1;
+    for (int i = 0; i < ast->size && ret; i++)
+        ret = analyze_node(b, jf, ast->edges[i]);
+    b->nesting -= 1;
+
+    return ret;
+}
+
+static int analyze_func(struct batch *b, struct jit_func *jf)
+{
+    if (jf->state == JIT_READY && jf->epoch != b->epoch)
+    {
+        release_code(jf);
+        jf->state = JIT_COLD;
+    }
+
+    if (jf->state == JIT_READY || jf->state == JIT_ANALYZED)
+        return 1;
+    if (jf->state == JIT_UNSUPPORTED)
+        return 0;
+
+    struct ast *def = jf->def;
+    release_code(jf);
+    jf->state = JIT_ANALYZED;
+
+    b->funcs = reallocarray(b->funcs, b->size + 1, sizeof(struct jit_func *));
+    b->funcs[b->size] = jf;
+    b->size += 1;
+
+    if (def->edges[0]->size > JIT_MAX_ARGS)
+        return 0;
+
+    for (int i = 0; i < def->edges[0]->size; i++)
+        add_name(&jf->args, def->edges[0]->edges[i]);
+
+    // the stack of a funk is checked at its entry, its nesting counts from there
+    int nesting = b->nesting;
+    b->nesting = 0;
+    int ret = collect_locals(jf, def->edges[1]) && analyze_node(b, jf, def->edges[1]);
+    b->nesting = nesting;
+
+    return ret;
+}
+
+// funks compiled by an earlier batch only call each other, a cycle through
+// a new funk never goes through them
+static int reaches(struct jit_func *from, struct jit_func *to, struct jit_func **seen, int *nseen)
+{
+    if (from->state == JIT_READY)
+        return 0;
+
+    for (int i = 0; i < *nseen; i++)
+    {
+        if (seen[i] == from)
+            return 0;
+    }
+    seen[(*nseen)++] = from;
+
+    for (int i = 0; i < from->ncallees; i++)
+    {
+        if (from->callees[i] == to || reaches(from->callees[i], to, seen, nseen))
+            return 1;
+    }
+
+    return 0;
+}
+
+// Funk calls copy the caller scope in and the non-arg values back out :
+// a funk's locals must never be visible to the frames below it, otherwise
+// the interpreter would write them back into its callers.
+static int check_batch(struct batch *b)
+{
+    for (int i = 0; i < b->size; i++)
+    {
+        struct jit_func *jf = b->funcs[i];
+        for (int j = 0; j < jf->locals.size; j++)
+            add_name(&jf->guard, jf->locals.names[j]);
+    }
+
+    int changed = 1;
+    while (changed)
+    {
+        changed = 0;
+        for (int i = 0; i < b->size; i++)
+        {
+            struct jit_func *jf = b->funcs[i];
+            for (int j = 0; j < jf->ncallees; j++)
+            {
+                struct name_list *g = &jf->callees[j]->guard;
+                for (int k = 0; k < g->size; k++)
+                {
+                    if (!has_name(&jf->guard, g->names[k]))
+                    {
+                        add_name(&jf->guard, g->names[k]);
+                        changed = 1;
+                    }
+                }
+            }
+        }
+    }
+
+    struct jit_func **seen = calloc(b->size, sizeof(struct jit_func *));
+    int ret = 1;
+
+    for (int i = 0; i < b->size && ret; i++)
+    {
+        struct jit_func *jf = b->funcs[i];
+        int nseen = 0;
+
+        if (jf->locals.size && reaches(jf, jf, seen, &nseen))
+            ret = 0;
+
+        for (int j = 0; j < jf->ncallees && ret; j++)
+        {
+            struct name_list *g = &jf->callees[j]->guard;
+            for (int k = 0; k < g->size; k++)
+            {
+                if (has_name(&jf->args, g->names[k]) || has_name(&jf->locals, g->names[k]))
+                    ret = 0;
+            }
+        }
+    }
+
+    free(seen);
+    return ret;
+}
+
+// CODE GENERATION
+
+static void emit(struct code_buf *c, const unsigned char *bytes, int n)
+{
+    if (c->size + n > c->cap)
+    {
+        c->cap = (c->cap + n) * 2;
+        c->data = realloc(c->data, c->cap);
+    }
+
+    memcpy(c->data + c->size, bytes, n);
+    c->size += n;
+}
+
+#define EMIT(c, ...)                                          \
+    do                                                        \
+    {                                                         \
+        const unsigned char _b[] = {__VA_ARGS__};             \
+        emit(c, _b, sizeof(_b));                              \
+    } while (0)
+
+static void emit32(struct code_buf *c, int32_t v)
+{
+    emit(c, (unsigned char *)&v, 4);
+}
+
+static void emit64(struct code_buf *c, uint64_t v)
+{
+    emit(c, (unsigned char *)&v, 8);
+}
+
+// jump with a rel32 to patch, returns the position of the rel32
+static int emit_jump(struct code_buf *c, unsigned char cc)
+{
+    if (cc)
+        EMIT(c, 0x0f, cc);
+    else
+        EMIT(c, 0xe9);
+
+    emit32(c, 0);
+    return c->size - 4;
+}
+
+static void patch(struct code_buf *c, int at, int target)
+{
+    int32_t rel = target - (at + 4);
+    memcpy(c->data + at, &rel, 4);
+}
+
+static void jump_to(struct code_buf *c, unsigned char cc, int target)
+{
+    patch(c, emit_jump(c, cc), target);
+}
+
+#define JCC_JO 0x80
+#define JCC_JB 0x82
+#define JCC_JE 0x84
+#define JCC_JNE 0x85
+
+static void jump_bail(struct code_buf *c, unsigned char cc)
+{
+    c->bails = reallocarray(c->bails, c->nbails + 1, sizeof(int));
+    c->bails[c->nbails] = emit_jump(c, cc);
+    c->nbails += 1;
+}
+
+// Growable list of rel32 to patch to the same target
+struct jumps
+{
+    int *at;
+    int size;
+};
+
+static void add_jump(struct jumps *j, int at)
+{
+    j->at = reallocarray(j->at, j->size + 1, sizeof(int));
+    j->at[j->size] = at;
+    j->size += 1;
+}
+
+static void patch_jumps(struct code_buf *c, struct jumps *j, int target)
+{
+    for (int i = 0; i < j->size; i++)
+        patch(c, j->at[i], target);
+
+    free(j->at);
+    j->at = NULL;
+    j->size = 0;
+}
+
+// Where the value the interpreter would hold as current is, at a step
+enum
+{
+    CURRENT_SLOT,
+    CURRENT_RAX,
+    CURRENT_KNOWN,
+};
+
+// Frame : args, locals, then cur (last value, the funk result)
+struct frame
+{
+    struct jit_func *jf;
+    // next entry of jf->callees, calls are generated in analysis order
+    int callee;
+    int cur;
+    // the current value, in cur, in rax or known when generating
+    int current;
+    value known;
+    // innermost loop : condition to continue at and breaks to patch past its end
+    struct ast *loop;
+    int top;
+    struct jumps *breaks;
+    // returns to patch to the epilogue
+    struct jumps *returns;
+};
+
+static int slot(int index)
+{
+    return -8 * (index + 1);
+}
+
+static int var_slot(struct frame *f, struct ast *var)
+{
+    for (int i = 0; i < f->jf->args.size; i++)
+    {
+        if (!strcmp(f->jf->args.names[i]->val.strval, var->val.strval))
+            return slot(i);
+    }
+
+    for (int i = 0; i < f->jf->locals.size; i++)
+    {
+        if (!strcmp(f->jf->locals.names[i]->val.strval, var->val.strval))
+            return slot(f->jf->args.size + i);
+    }
+
+    return 0;
+}
+
+// mov rax, [rbp + d]
+static void load_rax(struct code_buf *c, int d)
+{
+    EMIT(c, 0x48, 0x8b, 0x85);
+    emit32(c, d);
+}
+
+// mov [rbp + d], rax
+static void store_rax(struct code_buf *c, int d)
+{
+    EMIT(c, 0x48, 0x89, 0x85);
+    emit32(c, d);
+}
+
+static value jit_pow(value l, value r)
+{
+    value p = val_pow(l, r);
+    if (val_is_small(p))
+        return p;
+
+    val_drop(p);
+    return JIT_BAIL;
+}
+
+// After a call returning in rax : test al, 1 ; jne bail
+static void check_overflow(struct code_buf *c)
+{
+    EMIT(c, 0xa8, 0x01);
+    jump_bail(c, JCC_JNE);
+}
+
+// call imm64 (or [imm64]), keeping the stack 16 byte aligned
+static void emit_call(struct code_buf *c, uint64_t target, int indirect)
+{
+    int pad = c->depth % 2;
+
+    if (pad)
+        EMIT(c, 0x48, 0x83, 0xec, 0x08);
+
+    EMIT(c, 0x48, 0xb8);
+    emit64(c, target);
+    if (indirect)
+        EMIT(c, 0xff, 0x10);
+    else
+        EMIT(c, 0xff, 0xd0);
+
+    if (pad)
+        EMIT(c, 0x48, 0x83, 0xc4, 0x08);
+}
+
+// A step refused stops the run at the node at with the current value, as the
+// interpreter would, and every native frame bails out
+static int jit_fuel(const struct ast *at, value current)
+{
+    if (fuel_charge())
+        return 1;
+
+    fuel_stop(at, current);
+    return 0;
+}
+
+// With a budget, a step as the interpreter charges it :
+// mov rsi, current ; mov rdi, at ; call jit_fuel ; test eax, eax ; je bail
+static void charge_step(struct code_buf *c, struct frame *f, struct ast *at)
+{
+    if (!fuel_limited)
+        return;
+
+    if (f->current == CURRENT_RAX)
+        EMIT(c, 0x48, 0x89, 0xc6);
+    else if (f->current == CURRENT_KNOWN)
+    {
+        EMIT(c, 0x48, 0xbe);
+        emit64(c, f->known);
+    }
+    else
+    {
+        EMIT(c, 0x48, 0x8b, 0xb5);
+        emit32(c, f->cur);
+    }
+    EMIT(c, 0x48, 0xbf);
+    emit64(c, (uintptr_t)at);
+    emit_call(c, (uintptr_t)jit_fuel, 0);
+    EMIT(c, 0x85, 0xc0);
+    jump_bail(c, JCC_JE);
+}
+
+// jcc of a comparison, its setcc is 0x10 above
+static unsigned char comp_jcc(const char *op)
+{
+    if (!strcmp(op, "!="))
+        return 0x85;
+    if (!strcmp(op, "<="))
+        return 0x8e;
+    if (!strcmp(op, "<"))
+        return 0x8c;
+    if (!strcmp(op, ">="))
+        return 0x8d;
+    if (!strcmp(op, ">"))
+        return 0x8f;
+
+    return 0x84;
+}
+
+static void gen_expr(struct code_buf *c, struct frame *f, struct ast *ast);
+
+// The current value of the interpreter is v until the next value
+static void set_known(struct frame *f, value v)
+{
+    f->current = CURRENT_KNOWN;
+    f->known = v;
+}
+
+static int is_boolean(struct ast *ast)
+{
+    return ast->type == _opcomp || ast->type == _oplogic || (ast->type == _opuna && ast->val.strval[0] == '!');
+}
+
+// Jump to taken when the truth of ast is sense : comparisons compare straight
+// into the jump and && / || skip their right operand when the left decides
+static void gen_branch(struct code_buf *c, struct frame *f, struct ast *ast, int sense, struct jumps *taken)
+{
+    if (ast->type == _opcomp)
+    {
+        gen_expr(c, f, ast->edges[0]);
+        EMIT(c, 0x50);
+        c->depth += 1;
+        set_known(f, 0);
+        gen_expr(c, f, ast->edges[1]);
+        EMIT(c, 0x48, 0x89, 0xc1, 0x58, 0x48, 0x39, 0xc8);
+        c->depth -= 1;
+
+        // flipping the low bit inverts the condition
+        add_jump(taken, emit_jump(c, comp_jcc(ast->val.strval) ^ !sense));
+        return;
+    }
+
+    if (ast->type == _oplogic)
+    {
+        // && is decided by a false left side, || by a true one
+        int decides = ast->val.strval[0] == '|';
+        struct jumps skip = {NULL, 0};
+
+        gen_branch(c, f, ast->edges[0], decides, decides == sense ? taken : &skip);
+        // the right side runs after a left side that did not decide, a plain one is still in rax
+        if (is_boolean(ast->edges[0]))
+            set_known(f, VAL_SMALL(!decides));
+
+        gen_branch(c, f, ast->edges[1], sense, taken);
+        patch_jumps(c, &skip, c->size);
+        return;
+    }
+
+    if (ast->type == _opuna && ast->val.strval[0] == '!')
+    {
+        gen_branch(c, f, ast->edges[0], !sense, taken);
+        return;
+    }
+
+    gen_expr(c, f, ast);
+    EMIT(c, 0x48, 0x85, 0xc0);
+    add_jump(taken, emit_jump(c, sense ? JCC_JNE : JCC_JE));
+}
+
+// mov qword [rbp + d], imm32
+static void store_imm(struct code_buf *c, int d, int32_t v)
+{
+    EMIT(c, 0x48, 0xc7, 0x85);
+    emit32(c, d);
+    emit32(c, v);
+}
+
+// Condition of an if, elif or while : jump to no when false, the condition is
+// the last value (0 or 1 for a boolean operator, stored without materializing it)
+static void gen_cond(struct code_buf *c, struct frame *f, struct ast *ast, struct jumps *no)
+{
+    // reached from the statement before or the back-edge, both leave it in cur
+    f->current = CURRENT_SLOT;
+    if (!is_boolean(ast))
+    {
+        gen_expr(c, f, ast);
+        store_rax(c, f->cur);
+        EMIT(c, 0x48, 0x85, 0xc0);
+        add_jump(no, emit_jump(c, JCC_JE));
+        return;
+    }
+
+    gen_branch(c, f, ast, 0, no);
+    store_imm(c, f->cur, VAL_SMALL(1));
+}
+
+static void gen_value(struct code_buf *c, struct frame *f, struct ast *ast)
+{
+    switch (ast->type)
+    {
+    case _const:
+        EMIT(c, 0x48, 0xb8);
+        emit64(c, ast->val.intval);
+        return;
+    case _var:
+        load_rax(c, var_slot(f, ast));
+        return;
+    case _opuna:
+        gen_expr(c, f, ast->edges[0]);
+        if (ast->val.strval[0] == '-')
+        {
+            EMIT(c, 0x48, 0xf7, 0xd8);
+            jump_bail(c, JCC_JO);
+        }
+        else if (ast->val.strval[0] == '!')
+            EMIT(c, 0x48, 0x85, 0xc0, 0x0f, 0x94, 0xc0, 0x0f, 0xb6, 0xc0, 0x01, 0xc0);
+        return;
+    case _oplogic:
+    {
+        // mov eax, 2 (tagged 1) ; jmp end ; false : xor eax, eax ; end :
+        struct jumps no = {NULL, 0};
+        gen_branch(c, f, ast, 0, &no);
+        EMIT(c, 0xb8);
+        emit32(c, VAL_SMALL(1));
+        int end = emit_jump(c, 0);
+        patch_jumps(c, &no, c->size);
+        EMIT(c, 0x31, 0xc0);
+        patch(c, end, c->size);
+        return;
+    }
+    case _funccall:
+    {
+        static const unsigned char pops[JIT_MAX_ARGS][2] = {
+            {0x5f, 0}, {0x5e, 0}, {0x5a, 0}, {0x59, 0}, {0x41, 0x58}, {0x41, 0x59}};
+        struct jit_func *callee = f->jf->callees[f->callee++];
+
+        for (int i = 0; i < ast->size; i++)
+        {
+            gen_expr(c, f, ast->edges[i]);
+            EMIT(c, 0x50);
+            c->depth += 1;
+        }
+        // the args are on the stack, rax still holds the last one
+        charge_step(c, f, callee->def);
+        for (int i = ast->size - 1; i >= 0; i--)
+        {
+            emit(c, pops[i], pops[i][0] == 0x41 ? 2 : 1);
+            c->depth -= 1;
+        }
+
+        emit_call(c, (uintptr_t)&callee->code, 1);
+        check_overflow(c);
+        return;
+    }
+    default:
+        break;
+    }
+
+    // binary operators, left in rax, right in rcx
+    gen_expr(c, f, ast->edges[0]);
+    EMIT(c, 0x50);
+    c->depth += 1;
+    set_known(f, 0);
+    gen_expr(c, f, ast->edges[1]);
+    EMIT(c, 0x48, 0x89, 0xc1, 0x58);
+    c->depth -= 1;
+
+    if (ast->type == _opmath)
+    {
+        // tags add up, a product needs one side untagged, a quotient is retagged
+        switch (ast->val.strval[0])
+        {
+        case '+':
+            EMIT(c, 0x48, 0x01, 0xc8);
+            jump_bail(c, JCC_JO);
+            break;
+        case '-':
+            EMIT(c, 0x48, 0x29, 0xc8);
+            jump_bail(c, JCC_JO);
+            break;
+        case '*':
+            EMIT(c, 0x48, 0xd1, 0xf8, 0x48, 0x0f, 0xaf, 0xc1);
+            jump_bail(c, JCC_JO);
+            break;
+        case '/':
+            // test rcx, rcx : the interpreter reports dividing by 0
+            EMIT(c, 0x48, 0x85, 0xc9);
+            jump_bail(c, JCC_JE);
+            EMIT(c, 0x48, 0xd1, 0xf8, 0x48, 0xd1, 0xf9, 0x48, 0x99, 0x48, 0xf7, 0xf9, 0x48, 0x01, 0xc0);
+            jump_bail(c, JCC_JO);
+            break;
+        case '%':
+            EMIT(c, 0x48, 0x85, 0xc9);
+            jump_bail(c, JCC_JE);
+            EMIT(c, 0x48, 0xd1, 0xf8, 0x48, 0xd1, 0xf9, 0x48, 0x99, 0x48, 0xf7, 0xf9, 0x48, 0x8d, 0x04, 0x12);
+            break;
+        case '^':
+            EMIT(c, 0x48, 0x89, 0xc7, 0x48, 0x89, 0xce);
+            emit_call(c, (uintptr_t)jit_pow, 0);
+            check_overflow(c);
+            break;
+        }
+    }
+    else if (ast->type == _opcomp)
+    {
+        // cmp rax, rcx ; setcc al ; movzx eax, al ; add eax, eax
+        EMIT(c, 0x48, 0x39, 0xc8, 0x0f, comp_jcc(ast->val.strval) + 0x10, 0xc0, 0x0f, 0xb6, 0xc0, 0x01, 0xc0);
+    }
+}
+
+// The value of ast in rax, which the interpreter then holds as current
+static void gen_expr(struct code_buf *c, struct frame *f, struct ast *ast)
+{
+    gen_value(c, f, ast);
+    f->current = CURRENT_RAX;
+}
+
+static void gen_stmt(struct code_buf *c, struct frame *f, struct ast *ast);
+
+static void gen_compound(struct code_buf *c, struct frame *f, struct ast *ast)
+{
+    for (int i = 0; i < ast->size; i++)
+        gen_stmt(c, f, ast->edges[i]);
+}
+
+static void gen_stmt(struct code_buf *c, struct frame *f, struct ast *ast)
+{
+    switch (ast->type)
+    {
+    case _opeq:
+        gen_expr(c, f, ast->edges[1]);
+        store_rax(c, var_slot(f, ast->edges[0]));
+        store_rax(c, f->cur);
+        return;
+    case _opcontrol:
+        // check_ast put break and continue in a loop, return in the funk
+        if (!strcmp(ast->val.strval, "return"))
+        {
+            gen_expr(c, f, ast->edges[0]);
+            store_rax(c, f->cur);
+            add_jump(f->returns, emit_jump(c, 0));
+        }
+        else if (!strcmp(ast->val.strval, "break"))
+            add_jump(f->breaks, emit_jump(c, 0));
+        else
+        {
+            f->current = CURRENT_SLOT;
+            charge_step(c, f, f->loop);
+            jump_to(c, 0, f->top);
+        }
+        return;
+    case _block:
+    {
+        if (strcmp(ast->val.strval, "ifelse"))
+            return;
+
+        int *ends = calloc(ast->size, sizeof(int));
+        int nends = 0;
+
+        for (int i = 0; i < ast->size; i++)
+        {
+            struct ast *branch = ast->edges[i];
+            if (!strcmp(branch->val.strval, "else"))
+            {
+                gen_compound(c, f, branch->edges[0]);
+                continue;
+            }
+
+            struct jumps next = {NULL, 0};
+            gen_cond(c, f, branch->edges[0], &next);
+            gen_compound(c, f, branch->edges[1]);
+            ends[nends++] = emit_jump(c, 0);
+            patch_jumps(c, &next, c->size);
+            store_imm(c, f->cur, 0);
+        }
+
+        for (int i = 0; i < nends; i++)
+            patch(c, ends[i], c->size);
+
+        free(ends);
+        return;
+    }
+    case _loop:
+    {
+        struct jumps done = {NULL, 0};
+        struct jumps breaks = {NULL, 0};
+        struct ast *outer_loop = f->loop;
+        int outer_top = f->top;
+        struct jumps *outer_breaks = f->breaks;
+
+        f->loop = ast;
+        f->top = c->size;
+        f->breaks = &breaks;
+        gen_cond(c, f, ast->edges[0], &done);
+        gen_compound(c, f, ast->edges[1]);
+        f->current = CURRENT_SLOT;
+        charge_step(c, f, ast);
+        jump_to(c, 0, f->top);
+
+        // a break keeps the last value of the body
+        patch_jumps(c, &done, c->size);
+        store_imm(c, f->cur, 0);
+        patch_jumps(c, &breaks, c->size);
+
+        f->loop = outer_loop;
+        f->top = outer_top;
+        f->breaks = outer_breaks;
+        return;
+    }
+    default:
+        gen_expr(c, f, ast);
+        store_rax(c, f->cur);
+        return;
+    }
+}
+
+static int gen_func(struct jit_func *jf)
+{
+    static const unsigned char stores[JIT_MAX_ARGS][3] = {
+        {0x48, 0x89, 0xbd}, {0x48, 0x89, 0xb5}, {0x48, 0x89, 0x95},
+        {0x48, 0x89, 0x8d}, {0x4c, 0x89, 0x85}, {0x4c, 0x89, 0x8d}};
+    struct code_buf c = {0};
+    struct jumps returns = {NULL, 0};
+    struct frame f = {0};
+    int nslots = jf->args.size + jf->locals.size + 1;
+
+    f.jf = jf;
+    f.cur = slot(nslots - 1);
+    f.returns = &returns;
+
+    // push rbp ; mov rbp, rsp ; sub rsp, frame
+    EMIT(&c, 0x55, 0x48, 0x89, 0xe5, 0x48, 0x81, 0xec);
+    emit32(&c, 8 * (nslots + nslots % 2));
+
+    // mov rax, &call_stack.limit ; cmp rsp, [rax] ; jb bail
+    // the interpreter then runs out of stack and reports the calls
+    jf->stack_limit = &call_stack.limit;
+    EMIT(&c, 0x48, 0xb8);
+    emit64(&c, (uint64_t)(uintptr_t)jf->stack_limit);
+    EMIT(&c, 0x48, 0x3b, 0x20);
+    jump_bail(&c, JCC_JB);
+
+    for (int i = 0; i < jf->args.size; i++)
+    {
+        emit(&c, stores[i], 3);
+        emit32(&c, slot(i));
+    }
+    for (int i = jf->args.size; i < nslots; i++)
+    {
+        EMIT(&c, 0x48, 0xc7, 0x85);
+        emit32(&c, slot(i));
+        emit32(&c, 0);
+    }
+
+    gen_compound(&c, &f, jf->def->edges[1]);
+    patch_jumps(&c, &returns, c.size);
+
+    // mov rax, [cur] ; leave ; ret
+    load_rax(&c, f.cur);
+    EMIT(&c, 0xc9, 0xc3);
+
+    // bail : mov eax, JIT_BAIL ; leave ; ret
+    for (int i = 0; i < c.nbails; i++)
+        patch(&c, c.bails[i], c.size);
+    free(c.bails);
+    EMIT(&c, 0xb8);
+    emit32(&c, JIT_BAIL);
+    EMIT(&c, 0xc9, 0xc3);
+
+    size_t len = (c.size + 4095) & ~(size_t)4095;
+    void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED)
+    {
+        free(c.data);
+        return 0;
+    }
+
+    memcpy(map, c.data, c.size);
+    free(c.data);
+
+    if (mprotect(map, len, PROT_READ | PROT_EXEC))
+    {
+        munmap(map, len);
+        return 0;
+    }
+
+    jf->map = map;
+    jf->maplen = len;
+    jf->code = (jit_entry)(uintptr_t)map;
+    return 1;
+}
+
+static int compile(struct jit_func *root, struct scope *s, unsigned long epoch)
+{
+    struct batch b = {NULL, 0, s, epoch};
+
+    int ret = analyze_func(&b, root) && check_batch(&b);
+
+    for (int i = 0; i < b.size && ret; i++)
+        ret = gen_func(b.funcs[i]);
+
+    for (int i = 0; i < b.size; i++)
+    {
+        struct jit_func *jf = b.funcs[i];
+        if (ret)
+        {
+            jf->state = JIT_READY;
+            jf->epoch = epoch;
+        }
+        else
+        {
+            release_code(jf);
+            jf->state = JIT_COLD;
+        }
+    }
+
+    if (!ret)
+        root->state = JIT_UNSUPPORTED;
+
+    free(b.funcs);
+    return ret;
+}
+
+int jit_try_call(struct ast *f, struct scope *s, value *args, unsigned long epoch, value *res)
+{
+    if (!jit_threshold)
+        return 0;
+
+    struct jit_func *jf = get_jit(f);
+
+    if (jf->state == JIT_READY && jf->epoch != epoch)
+    {
+        release_code(jf);
+        jf->state = JIT_COLD;
+        jf->calls = 0;
+    }
+
+    if (jf->state == JIT_COLD)
+    {
+        jf->calls += 1;
+        if (jf->calls < jit_threshold || !compile(jf, s, epoch))
+            return 0;
+    }
+
+    if (jf->state != JIT_READY || jf->stack_limit != &call_stack.limit)
+        return 0;
+
+    for (int i = 0; i < jf->guard.size; i++)
+    {
+        if (getdef_hashed(s, jf->guard.names[i]->val.strval, ast_hash(jf->guard.names[i])))
+            return 0;
+    }
+
+    value a[JIT_MAX_ARGS] = {0};
+    for (int i = 0; i < jf->args.size; i++)
+    {
+        if (!val_is_small(args[i]))
+            return 0;
+        a[i] = args[i];
+    }
+
+    // the steps of a call interpreted again are charged once
+    struct fuel before = fuel;
+    value r = jf->code(a[0], a[1], a[2], a[3], a[4], a[5]);
+    // the budget ran out in native code, which recorded where
+    if (r == JIT_BAIL && fuel.at)
+        return -1;
+    if (r == JIT_BAIL)
+    {
+        // nothing native has side effects : interpret the call, and the funk from now on
+        fuel = before;
+        jf->state = JIT_UNSUPPORTED;
+        return 0;
+    }
+
+    val_assign(res, r);
+    return 1;
+}
+
+#else
+
+int jit_try_call(struct ast *f, struct scope *s, value *args, unsigned long epoch, value *res)
+{
+    return 0;
+}
+
+void jit_free(struct jit_func *jf)
+{
+}
+
+#endif
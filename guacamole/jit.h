@@ -0,0 +1,25 @@
+#ifndef _JIT_H
+#define _JIT_H
+#include "my_calc.h"
+
+// Baseline x86-64 JIT for hot funks (Linux only, no-op elsewhere)
+//
+// A funk is translated once it has been called jit threshold times. Only funks
+// touching nothing but their args and locals, and calling only such funks, are
+// supported : they have no side effect, so any other funk keeps being interpreted.
+// A funk whose native code overflows the small int range is interpreted from then on.
+
+#define JIT_DEFAULT_THRESHOLD 100
+
+// Calls before a funk is compiled, 0 disables the JIT
+void jit_configure(int threshold);
+
+// Run funk f (a _funcdef) natively with args, counting the call and compiling it
+// once hot. Returns 0 when the call has to be interpreted instead, -1 when the
+// budget stopped it where the interpreter would have.
+int jit_try_call(struct ast *f, struct scope *s, value *args, unsigned long epoch, value *res);
+
+// Release the machine code attached to a _funcdef
+void jit_free(struct jit_func *jf);
+
+#endif /* _JIT_H */
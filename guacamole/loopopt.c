@@ -0,0 +1,509 @@
+#include "loopopt.h"
+#include "builtins.h"
+#include "mem.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int loop_opt_enabled = 1;
+
+void loop_opt_configure(int enabled)
+{
+    loop_opt_enabled = enabled;
+}
+
+// Names borrowed from the AST, with how many times each one is assigned
+struct name_count
+{
+    const char **names;
+    int *counts;
+    int size;
+};
+
+// A while being analyzed
+struct loop_ctx
+{
+    struct ast *loop;
+    struct loop_info *info;
+    struct name_count assigned;
+    // calls a funk that is not a builtin : it may assign any of writes, or any name without writes
+    int calls;
+    struct name_count *writes;
+    // names the program defines, NULL when unknown
+    struct name_count *defined;
+    int control;
+    int funcdef;
+};
+
+static int count_of(struct name_count *set, const char *name)
+{
+    for (int i = 0; i < set->size; i++)
+    {
+        if (!strcmp(set->names[i], name))
+            return set->counts[i];
+    }
+
+    return 0;
+}
+
+static void count_name(struct name_count *set, const char *name)
+{
+    for (int i = 0; i < set->size; i++)
+    {
+        if (!strcmp(set->names[i], name))
+        {
+            set->counts[i] += 1;
+            return;
+        }
+    }
+
+    set->names = mem_reallocarray(MEM_LOOPS, set->names, set->size + 1, sizeof(char *));
+    set->counts = mem_reallocarray(MEM_LOOPS, set->counts, set->size + 1, sizeof(int));
+    set->names[set->size] = name;
+    set->counts[set->size] = 1;
+    set->size += 1;
+}
+
+static void free_names(struct name_count *set)
+{
+    mem_free(MEM_LOOPS, set->names);
+    mem_free(MEM_LOOPS, set->counts);
+}
+
+// ANALYSIS
+
+// Names a funk call may assign in its caller : everything assigned or defined in a funk body
+static void collect_funk_writes(struct name_count *writes, struct ast *ast, int infunk)
+{
+    if (infunk && (ast->type == _funcdef || ast->type == _opeq))
+        count_name(writes, ast->type == _funcdef ? ast->val.strval : ast->edges[0]->val.strval);
+
+    for (int i = 0; i < ast->size; i++)
+        collect_funk_writes(writes, ast->edges[i], infunk || (ast->type == _funcdef && i == 1));
+}
+
+// Names defined anywhere (funks, variables, args), a builtin of the same name may be shadowed
+static void collect_defined(struct name_count *defined, struct ast *ast)
+{
+    if (ast->type == _funcdef || ast->type == _opeq)
+        count_name(defined, ast->type == _funcdef ? ast->val.strval : ast->edges[0]->val.strval);
+    if (ast->type == _args)
+    {
+        for (int i = 0; i < ast->size; i++)
+            count_name(defined, ast->edges[i]->val.strval);
+    }
+
+    for (int i = 0; i < ast->size; i++)
+        collect_defined(defined, ast->edges[i]);
+}
+
+// Builtin a call surely runs, NULL when a funk of the program may define its name
+static const struct builtin *builtin_call(struct name_count *defined, struct ast *ast)
+{
+    if (ast->type != _funccall || !defined || count_of(defined, ast->val.strval))
+        return NULL;
+
+    return find_builtin(ast->val.strval);
+}
+
+static int call_may_write(struct loop_ctx *ctx, const char *name)
+{
+    return ctx->calls && (!ctx->writes || count_of(ctx->writes, name));
+}
+
+static void scan_loop(struct loop_ctx *ctx, struct ast *ast)
+{
+    switch (ast->type)
+    {
+    case _funcdef:
+        // the body runs when called, not here
+        count_name(&ctx->assigned, ast->val.strval);
+        ctx->funcdef = 1;
+        return;
+    case _opeq:
+        count_name(&ctx->assigned, ast->edges[0]->val.strval);
+        // the index of an element assignment
+        if (ast->edges[0]->type == _index)
+            scan_loop(ctx, ast->edges[0]->edges[0]);
+        scan_loop(ctx, ast->edges[1]);
+        return;
+    case _funccall:
+        if (!builtin_call(ctx->defined, ast))
+            ctx->calls = 1;
+        break;
+    case _opcontrol:
+        ctx->control = 1;
+        break;
+    default:
+        break;
+    }
+
+    for (int i = 0; i < ast->size; i++)
+        scan_loop(ctx, ast->edges[i]);
+}
+
+static int is_invariant_name(struct loop_ctx *ctx, const char *name)
+{
+    return !count_of(&ctx->assigned, name) && !call_may_write(ctx, name);
+}
+
+// No call but to pure builtins and no name the loop may assign
+static int is_invariant(struct loop_ctx *ctx, struct ast *ast)
+{
+    const struct builtin *b;
+
+    if (ast->type == _funccall && (!(b = builtin_call(ctx->defined, ast)) || !b->pure))
+        return 0;
+    if ((ast->type == _var || ast->type == _index) && !is_invariant_name(ctx, ast->val.strval))
+        return 0;
+
+    for (int i = 0; i < ast->size; i++)
+    {
+        if (!is_invariant(ctx, ast->edges[i]))
+            return 0;
+    }
+
+    return 1;
+}
+
+// Step of name when the loop assigns it once, with a top level `name = name + c`
+static int induction_step(struct loop_ctx *ctx, struct ast *name, int *step)
+{
+    if (name->type != _var || count_of(&ctx->assigned, name->val.strval) != 1 ||
+        call_may_write(ctx, name->val.strval))
+        return 0;
+
+    struct ast *body = ctx->loop->edges[1];
+    for (int i = 0; i < body->size; i++)
+    {
+        struct ast *st = body->edges[i];
+        if (st->type != _opeq || strcmp(st->edges[0]->val.strval, name->val.strval))
+            continue;
+        if (st->edges[0]->type != _var)
+            return 0;
+
+        struct ast *e = st->edges[1];
+        if (e->type != _opmath || e->size != 2 || (e->val.strval[0] != '+' && e->val.strval[0] != '-'))
+            return 0;
+
+        struct ast *var = e->edges[0];
+        struct ast *c = e->edges[1];
+        if (e->val.strval[0] == '+' && c->type == _var)
+        {
+            var = e->edges[1];
+            c = e->edges[0];
+        }
+
+        if (var->type != _var || strcmp(var->val.strval, name->val.strval) || c->type != _const || c->size)
+            return 0;
+
+        if (!val_is_small(c->val.intval))
+            return 0;
+
+        long s = e->val.strval[0] == '+' ? val_untag(c->val.intval) : -val_untag(c->val.intval);
+        if (!s || s < INT_MIN || s > INT_MAX)
+            return 0;
+
+        *step = s;
+        return 1;
+    }
+
+    return 0;
+}
+
+static void find_counted(struct loop_ctx *ctx)
+{
+    struct ast *cond = ctx->loop->edges[0];
+    struct ast *body = ctx->loop->edges[1];
+
+    if (ctx->calls || ctx->control || ctx->funcdef || body->size > LOOP_UNROLL_BODY)
+        return;
+    if (cond->type != _opcomp || cond->size != 2 || !strcmp(cond->val.strval, "=="))
+        return;
+
+    for (int flip = 0; flip < 2; flip++)
+    {
+        int step;
+        struct ast *ind = cond->edges[flip];
+        struct ast *bound = cond->edges[!flip];
+
+        if (induction_step(ctx, ind, &step) && is_invariant(ctx, bound))
+        {
+            ctx->info->ind = ind;
+            ctx->info->bound = bound;
+            ctx->info->op = cond->val.strval;
+            ctx->info->flip = flip;
+            ctx->info->step = step;
+            return;
+        }
+    }
+}
+
+static struct loop_cache *new_cache(struct ast *ast, struct loop_info *owner)
+{
+    ast->cache = mem_calloc(MEM_LOOPS, 1, sizeof(struct loop_cache));
+    ast->cache->owner = owner;
+    return ast->cache;
+}
+
+// Loops enclosing an expression, outermost first, within the same funk body
+struct loop_stack
+{
+    struct loop_ctx **ctx;
+    int size;
+    // names funk calls may assign and names the program defines, NULL when unknown
+    struct name_count *writes;
+    struct name_count *defined;
+};
+
+static void annotate(struct loop_stack *st, struct ast *ast, int parent_owner);
+
+static void annotate_loop(struct loop_stack *st, struct ast *ast)
+{
+    struct loop_ctx ctx = {0};
+    ctx.loop = ast;
+    ctx.writes = st->writes;
+    ctx.defined = st->defined;
+    ctx.info = mem_calloc(MEM_LOOPS, 1, sizeof(struct loop_info));
+    ast->loop = ctx.info;
+    scan_loop(&ctx, ast);
+    find_counted(&ctx);
+
+    st->ctx = mem_reallocarray(MEM_LOOPS, st->ctx, st->size + 1, sizeof(struct loop_ctx *));
+    st->ctx[st->size] = &ctx;
+    st->size += 1;
+
+    for (int i = 0; i < ast->size; i++)
+        annotate(st, ast->edges[i], st->size);
+
+    st->size -= 1;
+    free_names(&ctx.assigned);
+}
+
+static void annotate_expr(struct loop_stack *st, struct ast *ast, int parent_owner)
+{
+    int owner = 0;
+    while (owner < st->size && !is_invariant(st->ctx[owner], ast))
+        owner += 1;
+
+    if (owner < parent_owner)
+    {
+        new_cache(ast, st->ctx[owner]->info)->hoisted = 1;
+        parent_owner = owner;
+    }
+    else if (st->size && ast->type == _opmath && (ast->val.strval[0] == '*' || ast->val.strval[0] == '^'))
+    {
+        struct loop_ctx *inner = st->ctx[st->size - 1];
+        int step;
+
+        for (int i = 0; i < 2; i++)
+        {
+            if (ast->val.strval[0] == '^' && i == 0)
+                continue;
+
+            if (induction_step(inner, ast->edges[i], &step) && is_invariant(inner, ast->edges[!i]) &&
+                (ast->val.strval[0] == '*' || step == 1))
+            {
+                struct loop_cache *c = new_cache(ast, inner->info);
+                c->ind = i;
+                c->step = step;
+                break;
+            }
+        }
+    }
+
+    for (int i = 0; i < ast->size; i++)
+        annotate(st, ast->edges[i], parent_owner);
+}
+
+static void annotate(struct loop_stack *st, struct ast *ast, int parent_owner)
+{
+    if (ast->type == _funcdef)
+    {
+        // a funk body runs in its own scope, loops around its definition do not matter
+        struct loop_stack body = {NULL, 0, st->writes, st->defined};
+        annotate(&body, ast->edges[1], 0);
+        mem_free(MEM_LOOPS, body.ctx);
+        return;
+    }
+
+    if (ast->type == _loop)
+    {
+        annotate_loop(st, ast);
+        return;
+    }
+
+    const struct builtin *b;
+    if (((ast->type == _opmath || ast->type == _opcomp || ast->type == _oplogic) && ast->size == 2) ||
+        ((b = builtin_call(st->defined, ast)) && b->pure))
+    {
+        annotate_expr(st, ast, parent_owner);
+        return;
+    }
+
+    for (int i = 0; i < ast->size; i++)
+        annotate(st, ast->edges[i], parent_owner);
+}
+
+void optimize_loops(struct ast *ast, int whole)
+{
+    if (!loop_opt_enabled)
+        return;
+
+    struct name_count writes = {0};
+    struct name_count defined = {0};
+    struct loop_stack st = {NULL, 0, whole ? &writes : NULL, whole ? &defined : NULL};
+
+    if (whole)
+    {
+        collect_funk_writes(&writes, ast, 0);
+        collect_defined(&defined, ast);
+    }
+    annotate(&st, ast, 0);
+
+    mem_free(MEM_LOOPS, st.ctx);
+    free_names(&writes);
+    free_names(&defined);
+}
+
+// RUNTIME
+
+unsigned long loop_enter(struct loop_info *li)
+{
+    if (!li)
+        return 0;
+
+    unsigned long saved = li->stamp;
+    li->stamp = ++li->entries;
+    return saved;
+}
+
+void loop_leave(struct loop_info *li, unsigned long saved)
+{
+    // a recursive entry may have cached values for its own stamp, they stay stale
+    if (li)
+        li->stamp = saved;
+}
+
+int loop_cached(struct loop_cache *c, value *val)
+{
+    if (!c->hoisted || c->stamp != c->owner->stamp)
+        return 0;
+
+    *val = val_ref(c->val);
+    return 1;
+}
+
+void loop_store(struct loop_cache *c, value val)
+{
+    if (!c->hoisted)
+        return;
+
+    c->stamp = c->owner->stamp;
+    val_assign(&c->val, val_ref(val));
+}
+
+int loop_trips(struct loop_info *li, long ind, long bound, long *trips)
+{
+    long d;
+    long step = li->step;
+    long n;
+    char op[3] = {0};
+
+    if (__builtin_sub_overflow(bound, ind, &d))
+        return 0;
+
+    strncpy(op, li->op, 2);
+    if (li->flip && op[0] != '!')
+        op[0] = op[0] == '<' ? '>' : '<';
+
+    if (!strcmp(op, "<") || !strcmp(op, "<="))
+    {
+        if (d < 0 || (d == 0 && op[1] != '='))
+            n = 0;
+        else if (step < 0 || d > LONG_MAX - step)
+            return 0;
+        else
+            n = op[1] == '=' ? d / step + 1 : (d + step - 1) / step;
+    }
+    else if (!strcmp(op, ">") || !strcmp(op, ">="))
+    {
+        if (d > 0 || (d == 0 && op[1] != '='))
+            n = 0;
+        else if (step > 0 || d < LONG_MIN - step)
+            return 0;
+        else
+            n = op[1] == '=' ? d / step + 1 : (d + step + 1) / step;
+    }
+    else if (!strcmp(op, "!="))
+    {
+        if (d % step || d / step < 0)
+            return 0;
+        n = d / step;
+    }
+    else
+        return 0;
+
+    // the variable must stay a small int on the way
+    long last;
+    if (__builtin_mul_overflow(n, step, &last) || __builtin_add_overflow(ind, last, &last) ||
+        last < VAL_SMALL_MIN || last > VAL_SMALL_MAX)
+        return 0;
+
+    *trips = n;
+    return 1;
+}
+
+value loop_mul(struct loop_cache *c, value l, value r)
+{
+    if (c->hoisted || !val_is_small(l) || !val_is_small(r))
+        return val_mul(l, r);
+
+    long i = val_untag(c->ind ? r : l);
+    long k = val_untag(c->ind ? l : r);
+    long last_i = c->ind ? c->last_r : c->last_l;
+    long last_k = c->ind ? c->last_l : c->last_r;
+    long v;
+
+    // (i + step) * k == i * k + step * k, last always holds last_l * last_r
+    if (k != last_k || i != last_i + c->step || __builtin_mul_overflow((long)c->step, k, &v) ||
+        __builtin_add_overflow(c->last, v, &v))
+    {
+        if (__builtin_mul_overflow(i, k, &v))
+            return val_mul(l, r);
+    }
+
+    if (v < VAL_SMALL_MIN || v > VAL_SMALL_MAX)
+        return val_mul(l, r);
+
+    c->last_l = val_untag(l);
+    c->last_r = val_untag(r);
+    c->last = v;
+    return VAL_SMALL(v);
+}
+
+value loop_pow(struct loop_cache *c, value l, value r)
+{
+    if (c->hoisted || !val_is_small(l) || !val_is_small(r))
+        return val_pow(l, r);
+
+    long a = val_untag(l);
+    long b = val_untag(r);
+    long v;
+
+    // stamp tells last is exactly last_l ^ last_r
+    if (c->stamp && a == c->last_l && c->last_r >= 0 && b == c->last_r + 1 &&
+        !__builtin_mul_overflow(c->last, a, &v) && v >= VAL_SMALL_MIN && v <= VAL_SMALL_MAX)
+    {
+        c->last_r = b;
+        c->last = v;
+        return VAL_SMALL(v);
+    }
+
+    value p = val_pow(l, r);
+    c->stamp = val_is_small(p);
+    c->last_l = a;
+    c->last_r = b;
+    c->last = val_untag(p);
+    return p;
+}
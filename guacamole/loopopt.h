@@ -0,0 +1,73 @@
+#ifndef _LOOPOPT_H
+#define _LOOPOPT_H
+#include "my_calc.h"
+
+// Loop optimizations for while blocks
+//
+// After check_ast, every while gets the names its body may assign. Expressions
+// reading none of them, calling no builtin but the pure ones (len, sum...), are
+// hoisted : computed once per entry of the loop, on first use, then reused. `*`
+// and `^` by an induction variable (`i = i + c`) are strength reduced to an add
+// and a multiply from their previous value. Counted loops with a short body run
+// their body trip count times back to back.
+
+// Most statements in the body of a counted loop run without its condition
+#define LOOP_UNROLL_BODY 8
+
+// Attached to a _loop
+struct loop_info
+{
+    // changes at every entry of the loop, hoisted values of an older entry are stale
+    unsigned long stamp;
+    unsigned long entries;
+    // counted loop : `ind op bound` (`bound op ind` when flip) with ind += step
+    struct ast *ind;
+    struct ast *bound;
+    char *op;
+    int flip;
+    int step;
+};
+
+// Attached to a hoisted or strength reduced _opmath/_opcomp/_oplogic, or a hoisted pure builtin call
+struct loop_cache
+{
+    struct loop_info *owner;
+    // hoisted : owner stamp val was computed for, reduced `^` : last is exact
+    unsigned long stamp;
+    int hoisted;
+    // hoisted value, owned
+    value val;
+    // strength reduction : operand edge holding the induction variable and its step,
+    // previous small operands and result
+    int ind;
+    int step;
+    long last_l;
+    long last_r;
+    long last;
+};
+
+// 0 disables the pass
+void loop_opt_configure(int enabled);
+
+// Annotate the loops of a checked AST. Unless whole, funks defined outside of
+// it may be called, and a loop calling a funk may have any name assigned.
+void optimize_loops(struct ast *ast, int whole);
+
+// Start an entry of loop li, returns what loop_leave needs to restore
+unsigned long loop_enter(struct loop_info *li);
+void loop_leave(struct loop_info *li, unsigned long saved);
+
+// Hoisted value of c if it was computed during the current entry of its loop, as a new reference
+int loop_cached(struct loop_cache *c, value *val);
+
+// Remember the value of a hoisted node for the current entry of its loop
+void loop_store(struct loop_cache *c, value val);
+
+// Iterations of a counted loop entered with ind and bound, 0 when it cannot tell
+int loop_trips(struct loop_info *li, long ind, long bound, long *trips);
+
+// l * r and l ^ r, from the previous value when an induction step allows, consume l and r
+value loop_mul(struct loop_cache *c, value l, value r);
+value loop_pow(struct loop_cache *c, value l, value r);
+
+#endif /* _LOOPOPT_H */
@@ -0,0 +1,63 @@
+#include "mem.h"
+
+int mem_tracking = 0;
+
+struct mem_usage
+{
+    long bytes;
+    long peak;
+    long blocks;
+    long peak_blocks;
+    long allocs;
+    long allocated;
+};
+
+static struct mem_usage usage[MEM_KINDS];
+static long total_bytes;
+static long total_peak;
+
+static const char *kind_names[MEM_KINDS] = {"source", "captures", "ast nodes", "edges arrays", "names", "def tables",
+                                            "args buffers", "bignums", "arrays", "strings", "output", "input", "loop info",
+                                            "call stack"};
+
+void mem_count(enum mem_kind kind, long size, int blocks)
+{
+    struct mem_usage *u = &usage[kind];
+
+    u->bytes += size;
+    u->blocks += blocks;
+    if (blocks > 0)
+        u->allocs += blocks;
+    if (size > 0)
+        u->allocated += size;
+
+    if (u->bytes > u->peak)
+        u->peak = u->bytes;
+    if (u->blocks > u->peak_blocks)
+        u->peak_blocks = u->blocks;
+
+    total_bytes += size;
+    if (total_bytes > total_peak)
+        total_peak = total_bytes;
+}
+
+void mem_report(FILE *f)
+{
+    struct mem_usage sum = {0};
+
+    fprintf(f, "\n%-14s %12s %12s %11s %10s %14s\n", "memory", "live bytes", "peak bytes", "peak blocks", "allocs",
+            "total bytes");
+    for (int i = 0; i < MEM_KINDS; i++)
+    {
+        struct mem_usage *u = &usage[i];
+        fprintf(f, "%-14s %12ld %12ld %11ld %10ld %14ld\n", kind_names[i], u->bytes, u->peak, u->peak_blocks,
+                u->allocs, u->allocated);
+
+        sum.bytes += u->bytes;
+        sum.allocs += u->allocs;
+        sum.allocated += u->allocated;
+    }
+
+    // peaks of different kinds are not simultaneous, the total peak is tracked on its own
+    fprintf(f, "%-14s %12ld %12ld %11s %10ld %14ld\n", "all", sum.bytes, total_peak, "", sum.allocs, sum.allocated);
+}
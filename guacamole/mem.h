@@ -0,0 +1,79 @@
+#ifndef _MEM_H
+#define _MEM_H
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Allocation accounting for --mem-stats
+//
+// The parser, AST, scopes and evaluator allocate through these wrappers, naming
+// the subsystem the block belongs to. Block sizes come from malloc_usable_size,
+// so no header is added and a block freed with the wrong kind only skews the
+// counters. Only counts while mem_tracking is set, which happens before the
+// first allocation of the program.
+
+enum mem_kind
+{
+    MEM_SOURCE,
+    MEM_CAPTURES,
+    MEM_AST,
+    MEM_EDGES,
+    MEM_NAMES,
+    MEM_DEFS,
+    MEM_ARGS,
+    MEM_BIGNUM,
+    MEM_ARRAYS,
+    MEM_STRINGS,
+    MEM_OUTPUT,
+    MEM_INPUT,
+    MEM_LOOPS,
+    MEM_CALLS,
+    MEM_KINDS,
+};
+
+extern int mem_tracking;
+
+// size bytes of kind allocated (or released when negative)
+void mem_count(enum mem_kind kind, long size, int blocks);
+
+static inline void *mem_calloc(enum mem_kind kind, size_t n, size_t size)
+{
+    void *p = calloc(n, size);
+    if (mem_tracking && p)
+        mem_count(kind, malloc_usable_size(p), 1);
+
+    return p;
+}
+
+static inline void *mem_malloc(enum mem_kind kind, size_t size)
+{
+    void *p = malloc(size);
+    if (mem_tracking && p)
+        mem_count(kind, malloc_usable_size(p), 1);
+
+    return p;
+}
+
+static inline void *mem_reallocarray(enum mem_kind kind, void *old, size_t n, size_t size)
+{
+    long before = mem_tracking && old ? (long)malloc_usable_size(old) : 0;
+    void *p = reallocarray(old, n, size);
+
+    if (mem_tracking && p)
+        mem_count(kind, (long)malloc_usable_size(p) - before, !old);
+
+    return p;
+}
+
+static inline void mem_free(enum mem_kind kind, void *p)
+{
+    if (mem_tracking && p)
+        mem_count(kind, -(long)malloc_usable_size(p), -1);
+
+    free(p);
+}
+
+// Current, peak and total bytes and blocks of every kind, with the peak of all kinds together
+void mem_report(FILE *f);
+
+#endif /* _MEM_H */
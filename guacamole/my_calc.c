@@ -1,10 +1,20 @@
 #include "my_parser.h"
 #include "my_calc.h"
+#include "array.h"
 #include "builtins.h"
+#include "callstack.h"
+#include "fuel.h"
+#include "jit.h"
+#include "loopopt.h"
+#include "profile.h"
+#include "reduce.h"
+#include "sampler.h"
+#include "stats.h"
+#include "str.h"
+#include "mem.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#include <criterion/logging.h>
 #include <math.h>
 
 // START GRAMMAR
@@ -18,6 +28,12 @@ int readallblocks(struct parser *p, struct ast *a);
 // FUNCCALL <- VAR"()"
 int readfunccall(struct parser *p, struct ast *a);
 
+// INDEX <- VAR '[' CALC ']'
+int readindex(struct parser *p, struct ast *a);
+
+// ARRAY <- '[' (CALC (',' CALC)*)? ']'
+int readarray(struct parser *p, struct ast *a);
+
 // FUNCDEF <- 'funk ' VAR'(' (ARGUMENT (',' ARGUMENT)*)? ')' '{' (ALLBLOCKS)* '}' ';'?
 int readfuncdef(struct parser *p, struct ast *a);
 
@@ -42,7 +58,7 @@ int readelseblock(struct parser *p, struct ast *a);
 // WHILEBLOCK <- OPWHILE '(' COND (OPORAND COND)* ')' '{' (ALLBLOCKS)* '}' ';'?
 int readwhileblock(struct parser *p, struct ast *a);
 
-// EXPR <- (VAR OPEQ)? (FUNCCALL / CALC) ';'
+// EXPR <- ((VAR / INDEX) OPEQ)? (FUNCCALL / CALC) ';'
 int readexpr(struct parser *p, struct ast *a);
 
 // CALC <- COMP (OPLOGIC COMP)*
@@ -60,9 +76,12 @@ int readmul(struct parser *p, struct ast *a);
 // POW <- PAR (OPEXP PAR)*
 int readpow(struct parser *p, struct ast *a);
 
-// PAR <- OPUNA (INT / VAR / '(' CALC ')')
+// PAR <- OPUNA (INT / STRING / FUNCCALL / INDEX / ARRAY / VAR / '(' CALC ')')
 int readpar(struct parser *p, struct ast *a);
 
+// STRING <- '"' ([^"\\\n] / '\\' .)* '"'
+int readstring(struct parser *p, struct ast *a);
+
 // OPIF <- "if"
 int readopif(struct parser *p, struct ast *a);
 
@@ -115,36 +134,127 @@ int readint(struct parser *p);
 
 // END GRAMMAR
 
-int clean_ast(struct ast *ast)
+// What ast holds, not its edges
+static void clean_node(struct ast *ast)
 {
-    if (ast->type == _var || ast->type == _funccall || ast->type == _funcdef)
+    if (ast->type == _var || ast->type == _funccall || ast->type == _funcdef || ast->type == _index)
     {
-        free(ast->val.strval);
+        mem_free(MEM_NAMES, ast->val.strval);
+    }
+    else if (ast->type == _const)
+    {
+        val_drop(ast->val.intval);
     }
 
-    for (int i = 0; i < ast->size; i++)
+    if (ast->type == _funcdef)
+        jit_free(ast->jit);
+
+    mem_free(MEM_LOOPS, ast->loop);
+    if (ast->cache)
+        val_drop(ast->cache->val);
+    mem_free(MEM_LOOPS, ast->cache);
+}
+
+// Without recursion : a tree is as deep as the stack of the parser allowed, it
+// may be freed with less
+int clean_ast(struct ast *ast)
+{
+    struct ast *local[64];
+    struct ast **todo = local;
+    int size = 0;
+    int cap = 64;
+
+    for (struct ast *node = ast; node; node = size ? todo[--size] : NULL)
     {
-        clean_ast(ast->edges[i]);
-        free(ast->edges[i]);
+        clean_node(node);
+
+        if (size + node->size > cap)
+        {
+            cap = 2 * (size + node->size);
+            todo = todo == local ? memcpy(malloc(cap * sizeof(struct ast *)), local, size * sizeof(struct ast *))
+                                 : realloc(todo, cap * sizeof(struct ast *));
+        }
+        for (int i = node->size - 1; i >= 0; i--)
+            todo[size++] = node->edges[i];
+
+        mem_free(MEM_EDGES, node->edges);
+        if (node != ast)
+            mem_free(MEM_AST, node);
     }
 
-    free(ast->edges);
+    if (todo != local)
+        free(todo);
 
     return 1;
 }
 
+struct ast *copy_ast(struct ast *ast)
+{
+    struct ast *copy = mem_calloc(MEM_AST, 1, sizeof(struct ast));
+
+    copy->type = ast->type;
+    copy->val = ast->val;
+    copy->size = ast->size;
+    copy->begin = ast->begin;
+    copy->end = ast->end;
+    copy->line = ast->line;
+    copy->hash = ast->hash;
+
+    // names are owned by their node, operators are literals
+    if (ast->type == _var || ast->type == _funccall || ast->type == _funcdef || ast->type == _index)
+    {
+        size_t n = strlen(ast->val.strval) + 1;
+        copy->val.strval = mem_malloc(MEM_NAMES, n);
+        memcpy(copy->val.strval, ast->val.strval, n);
+    }
+    else if (ast->type == _const)
+    {
+        copy->val.intval = val_copy(ast->val.intval);
+    }
+
+    copy->edges = mem_calloc(MEM_EDGES, ast->size + 1, sizeof(struct ast *));
+    for (int i = 0; i < ast->size; i++)
+        copy->edges[i] = copy_ast(ast->edges[i]);
+
+    return copy;
+}
+
+// Nodes of the tree under ast, itself included
+static long count_nodes(struct ast *ast)
+{
+    long n = 1;
+    for (int i = 0; i < ast->size; i++)
+        n += count_nodes(ast->edges[i]);
+
+    return n;
+}
+
 int remove_last(struct ast *ast)
 {
     if (!ast->size)
         return 0;
 
+    run_stats.ast_discarded += count_nodes(ast->edges[ast->size - 1]);
+
     clean_ast(ast->edges[ast->size - 1]);
-    free(ast->edges[ast->size - 1]);
+    mem_free(MEM_AST, ast->edges[ast->size - 1]);
     ast->size -= 1;
 
     return 1;
 }
 
+// Back to an empty node, for a node reused by a rule that failed
+static void reset_ast(struct ast *ast)
+{
+    run_stats.ast_discarded += count_nodes(ast) - 1;
+
+    clean_ast(ast);
+    ast->type = 0;
+    ast->val.strval = NULL;
+    ast->size = 0;
+    ast->edges = NULL;
+}
+
 struct ast *append_or_reuse_ast(struct ast *ast, struct parser *p)
 {
     if (!ast->type)
@@ -154,15 +264,16 @@ struct ast *append_or_reuse_ast(struct ast *ast, struct parser *p)
     }
     else
     {
-        struct ast *sub_ast = calloc(1, sizeof(struct ast));
+        struct ast *sub_ast = mem_calloc(MEM_AST, 1, sizeof(struct ast));
         sub_ast->begin = p->current_pos;
+        run_stats.ast_built += 1;
 
-        void *ptr = reallocarray(ast->edges, ast->size + 1, sizeof(struct ast *));
+        void *ptr = mem_reallocarray(MEM_EDGES, ast->edges, ast->size + 1, sizeof(struct ast *));
 
         if (!ptr)
         {
             clean_ast(sub_ast);
-            free(sub_ast);
+            mem_free(MEM_AST, sub_ast);
             return NULL;
         }
 
@@ -183,16 +294,19 @@ struct ast *prepend_or_reuse_ast(struct ast *ast, struct parser *p)
     }
     else
     {
-        struct ast *sub_ast = calloc(1, sizeof(struct ast));
+        struct ast *sub_ast = mem_calloc(MEM_AST, 1, sizeof(struct ast));
+        run_stats.ast_built += 1;
         sub_ast->val = ast->val;
         sub_ast->type = ast->type;
         sub_ast->size = ast->size;
         sub_ast->edges = ast->edges;
+        sub_ast->begin = ast->begin;
+        sub_ast->end = ast->end;
         ast->edges = NULL;
         ast->type = 0;
         ast->size = 0;
 
-        void *ptr = reallocarray(ast->edges, ast->size + 1, sizeof(struct ast *));
+        void *ptr = mem_reallocarray(MEM_EDGES, ast->edges, ast->size + 1, sizeof(struct ast *));
 
         if (!ptr)
             return NULL;
@@ -278,7 +392,7 @@ int readopuna(struct parser *p, struct ast *ast)
         else if (op[0] == '!')
             sub_ast->val.strval = "!";
 
-        free(op);
+        mem_free(MEM_NAMES, op);
     }
 
     return ret;
@@ -306,7 +420,7 @@ int readoppow(struct parser *p, struct ast *ast)
         if (op[0] == '^')
             sub_ast->val.strval = "^";
 
-        free(op);
+        mem_free(MEM_NAMES, op);
     }
 
     return ret;
@@ -338,7 +452,7 @@ int readopmul(struct parser *p, struct ast *ast)
         else if (op[0] == '%')
             sub_ast->val.strval = "%%";
 
-        free(op);
+        mem_free(MEM_NAMES, op);
     }
 
     return ret;
@@ -368,7 +482,7 @@ int readopadd(struct parser *p, struct ast *ast)
         else if (op[0] == '-')
             sub_ast->val.strval = "-";
 
-        free(op);
+        mem_free(MEM_NAMES, op);
     }
 
     return ret;
@@ -406,7 +520,7 @@ int readopcomp(struct parser *p, struct ast *ast)
         else if (!strcmp(op, ">"))
             sub_ast->val.strval = ">";
 
-        free(op);
+        mem_free(MEM_NAMES, op);
     }
 
     return ret;
@@ -436,7 +550,7 @@ int readoplogic(struct parser *p, struct ast *ast)
         else if (!strcmp(op, "&&"))
             sub_ast->val.strval = "&&";
 
-        free(op);
+        mem_free(MEM_NAMES, op);
     }
 
     return ret;
@@ -589,6 +703,13 @@ int readopif(struct parser *p, struct ast *ast)
     return ret;
 }
 
+// Less stack left than a rule may need : the parse fails from here
+static int out_of_stack(struct parser *p)
+{
+    p->deep |= callstack_low();
+    return p->deep;
+}
+
 int readpar(struct parser *p, struct ast *ast)
 {
     int ret = 0;
@@ -605,13 +726,13 @@ int readpar(struct parser *p, struct ast *ast)
         char *tmp = get_value(p, "INT");
 
         par_ast->type = _const;
-        par_ast->val.intval = atoi(tmp);
+        par_ast->val.intval = val_parse(tmp);
         par_ast->end = p->current_pos;
 
-        free(tmp);
+        mem_free(MEM_NAMES, tmp);
         ret = 1;
     }
-    else if (readfunccall(p, par_ast))
+    else if (readstring(p, par_ast) || readfunccall(p, par_ast) || readindex(p, par_ast) || readarray(p, par_ast))
         ret = 1;
     else if (readvar(p))
     {
@@ -619,7 +740,7 @@ int readpar(struct parser *p, struct ast *ast)
 
         if (!strcmp(tmp, "return") || !strcmp(tmp, "while") || !strcmp(tmp, "break") || !strcmp(tmp, "funk") || !strcmp(tmp, "if") || !strcmp(tmp, "elif") || !strcmp(tmp, "else"))
         {
-            free(tmp);
+            mem_free(MEM_NAMES, tmp);
         }
         else
         {
@@ -639,6 +760,50 @@ int readpar(struct parser *p, struct ast *ast)
     return ret;
 }
 
+// Literals of the program being read, interned for its whole parse
+static _Thread_local struct str_pool *interning;
+
+int readstring(struct parser *p, struct ast *ast)
+{
+    int tmp_pos = p->current_pos;
+
+    if (!readchar(p, '"'))
+        return 0;
+
+    int begin = p->current_pos;
+    while (readnotset(p, "\"\\\n") || (readchar(p, '\\') && nextchar(p)))
+        ;
+
+    int end = p->current_pos;
+    if (!readchar(p, '"'))
+    {
+        p->err = "Missing closing quote '\"'";
+        p->current_pos = tmp_pos;
+        return 0;
+    }
+
+    // escapes only shrink the text
+    char *buf = mem_malloc(MEM_NAMES, end - begin + 1);
+    long n = 0;
+    for (int i = begin; i < end; i++)
+    {
+        char c = p->content[i];
+        if (c == '\\')
+        {
+            c = p->content[++i];
+            c = c == 'n' ? '\n' : c == 't' ? '\t' : c == 'r' ? '\r' : c;
+        }
+        buf[n++] = c;
+    }
+
+    ast->type = _const;
+    ast->val.intval = interning ? str_intern(interning, buf, n) : str_new(buf, n);
+    ast->end = p->current_pos;
+
+    mem_free(MEM_NAMES, buf);
+    return 1;
+}
+
 int readpow(struct parser *p, struct ast *ast)
 {
     int ret = 0;
@@ -719,6 +884,10 @@ int readcalc(struct parser *p, struct ast *ast)
 {
     int ret = 0;
 
+    if (out_of_stack(p))
+        return 0;
+    int begin = p->current_pos;
+
     struct ast *sub_ast = append_or_reuse_ast(ast, p);
 
     if (readcomp(p, sub_ast))
@@ -730,6 +899,8 @@ int readcalc(struct parser *p, struct ast *ast)
 
     if (!ret && (sub_ast != ast))
         remove_last(ast);
+    if (!ret && p->deep)
+        p->deep_pos = begin;
 
     return ret;
 }
@@ -764,6 +935,25 @@ int readexpr(struct parser *p, struct ast *ast)
         else
         {
             p->current_pos = last_pos;
+
+            // an element assignment, the index becomes edge 0 of the _opeq
+            if (readindex(p, sub_ast))
+            {
+                eq_begin = p->current_pos;
+                if (readopeq(p))
+                {
+                    struct ast *eq_ast = prepend_or_reuse_ast(sub_ast, p);
+                    eq_ast->type = _opeq;
+                    eq_ast->val.strval = "=";
+                    eq_ast->begin = eq_begin;
+                    eq_ast->end = p->current_pos;
+                }
+                else
+                {
+                    reset_ast(sub_ast);
+                    p->current_pos = last_pos;
+                }
+            }
         }
     }
 
@@ -1183,7 +1373,88 @@ int readfunccall(struct parser *p, struct ast *ast)
 
     if (!ret)
     {
-        remove_last(ast);
+        if (sub_ast == ast)
+            reset_ast(ast);
+        else
+            remove_last(ast);
+        p->current_pos = tmp_pos;
+    }
+
+    return ret;
+}
+
+int readindex(struct parser *p, struct ast *ast)
+{
+    int ret = 0;
+
+    struct ast *sub_ast = append_or_reuse_ast(ast, p);
+
+    int tmp_pos = p->current_pos;
+    if (readvar(p) && readchar(p, '['))
+    {
+        sub_ast->type = _index;
+        sub_ast->val.strval = get_value(p, "VAR");
+
+        clean_space(p);
+        if (readcalc(p, sub_ast))
+        {
+            clean_space(p);
+            if (readchar(p, ']'))
+                ret = 1;
+        }
+
+        if (!ret)
+            p->err = "Missing index closing bracket ']'";
+    }
+
+    sub_ast->end = p->current_pos;
+
+    if (!ret)
+    {
+        if (sub_ast == ast)
+            reset_ast(ast);
+        else
+            remove_last(ast);
+        p->current_pos = tmp_pos;
+    }
+
+    return ret;
+}
+
+int readarray(struct parser *p, struct ast *ast)
+{
+    int ret = 0;
+
+    struct ast *sub_ast = append_or_reuse_ast(ast, p);
+
+    int tmp_pos = p->current_pos;
+    clean_space(p);
+    if (readchar(p, '['))
+    {
+        sub_ast->type = _array;
+
+        clean_space(p);
+        while (readcalc(p, sub_ast))
+        {
+            clean_space(p);
+            if (!readchar(p, ','))
+                break;
+        }
+
+        if (readchar(p, ']'))
+            ret = 1;
+        else
+            p->err = "Missing array closing bracket ']'";
+    }
+
+    sub_ast->end = p->current_pos;
+
+    if (!ret)
+    {
+        if (sub_ast == ast)
+            reset_ast(ast);
+        else
+            remove_last(ast);
         p->current_pos = tmp_pos;
     }
 
@@ -1194,9 +1465,16 @@ int readallblocks(struct parser *p, struct ast *ast)
 {
     int ret = 0;
 
+    if (out_of_stack(p))
+        return 0;
+    int begin = p->current_pos;
+
     if (readcomment(p) || readcontrol(p, ast) || readfuncdef(p, ast) || readblock(p, ast) || readexpr(p, ast))
         ret = 1;
 
+    if (!ret && p->deep)
+        p->deep_pos = begin;
+
     return ret;
 }
 
@@ -1206,8 +1484,11 @@ int readlang(struct parser *p, struct ast *ast)
 
     ast->type = _compound;
 
+    interning = str_pool_new();
     while (readallblocks(p, ast))
         ;
+    str_pool_free(interning);
+    interning = NULL;
 
     int tmp_pos = p->current_pos;
     int last_pos = p->last_pos;
@@ -1227,114 +1508,147 @@ int readlang(struct parser *p, struct ast *ast)
     return ret;
 }
 
-struct def_list *getdef(struct scope *s, char *name)
+unsigned int ast_hash(struct ast *a)
 {
-    if (s->defs == NULL)
-        return NULL;
+    if (!a->hash)
+        a->hash = hash_name(a->val.strval);
 
-    struct def_list *ptr = s->defs;
-    while (ptr)
-    {
-        if (!strcmp(ptr->name, name))
-            return ptr;
-        ptr = ptr->next;
-    }
+    return a->hash;
+}
 
-    return NULL;
+struct def_entry *getdef_ast(struct scope *s, struct ast *a)
+{
+    return getdef_hashed(s, a->val.strval, ast_hash(a));
 }
 
-int create_or_reuse_dl(struct ast *a, struct scope *s, union Definition v)
+int create_or_reuse_dl(struct ast *a, struct scope *s, union Definition v, dltype type)
 {
-    struct def_list *ptr = getdef(s, a->val.strval);
+    struct def_entry *ptr = putdef(s, a->val.strval, ast_hash(a));
 
-    if (ptr && !ptr->builtin)
-    {
-        ptr->val = v;
-    }
-    else if (!ptr)
-    {
-        struct def_list *dl = calloc(1, sizeof(struct def_list));
-        char *name = calloc(1, sizeof(char) * (strlen(a->val.strval) + 1));
-        strcpy(name, a->val.strval);
-        dl->name = name;
-        dl->val = v;
-        dl->type = __;
+    // a definition shadows the builtin of the same name
+    ptr->builtin = NULL;
+    if ((ptr->type == _func || type == _func) && (ptr->type == __ || ptr->val.astptr != v.astptr))
+        s->epoch = new_epoch();
 
-        dl->next = s->defs;
-        s->defs = dl;
-    }
+    if (ptr->type == _int)
+        val_drop(ptr->val.intval);
+
+    ptr->val = v;
+    ptr->type = type;
 
     return 1;
 }
 
-void clean_scope(struct scope *s)
+int throw_err(struct ast *ast, struct error_scope *err_s, char *msg)
 {
-    struct def_list *ptr = s->defs;
-    if (ptr != NULL)
+    if (err_s->begin == -1)
     {
-        while (ptr)
-        {
-            struct def_list *tmp = ptr->next;
-
-            if (ptr->name)
-            {
-                free(ptr->name);
-            }
-            free(ptr);
-            ptr = tmp;
-        }
+        err_s->begin = ast->begin;
+        err_s->end = ast->end;
+        err_s->err = msg;
     }
+
+    return 0;
 }
 
-struct scope *duplicate_scope(struct scope *s)
+// Whether evaluating ast may call a funk, which could assign any name
+static int has_call(struct ast *ast)
 {
-    struct scope *new_scope = calloc(1, sizeof(struct scope));
+    if (ast->type == _funccall)
+        return 1;
 
-    struct def_list *ptr = s->defs;
-    if (ptr != NULL)
+    for (int i = 0; i < ast->size; i++)
     {
-        struct def_list *last = NULL;
-        while (ptr)
-        {
-            struct def_list *tmp = ptr->next;
+        if (has_call(ast->edges[i]))
+            return 1;
+    }
+
+    return 0;
+}
 
-            struct def_list *dl = calloc(1, sizeof(struct def_list));
+// Funks walked by pure_funk
+struct funk_set
+{
+    struct ast **funks;
+    int size;
+};
 
-            if (new_scope->defs == NULL)
-                new_scope->defs = dl;
+static int pure_funk(struct ast *funk, struct scope *s, struct funk_set *seen);
 
-            char *name = calloc(1, sizeof(char) * (strlen(ptr->name) + 1));
-            strcpy(name, ptr->name);
-            dl->name = name;
+static int is_arg(struct ast *funk, const char *name)
+{
+    for (int i = 0; i < funk->edges[0]->size; i++)
+    {
+        if (!strcmp(funk->edges[0]->edges[i]->val.strval, name))
+            return 1;
+    }
 
-            dl->val = ptr->val;
-            dl->builtin = ptr->builtin;
-            dl->type = ptr->type;
+    return 0;
+}
 
-            if (last)
-                last->next = dl;
-            else
-                dl->next = NULL;
+// Whether ast, in the body of funk, prints nothing and assigns no name defined in s
+static int pure_node(struct ast *ast, struct ast *funk, struct scope *s, struct funk_set *seen)
+{
+    if (ast->type == _funcdef)
+        return 0;
 
-            last = dl;
+    // the body runs in the scope of its caller, a name it did not create stays assigned
+    if (ast->type == _opeq && !is_arg(funk, ast->edges[0]->val.strval) && getdef_ast(s, ast->edges[0]))
+        return 0;
 
-            ptr = tmp;
-        }
+    if (ast->type == _funccall)
+    {
+        struct def_entry *e = getdef_ast(s, ast);
+        if (!e || (e->builtin ? !e->builtin->pure : e->type != _func || !pure_funk(e->val.astptr, s, seen)))
+            return 0;
+    }
+
+    for (int i = 0; i < ast->size; i++)
+    {
+        if (!pure_node(ast->edges[i], funk, s, seen))
+            return 0;
     }
 
-    return new_scope;
+    return 1;
 }
 
-int throw_err(struct ast *ast, struct error_scope *err_s, char *msg)
+// Whether calling funk from s only changes its own frame, so reduce can run it on
+// other threads : neither it nor the funks it calls print or assign a name of s
+static int pure_funk(struct ast *funk, struct scope *s, struct funk_set *seen)
 {
-    if (err_s->begin == -1)
+    for (int i = 0; i < seen->size; i++)
     {
-        err_s->begin = ast->begin;
-        err_s->end = ast->end;
-        err_s->err = msg;
+        if (seen->funks[i] == funk)
+            return 1;
     }
 
-    return 0;
+    seen->funks = reallocarray(seen->funks, seen->size + 1, sizeof(struct ast *));
+    seen->funks[seen->size++] = funk;
+
+    return pure_node(funk->edges[1], funk, s, seen);
+}
+
+int check_ast(struct ast *ast, struct scope *s, struct visitor_scope *vis_s, struct error_scope *err_s);
+
+// reduce(f, lo, hi, op) : f a pure funk of one arg, op a string literal
+static int check_reduce(struct ast *ast, struct scope *s, struct visitor_scope *vis_s, struct error_scope *err_s)
+{
+    struct def_entry *f = ast->edges[0]->type == _var ? getdef_ast(s, ast->edges[0]) : NULL;
+    if (!f || f->builtin || f->type != _func || f->val.astptr->edges[0]->size != 1)
+        return throw_err(ast, err_s, "reduce should be given a funk of 1 arg!");
+
+    struct funk_set seen = {0};
+    int pure = pure_funk(f->val.astptr, s, &seen);
+    free(seen.funks);
+    if (!pure)
+        return throw_err(ast, err_s, "reduce should be given a funk that prints nothing and assigns no variable of its caller!");
+
+    char buf[STR_INLINE + 1];
+    struct ast *op = ast->edges[3];
+    if (op->type != _const || !val_is_str(op->val.intval) || reduce_op(str_bytes(op->val.intval, buf)) < 0)
+        return throw_err(op, err_s, "reduce op should be \"+\", \"*\", \"min\" or \"max\"!");
+
+    return check_ast(ast->edges[1], s, vis_s, err_s) && check_ast(ast->edges[2], s, vis_s, err_s);
 }
 
 int check_ast(struct ast *ast, struct scope *s, struct visitor_scope *vis_s, struct error_scope *err_s)
@@ -1342,6 +1656,9 @@ int check_ast(struct ast *ast, struct scope *s, struct visitor_scope *vis_s, str
     if (ast == NULL)
         return 0;
 
+    if (callstack_low())
+        return throw_err(ast, err_s, "expression or block nested too deeply for the stack!");
+
     if (ast->type == _const)
     {
         if (ast->size > 0)
@@ -1354,13 +1671,35 @@ int check_ast(struct ast *ast, struct scope *s, struct visitor_scope *vis_s, str
     {
         if (ast->size > 0)
             return throw_err(ast, err_s, "_var should have no edges!");
-        if (!getdef(s, ast->val.strval) && vis_s->state != _invardef)
+        if (!getdef_ast(s, ast) && vis_s->state != _invardef)
             return throw_err(ast, err_s, "_var should be defined before being used!");
 
         if (vis_s->state == _invardef)
         {
             union Definition val;
-            create_or_reuse_dl(ast, s, val);
+            val.intval = 0;
+            create_or_reuse_dl(ast, s, val, _int);
+        }
+
+        return 1;
+    }
+
+    if (ast->type == _index)
+    {
+        if (ast->size != 1)
+            return throw_err(ast, err_s, "_index should have 1 edge!");
+        if (!getdef_ast(s, ast))
+            return throw_err(ast, err_s, "_index should index a defined variable!");
+
+        return check_ast(ast->edges[0], s, vis_s, err_s);
+    }
+
+    if (ast->type == _array)
+    {
+        for (int i = 0; i < ast->size; i++)
+        {
+            if (!check_ast(ast->edges[i], s, vis_s, err_s))
+                return 0;
         }
 
         return 1;
@@ -1372,7 +1711,7 @@ int check_ast(struct ast *ast, struct scope *s, struct visitor_scope *vis_s, str
         {
             if (ast->size != 0)
                 return throw_err(ast, err_s, "break should not have any edges!");
-            if (vis_s->state != _inwhile)
+            if (!vis_s->loop)
                 return throw_err(ast, err_s, "cannot break outside of a loop!");
             return 1;
         }
@@ -1381,7 +1720,7 @@ int check_ast(struct ast *ast, struct scope *s, struct visitor_scope *vis_s, str
         {
             if (ast->size != 0)
                 return throw_err(ast, err_s, "continue should not have any edges!");
-            if (vis_s->state != _inwhile)
+            if (!vis_s->loop)
                 return throw_err(ast, err_s, "cannot continue outside of a loop!");
             return 1;
         }
@@ -1390,9 +1729,14 @@ int check_ast(struct ast *ast, struct scope *s, struct visitor_scope *vis_s, str
         {
             if (ast->size != 1)
                 return throw_err(ast, err_s, "return should have 1 edge!");
-            if (vis_s->state != _infunc)
+            if (!vis_s->funk)
                 return throw_err(ast, err_s, "cannot return outside of a funk!");
-            return 1;
+
+            int _ogforward = vis_s->forward;
+            vis_s->forward = 1;
+            int ok = check_ast(ast->edges[0], s, vis_s, err_s);
+            vis_s->forward = _ogforward;
+            return ok;
         }
     }
 
@@ -1407,39 +1751,54 @@ int check_ast(struct ast *ast, struct scope *s, struct visitor_scope *vis_s, str
 
         union Definition val;
         val.astptr = ast;
-        create_or_reuse_dl(ast, s, val);
+        create_or_reuse_dl(ast, s, val, _func);
 
-        struct scope *func_s = duplicate_scope(s);
+        // the body is checked in s, what it defines is undone after
+        struct def_journal body = {0};
+        journal_begin(s, &body, 1);
 
         int _ogstate = vis_s->state;
+        struct ast *_ogloop = vis_s->loop;
+        struct ast *_ogfunk = vis_s->funk;
         vis_s->state = _invardef;
-        if (!check_ast(ast->edges[0], func_s, vis_s, err_s))
-        {
-            clean_scope(func_s);
-            return 0;
-        }
-        vis_s->state = 0;
-
-        vis_s->state = _infunc;
-        if (!check_ast(ast->edges[1], func_s, vis_s, err_s))
-        {
-            clean_scope(func_s);
-            return 0;
-        }
+        int ok = check_ast(ast->edges[0], s, vis_s, err_s);
         vis_s->state = _ogstate;
 
-        clean_scope(func_s);
-        free(func_s);
-        return 1;
+        // a loop around the definition is not around the body
+        vis_s->loop = NULL;
+        vis_s->funk = ast;
+        ok = ok && check_ast(ast->edges[1], s, vis_s, err_s);
+        vis_s->loop = _ogloop;
+        vis_s->funk = _ogfunk;
+
+        journal_end(s, 1);
+        free_journal(&body);
+        return ok;
     }
 
     if (ast->type == _funccall)
     {
-        struct def_list *func;
-        if (!(func = getdef(s, ast->val.strval)))
+        struct def_entry *func = getdef_ast(s, ast);
+        if (!func && !vis_s->forward)
             return throw_err(ast, err_s, "_funccall should be after function is defined!");
+        if (!func)
+        {
+            for (int i = 0; i < ast->size; i++)
+            {
+                if (!check_ast(ast->edges[i], s, vis_s, err_s))
+                    return 0;
+            }
+
+            return 1;
+        }
+        if (!func->builtin && func->type != _func)
+            return throw_err(ast, err_s, "_funccall should call a funk!");
+        if (func->builtin && (ast->size > func->builtin->arity || ast->size < func->builtin->arity - func->builtin->optional))
+            return throw_err(ast, err_s, "_funccall should have the same # of args as the builtin!");
         if (!func->builtin && ast->size != func->val.astptr->edges[0]->size)
             return throw_err(ast, err_s, "_funccall should have the same # of args as the _funcdef!");
+        if (func->builtin && func->builtin->funk)
+            return check_reduce(ast, s, vis_s, err_s);
 
         for (int i = 0; i < ast->size; i++)
         {
@@ -1498,11 +1857,11 @@ int check_ast(struct ast *ast, struct scope *s, struct visitor_scope *vis_s, str
         if (ast->edges[1]->type != _compound)
             return throw_err(ast, err_s, "_loop edges[1] should be of type _compound!");
 
-        int _ogstate = vis_s->state;
-        vis_s->state = _inwhile;
+        struct ast *_ogloop = vis_s->loop;
+        vis_s->loop = ast;
         if (!check_ast(ast->edges[0], s, vis_s, err_s) || !check_ast(ast->edges[1], s, vis_s, err_s))
             return 0;
-        vis_s->state = _ogstate;
+        vis_s->loop = _ogloop;
 
         return 1;
     }
@@ -1522,8 +1881,14 @@ int check_ast(struct ast *ast, struct scope *s, struct visitor_scope *vis_s, str
         if (ast->size != 2)
             return throw_err(ast, err_s, "_opeq should have 2 edges!");
 
+        if (ast->edges[0]->type == _index)
+            return check_ast(ast->edges[0], s, vis_s, err_s) && check_ast(ast->edges[1], s, vis_s, err_s);
         if (ast->edges[0]->type != _var)
-            return throw_err(ast, err_s, "_opeq edge[0] should be of type _var!");
+            return throw_err(ast, err_s, "_opeq edge[0] should be of type _var or _index!");
+
+        // the value is checked before the variable is defined, u = 5 + u reads no u
+        if (!check_ast(ast->edges[1], s, vis_s, err_s))
+            return 0;
 
         int _ogstate = vis_s->state;
         vis_s->state = _invardef;
@@ -1531,8 +1896,11 @@ int check_ast(struct ast *ast, struct scope *s, struct visitor_scope *vis_s, str
             return 0;
         vis_s->state = _ogstate;
 
-        if (!check_ast(ast->edges[1], s, vis_s, err_s))
-            return 0;
+        // x = x + e : e is evaluated first, then added to x where it is stored
+        struct ast *rhs = ast->edges[1];
+        if (rhs->type == _opmath && rhs->size == 2 && rhs->val.strval[0] == '+' && rhs->edges[0]->type == _var &&
+            !strcmp(rhs->edges[0]->val.strval, ast->edges[0]->val.strval) && !has_call(rhs->edges[1]))
+            ast->val.strval = "+=";
 
         return 1;
     }
@@ -1561,22 +1929,79 @@ int check_ast(struct ast *ast, struct scope *s, struct visitor_scope *vis_s, str
     return 0;
 }
 
-int my_calc(struct parser *p, struct ast *ast, struct error_scope *err_s)
+// Line of every node, from the offsets of the lines of text
+static void number_lines(struct ast *ast, const int *starts, int nlines)
 {
-    int ret = 0;
+    int lo = 0;
+    int hi = nlines - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (starts[mid] <= ast->begin)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    ast->line = lo + 1;
+
+    for (int i = 0; i < ast->size; i++)
+        number_lines(ast->edges[i], starts, nlines);
+}
+
+// Passes after check_ast : source lines and loop optimizations, whole when no
+// other AST defines funks
+static void annotate(struct ast *ast, const char *text, int whole)
+{
+    int nlines;
+    int *starts = line_starts(text, &nlines);
+    number_lines(ast, starts, nlines);
+    free(starts);
+    optimize_loops(ast, whole);
+}
+
+// readlang, with an error at the expression or block the stack could not hold
+static int read_program(struct parser *p, struct ast *ast, struct error_scope *err_s)
+{
+    if (readlang(p, ast))
+        return 1;
+
+    if (p->deep)
+    {
+        while (p->content[p->deep_pos] && strchr(" \t\r\n", p->content[p->deep_pos]))
+            p->deep_pos++;
+        err_s->begin = p->deep_pos;
+        err_s->end = p->deep_pos + 1;
+        err_s->err = "expression or block nested too deeply for the stack!";
+    }
+
+    return 0;
+}
+
+int my_calc(struct parser *p, struct ast *ast, struct error_scope *err_s)
+{
+    int ret = 0;
     struct scope s;
-    s.defs = 0;
+    init_scope(&s);
     err_s->begin = -1;
+    // the parser and check_ast stop where the stack runs out
+    callstack_start();
+
+    stats_begin(PHASE_READLANG);
+    ret = read_program(p, ast, err_s);
+    stats_end(PHASE_READLANG);
 
-    ret = readlang(p, ast);
+    stats_begin(PHASE_CHECK);
     if (ret != 0)
     {
         register_builtins(&s);
-        struct visitor_scope vs;
-        vs.state = 0;
+        struct visitor_scope vs = {0};
         ret = check_ast(ast, &s, &vs, err_s);
     }
 
+    if (ret != 0)
+        annotate(ast, p->content, 1);
+    stats_end(PHASE_CHECK);
+
     clean_scope(&s);
 
     return ret;
@@ -1584,87 +2009,296 @@ int my_calc(struct parser *p, struct ast *ast, struct error_scope *err_s)
 
 int check_cond(long a, long b, char *opc)
 {
-    if (!strcmp(opc, "=="))
+    switch (opc[0])
     {
-        if (a == b)
-            return 1;
+    case '=':
+        return a == b;
+    case '!':
+        return a != b;
+    case '<':
+        return opc[1] ? a <= b : a < b;
+    case '>':
+        return opc[1] ? a >= b : a > b;
     }
-    else if (!strcmp(opc, "!="))
+
+    return 0;
+}
+
+int recursive_eval(struct ast *ast, struct scope *s);
+
+// Iterations left when entering the counted loop li, its bound evaluated once
+static int counted_trips(struct loop_info *li, struct scope *s, long *trips)
+{
+    struct def_entry *ind = getdef_ast(s, li->ind);
+    if (!ind || ind->type != _int)
+        return 0;
+
+    value i = ind->val.intval;
+    if (!val_is_small(i) || !recursive_eval(li->bound, s) || !val_is_small(s->current_val))
+        return 0;
+
+    return loop_trips(li, val_untag(i), val_untag(s->current_val), trips);
+}
+
+static int eval_cond(struct ast *ast, struct scope *s, int *truth);
+
+// Binary _opcomp or _oplogic : comparisons feed truth directly and && / || stop
+// at their left operand when it decides, current value is still 0 or 1
+static int eval_test(struct ast *ast, struct scope *s, int *truth)
+{
+    int ret;
+
+    if (ast->type == _oplogic)
     {
-        if (a != b)
-            return 1;
+        int and = ast->val.strval[0] == '&';
+
+        ret = eval_cond(ast->edges[0], s, truth);
+        if (ret == EVAL_OK && *truth == and)
+            ret = eval_cond(ast->edges[1], s, truth);
+
+        val_assign(&s->current_val, VAL_SMALL(*truth));
+        return ret;
     }
-    else if (!strcmp(opc, "<="))
+
+    // an operand the budget stopped stops the test, its value may not compare
+    ret = recursive_eval(ast->edges[0], s);
+    if (ret == EVAL_STOP)
+        return ret;
+    value l = val_take(&s->current_val);
+    ret = recursive_eval(ast->edges[1], s);
+    if (ret == EVAL_STOP)
     {
-        if (a <= b)
-            return 1;
+        val_drop(l);
+        return ret;
     }
-    else if (!strcmp(opc, "<"))
+    value r = val_take(&s->current_val);
+
+    *truth = check_cond(val_cmp(l, r), 0, ast->val.strval);
+    val_drop(l);
+    val_drop(r);
+    s->current_val = VAL_SMALL(*truth);
+    return ret;
+}
+
+// The budget is spent or a runtime error happened : the run unwinds from ast
+static int stop_at(struct ast *ast, struct scope *s)
+{
+    fuel_stop(ast, s->current_val);
+    return EVAL_STOP;
+}
+
+// Evaluate a condition of if, elif, while, && or || into truth
+static int eval_cond(struct ast *ast, struct scope *s, int *truth)
+{
+    if (__builtin_expect(callstack_low(), 0))
     {
-        if (a < b)
-            return 1;
+        callstack_nested(ast);
+        *truth = 0;
+        return stop_at(ast, s);
     }
-    else if (!strcmp(opc, ">="))
+
+    if (!ast->cache && ast->size == 2 && (ast->type == _opcomp || ast->type == _oplogic))
+        return eval_test(ast, s, truth);
+
+    if (ast->type == _opuna && ast->size == 1 && ast->val.strval[0] == '!')
     {
-        if (a >= b)
-            return 1;
+        int ret = eval_cond(ast->edges[0], s, truth);
+        *truth = !*truth;
+        val_assign(&s->current_val, VAL_SMALL(*truth));
+        return ret;
     }
-    else if (!strcmp(opc, ">"))
+
+    int ret = recursive_eval(ast, s);
+    *truth = s->current_val != 0;
+    return ret;
+}
+
+static int eval_node(struct ast *ast, struct scope *s);
+
+// reduce(f, lo, hi, op), f resolved like a call to it
+static int eval_reduce(struct ast *ast, struct scope *s)
+{
+    struct def_entry *f = getdef_ast(s, ast->edges[0]);
+    if (!f || f->type != _func || f->builtin)
+        return 0;
+
+    value args[3];
+    for (int i = 0; i < 3; i++)
     {
-        if (a > b)
-            return 1;
+        recursive_eval(ast->edges[i + 1], s);
+        args[i] = val_take(&s->current_val);
     }
 
-    return 0;
+    // checked again against the names defined now : one the funk assigns may have been
+    // created since the check, the workers would then write their own copies of it
+    struct funk_set seen = {0};
+    int pure = pure_funk(f->val.astptr, s, &seen);
+    free(seen.funks);
+    if (!pure)
+    {
+        char msg[160];
+        snprintf(msg, sizeof(msg), "reduce is given %.80s, which prints or assigns a variable of its caller", ast->edges[0]->val.strval);
+        val_fail(msg);
+    }
+
+    int ret = pure ? reduce_range(s, f, args[0], args[1], args[2]) : stop_at(ast, s);
+
+    for (int i = 0; i < 3; i++)
+        val_drop(args[i]);
+    // a runtime error or the budget stopped the range
+    return ret || !fuel.out ? ret : stop_at(ast, s);
 }
 
-int recursive_eval(struct ast *ast, struct scope *s, struct control_scope *ctrl_s)
+int recursive_eval(struct ast *ast, struct scope *s)
+{
+    if (__builtin_expect(profiling, 0) && ast)
+    {
+        struct prof_mark m;
+        profile_enter_node(ast, &m);
+        int ret = eval_node(ast, s);
+        profile_leave_node(&m);
+        return ret;
+    }
+
+    if (__builtin_expect(sampling, 0))
+    {
+        struct ast *outer = sample_enter(ast);
+        int ret = eval_node(ast, s);
+        sample_leave(outer);
+        return ret;
+    }
+
+    return eval_node(ast, s);
+}
+
+// The call from ast cannot be made : it resolves to no funk (an arg of a caller
+// may shadow it, a call in a return may go to one never defined), or func takes
+// another number of args (a call in a return to a funk defined after it). Out
+// of eval_node, whose frame every call holds.
+static __attribute__((noinline)) int bad_call(struct ast *ast, struct scope *s, struct ast *func)
+{
+    char msg[128];
+
+    if (func)
+        snprintf(msg, sizeof(msg), "%.80s takes %d args, not %d", ast->val.strval, func->edges[0]->size, ast->size);
+    else if (getdef_ast(s, ast))
+        snprintf(msg, sizeof(msg), "%.80s is not a funk here, a variable hides it", ast->val.strval);
+    else
+        snprintf(msg, sizeof(msg), "%.80s is not defined", ast->val.strval);
+
+    val_fail(msg);
+    return stop_at(ast, s);
+}
+
+int call_funk(struct ast *func, struct scope *s, value *args)
+{
+    if (!fuel_charge())
+        return stop_at(func, s);
+
+    int jit = jit_try_call(func, s, args, s->epoch, &s->current_val);
+    if (jit)
+        return jit > 0 ? EVAL_OK : EVAL_STOP;
+
+    // the body runs in the scope of the caller : what it defines is removed
+    // and the variables its args shadow are restored when it returns
+    struct def_journal frame = {0};
+    journal_begin(s, &frame, 0);
+
+    for (int i = 0; i < func->edges[0]->size; i++)
+    {
+        struct ast *arg_ast = func->edges[0]->edges[i];
+        union Definition val;
+        val.intval = val_take(&args[i]);
+        journal_def(s, arg_ast->val.strval, ast_hash(arg_ast));
+        create_or_reuse_dl(arg_ast, s, val, _int);
+    }
+
+    int ret = EVAL_OK;
+    val_assign(&s->current_val, 0);
+    for (int i = 0; i < func->edges[1]->size && ret == EVAL_OK; i++)
+        ret = recursive_eval(func->edges[1]->edges[i], s);
+
+    // a name may start resolving to another funk
+    if (journal_end(s, 1))
+        s->epoch = new_epoch();
+    free_journal(&frame);
+
+    return ret == EVAL_RETURN ? EVAL_OK : ret;
+}
+
+static int eval_node(struct ast *ast, struct scope *s)
 {
     if (ast == NULL)
         return 0;
 
     if (!ast->size && ast->type == _const)
     {
-        s->current_val = ast->val.intval;
+        val_assign(&s->current_val, val_ref(ast->val.intval));
         return 1;
     }
 
     if (!ast->size && ast->type == _var)
     {
-        struct def_list *ptr;
+        struct def_entry *ptr;
 
-        if ((ptr = getdef(s, ast->val.strval)))
+        if ((ptr = getdef_ast(s, ast)))
         {
-            s->current_val = ptr->val.intval;
+            // a funk read as a variable is 0
+            val_assign(&s->current_val, ptr->type == _int ? val_ref(ptr->val.intval) : 0);
             return 1;
         }
 
         return 0;
     }
 
-    if (ast->type == _opcontrol)
+    // the nodes under this one may need more stack than is left
+    if (__builtin_expect(callstack_low(), 0))
     {
-        if (!strcmp(ast->val.strval, "break"))
-        {
-            ctrl_s->breakcnt += 1;
-            return 1;
-        }
+        callstack_nested(ast);
+        return stop_at(ast, s);
+    }
 
-        if (!strcmp(ast->val.strval, "continue"))
-        {
-            ctrl_s->continuecnt += 1;
-            return 1;
-        }
+    if (ast->type == _index)
+    {
+        struct def_entry *ptr;
+
+        // the index may call a funk that assigns the array
+        if (!recursive_eval(ast->edges[0], s) || !(ptr = getdef_ast(s, ast)))
+            return 0;
 
-        if (!strcmp(ast->val.strval, "return"))
+        value i = val_take(&s->current_val);
+        s->current_val = array_get(ptr->type == _int ? ptr->val.intval : 0, i);
+        val_drop(i);
+        return 1;
+    }
+
+    if (ast->type == _array)
+    {
+        value *elems = mem_calloc(MEM_ARGS, ast->size + 1, sizeof(value));
+        for (int i = 0; i < ast->size; i++)
         {
-            int ret = 0;
+            recursive_eval(ast->edges[i], s);
+            elems[i] = val_take(&s->current_val);
+        }
 
-            ctrl_s->returncnt += 1;
+        val_assign(&s->current_val, array_from(elems, ast->size));
 
-            ret = recursive_eval(ast->edges[0], s, ctrl_s);
+        for (int i = 0; i < ast->size; i++)
+            val_drop(elems[i]);
+        mem_free(MEM_ARGS, elems);
+        return 1;
+    }
 
-            return ret;
+    if (ast->type == _opcontrol)
+    {
+        switch (ast->val.strval[0])
+        {
+        case 'b':
+            return EVAL_BREAK;
+        case 'c':
+            return EVAL_CONTINUE;
+        case 'r':
+            return recursive_eval(ast->edges[0], s) ? EVAL_RETURN : EVAL_FAIL;
         }
     }
 
@@ -1672,107 +2306,92 @@ int recursive_eval(struct ast *ast, struct scope *s, struct control_scope *ctrl_
     {
         union Definition val;
         val.astptr = ast;
-        return create_or_reuse_dl(ast, s, val);
+        return create_or_reuse_dl(ast, s, val, _func);
     }
     else if (ast->type == _funccall)
     {
         int ret = 0;
-        struct def_list *ptr;
+        struct call_target *target = &ast->target;
+        value cached;
+
+        // a pure builtin call hoisted out of a loop
+        if (ast->cache && loop_cached(ast->cache, &cached))
+        {
+            val_assign(&s->current_val, cached);
+            return 1;
+        }
+
+        if (target->epoch != s->epoch)
+        {
+            struct def_entry *ptr;
+            if (!(ptr = getdef_ast(s, ast)) || ptr->type != _func)
+                return bad_call(ast, s, NULL);
+
+            target->builtin = ptr->builtin;
+            target->func = ptr->builtin ? NULL : ptr->val.astptr;
+            target->epoch = s->epoch;
+        }
+
+        if (target->builtin && target->builtin->funk)
+            return eval_reduce(ast, s);
 
-        if ((ptr = getdef(s, ast->val.strval)))
         {
             int i;
-            int *args_res = calloc(0, sizeof(int));
+            // a builtin gets 0 for the args left out
+            int extra = target->builtin ? target->builtin->optional : 0;
+            value *args_res = mem_calloc(MEM_ARGS, ast->size + 1 + extra, sizeof(value));
             for (i = 0; i < ast->size; i++)
             {
-                args_res = (int *)realloc(args_res, sizeof(int) * (i + 1));
-                recursive_eval(ast->edges[i], s, ctrl_s);
-                args_res[i] = s->current_val;
+                recursive_eval(ast->edges[i], s);
+                args_res[i] = val_ref(s->current_val);
             }
 
-            if (ptr->builtin)
+            if (__builtin_expect(stats_enabled, 0))
+                stats_count_call(ast->val.strval, ast_hash(ast));
+
+            if (__builtin_expect(profiling, 0))
+                profile_enter_funk(ast->val.strval, ast_hash(ast));
+
+            if (__builtin_expect(sampling, 0))
+                sample_push(ast);
+
+            if (target->builtin)
             {
-                if (!strcmp(ptr->name, "println") && ast->size == 1)
-                {
-                    ret = _println(args_res[0]);
-                }
-                else if (!strcmp(ptr->name, "print") && ast->size == 1)
-                {
-                    ret = _print(args_res[0]);
-                }
-                else if (!strcmp(ptr->name, "donut"))
-                {
-                    ret = _donut();
-                }
+                if (!fuel_charge())
+                    ret = stop_at(ast, s);
+                else if (ast->size <= target->builtin->arity && ast->size >= target->builtin->arity - target->builtin->optional)
+                    ret = target->builtin->fn(s, args_res) ? EVAL_OK : EVAL_FAIL;
+                // donut() charges its frames, a failed builtin has stopped the run
+                if (ret != EVAL_STOP && __builtin_expect(fuel.out, 0))
+                    ret = stop_at(ast, s);
+                if (ret == EVAL_OK && ast->cache)
+                    loop_store(ast->cache, s->current_val);
             }
             else
             {
-                struct ast *func_ast = ptr->val.astptr;
+                struct ast *func_ast = target->func;
 
-                if (func_ast->size > 1)
+                if (func_ast->size > 1 && func_ast->edges[0]->size == ast->size)
                 {
-                    if (func_ast->edges[0]->size == ast->size)
-                    {
-
-                        struct scope *func_scope = duplicate_scope(s);
-
-                        for (i = 0; i < func_ast->edges[0]->size; i++)
-                        {
-                            union Definition val;
-                            val.intval = args_res[i];
-                            create_or_reuse_dl(func_ast->edges[0]->edges[i], func_scope, val);
-                        }
-
-                        int i;
-                        for (i = 0; i < func_ast->edges[1]->size; i++)
-                        {
-                            ret = recursive_eval(func_ast->edges[1]->edges[i], func_scope, ctrl_s);
-                            if (!ret)
-                                break;
-
-                            if (ctrl_s->returncnt)
-                            {
-                                ctrl_s->returncnt -= 1;
-                            }
-                        }
-
-                        struct def_list *ptr = func_scope->defs;
-                        if (ptr != NULL)
-                        {
-                            while (ptr)
-                            {
-                                struct def_list *tmp = ptr->next;
-
-                                int arg = 0;
-                                for (i = 0; i < func_ast->edges[0]->size; i++)
-                                {
-                                    if (!strcmp(func_ast->edges[0]->edges[i]->val.strval, ptr->name))
-                                    {
-                                        arg = 1;
-                                    }
-                                }
-
-                                if (!arg)
-                                {
-                                    struct def_list *og;
-                                    if ((og = getdef(s, ptr->name)))
-                                    {
-                                        og->val = ptr->val;
-                                    }
-                                }
-
-                                ptr = tmp;
-                            }
-                        }
-
-                        s->current_val = func_scope->current_val;
-                        clean_scope(func_scope);
-                        free(func_scope);
-                    }
+                    callstack_push(ast);
+                    ret = call_funk(func_ast, s, args_res);
+                    callstack_pop();
+                }
+                else
+                {
+                    ret = bad_call(ast, s, func_ast);
                 }
             }
 
-            free(args_res);
+            if (__builtin_expect(profiling, 0))
+                profile_leave_funk();
+
+            if (__builtin_expect(sampling, 0))
+                sample_pop();
+
+            for (i = 0; i < ast->size; i++)
+                val_drop(args_res[i]);
+            mem_free(MEM_ARGS, args_res);
         }
 
         return ret;
@@ -1787,28 +2406,29 @@ int recursive_eval(struct ast *ast, struct scope *s, struct control_scope *ctrl_
             int i;
             for (i = 0; i < ast->size; i++)
             {
-                ret = recursive_eval(ast->edges[i], s, ctrl_s);
-                if (ret == 1)
-                    break;
+                ret = recursive_eval(ast->edges[i], s);
+                if (ret)
+                    return ret;
             }
 
-            return 1;
+            return EVAL_OK;
         }
         else if ((!strcmp(ast->val.strval, "if") || !strcmp(ast->val.strval, "elif")) && ast->size > 1)
         {
-            int ret = 0;
-
-            recursive_eval(ast->edges[0], s, ctrl_s);
-            if (s->current_val)
+            // 0 when the branch is not taken, so ifelse stops at the first taken one
+            int truth;
+            eval_cond(ast->edges[0], s, &truth);
+            if (truth)
             {
-                ret = recursive_eval(ast->edges[1], s, ctrl_s);
+                int ret = recursive_eval(ast->edges[1], s);
+                return ret > EVAL_OK ? ret : EVAL_OK;
             }
 
-            return ret;
+            return 0;
         }
         else if (!strcmp(ast->val.strval, "else") && ast->size > 0)
         {
-            return recursive_eval(ast->edges[0], s, ctrl_s);
+            return recursive_eval(ast->edges[0], s);
         }
     }
 
@@ -1816,39 +2436,58 @@ int recursive_eval(struct ast *ast, struct scope *s, struct control_scope *ctrl_
     {
         if (!strcmp(ast->val.strval, "while") && ast->size > 1)
         {
-            int ret = 0;
+            int ret = 1;
+            long trips;
+            struct loop_info *li = ast->loop;
+            unsigned long saved = loop_enter(li);
 
-            recursive_eval(ast->edges[0], s, ctrl_s);
-            if (s->current_val)
+            if (li && li->ind && counted_trips(li, s, &trips))
             {
-                for (int i = 0; i < ast->edges[1]->size; i++)
+                // the condition holds exactly trips times, only the body has to run
+                struct ast *body = ast->edges[1];
+                for (long n = 0; n < trips && ret == EVAL_OK; n++)
                 {
-                    ret = recursive_eval(ast->edges[1]->edges[i], s, ctrl_s);
+                    for (int i = 0; i < body->size && ret == EVAL_OK; i++)
+                        ret = recursive_eval(body->edges[i], s);
+                    // the back-edge, like the loop below
+                    if (ret == EVAL_OK && !fuel_charge())
+                        ret = stop_at(ast, s);
+                }
 
-                    if (ret == 0)
-                        break;
+                if (ret == EVAL_OK)
+                    val_assign(&s->current_val, 0);
 
-                    if (ctrl_s->breakcnt)
-                    {
-                        ctrl_s->breakcnt -= 1;
-                        break;
-                    }
+                loop_leave(li, saved);
+                return ret;
+            }
 
-                    if (i == ast->edges[1]->size - 1 || ctrl_s->continuecnt)
-                    {
-                        if (ctrl_s->continuecnt)
-                            ctrl_s->continuecnt -= 1;
+            struct ast *body = ast->edges[1];
+            int truth;
+            eval_cond(ast->edges[0], s, &truth);
 
-                        i = -1;
+            // an empty body only evaluates the condition once
+            while (truth && body->size)
+            {
+                for (int i = 0; i < body->size; i++)
+                {
+                    ret = recursive_eval(body->edges[i], s);
+                    if (ret != EVAL_OK)
+                        break;
+                }
 
-                        recursive_eval(ast->edges[0], s, ctrl_s);
-                        if (!s->current_val)
-                            break;
-                    }
+                if (ret != EVAL_OK && ret != EVAL_CONTINUE)
+                    break;
+                if (!fuel_charge())
+                {
+                    ret = stop_at(ast, s);
+                    break;
                 }
+
+                eval_cond(ast->edges[0], s, &truth);
             }
 
-            return ret;
+            loop_leave(li, saved);
+            return ret == EVAL_BREAK || ret == EVAL_CONTINUE ? EVAL_OK : ret;
         }
     }
 
@@ -1856,10 +2495,9 @@ int recursive_eval(struct ast *ast, struct scope *s, struct control_scope *ctrl_
     {
         int ret;
 
-        ret = recursive_eval(ast->edges[0], s, ctrl_s);
-        int c = s->current_val;
+        ret = recursive_eval(ast->edges[0], s);
 
-        if (ret == 0)
+        if (ret == 0 || ret == EVAL_STOP)
             return ret;
 
         switch (ast->val.strval[0])
@@ -1867,36 +2505,70 @@ int recursive_eval(struct ast *ast, struct scope *s, struct control_scope *ctrl_
         case '+':
             return 1;
         case '-':
-            s->current_val = c * -1;
+            s->current_val = val_neg(s->current_val);
             return 1;
         case '!':
-            if (c == 0)
-            {
-                s->current_val = 1;
-            }
-            else
-            {
-                s->current_val = 0;
-            }
+            s->current_val = val_not(s->current_val);
             return 1;
         }
 
         return ret;
     }
 
+    if (ast->type == _opeq && ast->edges[0]->type == _index)
+    {
+        struct ast *elem = ast->edges[0];
+        struct def_entry *ptr;
+
+        if (!recursive_eval(elem->edges[0], s))
+            return 0;
+        value i = val_take(&s->current_val);
+
+        if (!recursive_eval(ast->edges[1], s) || !(ptr = getdef_ast(s, elem)))
+        {
+            val_drop(i);
+            return 0;
+        }
+
+        // a funk is not an array, array_set says so
+        array_set(ptr->type == _int ? &ptr->val.intval : &(value){0}, i, s->current_val);
+        val_drop(i);
+        return 1;
+    }
+
+    // x = x + e : a string is appended to in place while x holds its only reference
+    if (ast->type == _opeq && ast->val.strval[0] == '+')
+    {
+        struct def_entry *ptr = getdef_ast(s, ast->edges[0]);
+
+        if (ptr && ptr->type == _int)
+        {
+            if (!recursive_eval(ast->edges[1]->edges[1], s))
+                return 0;
+            value r = val_take(&s->current_val);
+
+            // records the old value when the scope keeps a journal
+            ptr = putdef(s, ast->edges[0]->val.strval, ast_hash(ast->edges[0]));
+            ptr->val.intval = val_add(ptr->val.intval, r);
+            s->current_val = val_ref(ptr->val.intval);
+            if (__builtin_expect(fuel.out, 0))
+                return stop_at(ast->edges[1], s);
+            return 1;
+        }
+    }
+
     if (ast->type == _opeq)
     {
         int ret;
 
-        ret = recursive_eval(ast->edges[1], s, ctrl_s);
-        int r = s->current_val;
+        ret = recursive_eval(ast->edges[1], s);
 
         if (!ret)
             return 0;
 
         union Definition val;
-        val.intval = r;
-        ret = create_or_reuse_dl(ast->edges[0], s, val);
+        val.intval = val_ref(s->current_val);
+        ret = create_or_reuse_dl(ast->edges[0], s, val, _int);
 
         return ret;
     }
@@ -1904,92 +2576,277 @@ int recursive_eval(struct ast *ast, struct scope *s, struct control_scope *ctrl_
     if (ast->type == _oplogic || ast->type == _opcomp || ast->type == _opmath)
     {
         int ret;
+        value cached;
 
-        ret = recursive_eval(ast->edges[0], s, ctrl_s);
-        int l = s->current_val;
-        ret = recursive_eval(ast->edges[1], s, ctrl_s);
-        int r = s->current_val;
-
-        if (ret == 0)
-            return ret;
+        if (ast->cache && loop_cached(ast->cache, &cached))
+        {
+            val_assign(&s->current_val, cached);
+            return 1;
+        }
 
-        if (ast->type == _oplogic)
+        if (ast->type != _opmath)
         {
-            if (!strcmp(ast->val.strval, "&&"))
-            {
-                if (l && r)
-                    s->current_val = 1;
-                else
-                    s->current_val = 0;
+            int truth;
 
-                return 1;
-            }
-            else if (!strcmp(ast->val.strval, "||"))
-            {
-                if (l || r)
-                    s->current_val = 1;
-                else
-                    s->current_val = 0;
+            ret = eval_test(ast, s, &truth);
+            if (ret && ast->cache)
+                loop_store(ast->cache, s->current_val);
 
-                return 1;
-            }
+            return ret;
         }
-        else if (ast->type == _opcomp)
+
+        // as in eval_test, a stopped operand stops the operation
+        ret = recursive_eval(ast->edges[0], s);
+        if (ret == EVAL_STOP)
+            return ret;
+        value l = val_take(&s->current_val);
+        ret = recursive_eval(ast->edges[1], s);
+        value r = val_take(&s->current_val);
+
+        if (ret == 0 || ret == EVAL_STOP)
         {
-            s->current_val = check_cond(l, r, ast->val.strval);
-            return 1;
+            val_drop(l);
+            val_drop(r);
+            return ret;
         }
-        else if (ast->type == _opmath)
+
+        switch (ast->val.strval[0])
         {
-            switch (ast->val.strval[0])
-            {
-            case '+':
-                s->current_val = l + r;
-                return 1;
-            case '-':
-                s->current_val = l - r;
-                return 1;
-            case '*':
-                s->current_val = l * r;
-                return 1;
-            case '/':
-                s->current_val = l / r;
-                return 1;
-            case '%':
-                s->current_val = l % r;
-                return 1;
-            case '^':
-                s->current_val = (int)pow(l, r);
-                return 1;
-            default:
-                return 0;
-            }
+        case '+':
+            s->current_val = val_add(l, r);
+            break;
+        case '-':
+            s->current_val = val_sub(l, r);
+            break;
+        case '*':
+            s->current_val = ast->cache ? loop_mul(ast->cache, l, r) : val_mul(l, r);
+            break;
+        case '/':
+            s->current_val = val_div(l, r);
+            break;
+        case '%':
+            s->current_val = val_mod(l, r);
+            break;
+        case '^':
+            s->current_val = ast->cache ? loop_pow(ast->cache, l, r) : val_pow(l, r);
+            break;
+        default:
+            val_drop(l);
+            val_drop(r);
+            return 0;
         }
+
+        // the operands were long enough to spend the budget
+        if (__builtin_expect(fuel.out, 0))
+            return stop_at(ast, s);
+
+        if (ret && ast->cache)
+            loop_store(ast->cache, s->current_val);
+
+        return ret;
     }
 
     int ret = 0;
     if (ast->type == _compound)
     {
+        ret = 1;
+
         int i;
         for (i = 0; i < ast->size; i++)
         {
-            ret = recursive_eval(ast->edges[i], s, ctrl_s);
+            ret = recursive_eval(ast->edges[i], s);
+            if (ret > EVAL_OK)
+                break;
         }
     }
 
     return ret;
 }
 
-int eval(struct ast *a, struct scope *s)
+int eval(struct ast *a, struct scope *s, FILE *out)
 {
-    struct control_scope cs;
-    cs.breakcnt = 0;
-    cs.returncnt = 0;
-    cs.continuecnt = 0;
-
-    s->defs = 0;
+    stats_begin(PHASE_EVAL);
+    init_scope(s);
+    out_open(&s->out, out);
     register_builtins(s);
-    recursive_eval(a, s, &cs);
+    fuel_start();
+    callstack_start();
+    recursive_eval(a, s);
+    callstack_end();
+    clean_scope(s);
+    stats_end(PHASE_EVAL);
+    return 1;
+}
+
+void session_init(struct session *ss)
+{
+    init_scope(&ss->check);
+    register_builtins(&ss->check);
+    init_scope(&ss->run);
+    register_builtins(&ss->run);
+    ss->journal = (struct def_journal){0};
+    ss->chunks = NULL;
+    ss->size = 0;
+    ss->saved = NULL;
+    ss->nsaved = 0;
+    ss->open = 1;
+    callstack_start();
+}
+
+// session_load with the changes of the chunk to the check scope still journaled,
+// the caller ends the journal
+static int load_chunk(struct session *ss, struct parser *p, struct error_scope *err_s)
+{
+    struct ast *ast = mem_calloc(MEM_AST, 1, sizeof(struct ast));
+    err_s->begin = -1;
+
+    // a chunk with an error defines nothing, its changes to the check scope are undone
+    struct visitor_scope vs = {0};
+    journal_begin(&ss->check, &ss->journal, 1);
+    int ok = read_program(p, ast, err_s) && check_ast(ast, &ss->check, &vs, err_s);
+
+    if (!ok)
+    {
+        journal_end(&ss->check, 1);
+        clean_ast(ast);
+        mem_free(MEM_AST, ast);
+        return 0;
+    }
+
+    // definitions borrow their names from the chunk, it lives as long as the session
+    ss->chunks = mem_reallocarray(MEM_EDGES, ss->chunks, ss->size + 1, sizeof(struct ast *));
+    ss->chunks[ss->size++] = ast;
+
+    annotate(ast, p->content, !ss->open);
+
+    return 1;
+}
+
+int session_load(struct session *ss, struct parser *p, struct error_scope *err_s)
+{
+    if (!load_chunk(ss, p, err_s))
+        return 0;
+
+    journal_end(&ss->check, 0);
+    return 1;
+}
+
+// The definitions of s into *defs, their ints referenced
+static void keep_defs(struct scope *s, struct def_entry **defs, int *n)
+{
+    *defs = mem_calloc(MEM_DEFS, s->defs.count + 1, sizeof(struct def_entry));
+    *n = 0;
+
+    for (struct def_entry *e = nextdef(s, NULL); e; e = nextdef(s, e))
+    {
+        (*defs)[(*n)++] = *e;
+        if (e->type == _int)
+            val_ref(e->val.intval);
+    }
+}
+
+static void drop_defs(struct def_entry **defs, int *n)
+{
+    for (int i = 0; i < *n; i++)
+    {
+        if ((*defs)[i].type == _int)
+            val_drop((*defs)[i].val.intval);
+    }
+
+    mem_free(MEM_DEFS, *defs);
+    *defs = NULL;
+    *n = 0;
+}
+
+// s back to the definitions kept. In a new epoch, funks redefined since are back
+// to their kept definition.
+static void put_back_defs(struct scope *s, struct def_entry *defs, int n)
+{
+    FILE *out = s->out.f;
+
+    val_assign(&s->current_val, 0);
     clean_scope(s);
+    init_scope(s);
+    out_open(&s->out, out);
+
+    for (int i = 0; i < n; i++)
+    {
+        struct def_entry *e = putdef(s, defs[i].name, defs[i].hash);
+        *e = defs[i];
+        if (e->type == _int)
+            val_ref(e->val.intval);
+    }
+}
+
+int session_eval(struct session *ss, struct parser *p, struct error_scope *err_s)
+{
+    if (!load_chunk(ss, p, err_s))
+        return 0;
+
+    // a runtime error undoes the chunk : what it defined and assigned, checked or run
+    struct def_entry *before;
+    int nbefore;
+    keep_defs(&ss->run, &before, &nbefore);
+
+    fuel_start();
+    recursive_eval(ss->chunks[ss->size - 1], &ss->run);
+    out_flush(&ss->run.out);
+
+    journal_end(&ss->check, fuel.error != NULL);
+    if (fuel.error)
+    {
+        val_drop(fuel_finish());
+        put_back_defs(&ss->run, before, nbefore);
+    }
+    drop_defs(&before, &nbefore);
+
     return 1;
 }
+
+int session_run(struct session *ss)
+{
+    int ret = EVAL_OK;
+
+    FILE *out = ss->run.out.f;
+
+    // init_scope starts a new epoch, call targets of the previous run are stale
+    val_assign(&ss->run.current_val, 0);
+    clean_scope(&ss->run);
+    init_scope(&ss->run);
+    register_builtins(&ss->run);
+    out_open(&ss->run.out, out);
+
+    for (int i = 0; i < ss->size && ret == EVAL_OK; i++)
+        ret = recursive_eval(ss->chunks[i], &ss->run);
+    out_flush(&ss->run.out);
+
+    return ret == EVAL_OK;
+}
+
+void session_save(struct session *ss)
+{
+    drop_defs(&ss->saved, &ss->nsaved);
+    keep_defs(&ss->run, &ss->saved, &ss->nsaved);
+}
+
+void session_restore(struct session *ss)
+{
+    put_back_defs(&ss->run, ss->saved, ss->nsaved);
+}
+
+void session_clean(struct session *ss)
+{
+    val_drop(ss->run.current_val);
+    clean_scope(&ss->run);
+    clean_scope(&ss->check);
+    free_journal(&ss->journal);
+    drop_defs(&ss->saved, &ss->nsaved);
+    callstack_end();
+
+    for (int i = 0; i < ss->size; i++)
+    {
+        clean_ast(ss->chunks[i]);
+        mem_free(MEM_AST, ss->chunks[i]);
+    }
+    mem_free(MEM_EDGES, ss->chunks);
+}
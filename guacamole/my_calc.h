@@ -1,43 +1,23 @@
 #ifndef _MY_CALC_H
 #define _MY_CALC_H
 #include "my_parser.h"
+#include "scope.h"
 
-union Definition
-{
-    int intval;
-    struct ast *astptr;
-};
+struct jit_func;
+struct loop_info;
+struct loop_cache;
 
-typedef enum
+// How the evaluation of a node ended : break, continue and return unwind
+// straight to the loop or funk check_ast resolved them to, stop out of the
+// whole run once its budget is spent (fuel.h)
+enum eval_status
 {
-    __,
-    _int,
-    _func,
-} dltype;
-
-// Variable & Function definition list
-struct def_list
-{
-    char *name;
-    union Definition val;
-    dltype type;
-    int builtin;
-    struct def_list *next;
-};
-
-// Scope for evalutation functions and variables
-struct scope
-{
-    struct def_list *defs;
-    long int current_val;
-};
-
-// Control Scope for breaking and returning
-struct control_scope
-{
-    int breakcnt;
-    int returncnt;
-    int continuecnt;
+    EVAL_FAIL,
+    EVAL_OK,
+    EVAL_BREAK,
+    EVAL_CONTINUE,
+    EVAL_RETURN,
+    EVAL_STOP,
 };
 
 // Error Scope for when checking AST for precise errors
@@ -54,18 +34,30 @@ struct visitor_scope
     enum 
     {
         ___,
-        _infunc,
-        _inwhile,
         _invardef,
     } state;
+    // innermost loop and funk around the node, targets of break / continue and return
+    struct ast *loop;
+    struct ast *funk;
+    // in the value of a return : a call may go to a funk defined after this one
+    // (mutual recursion), it is resolved when the funk runs
+    int forward;
 };
 
 union Constant
 {
-    int intval;
+    value intval;
     char *strval;
 };
 
+// Resolved target of a _funccall, valid while epoch matches the epoch of the scope
+struct call_target
+{
+    const struct builtin *builtin;
+    struct ast *func;
+    unsigned long epoch;
+};
+
 struct ast
 {
     enum
@@ -85,16 +77,65 @@ struct ast
         _oplogic,
         _compound,
         _opcontrol,
+        _index,
+        _array,
     } type;
     union Constant val;
     int size;
     struct ast **edges;
     int begin;
     int end;
+    // source line of begin, from 1
+    int line;
+    unsigned int hash;
+    struct call_target target;
+    struct jit_func *jit;
+    struct loop_info *loop;
+    struct loop_cache *cache;
+};
+
+// Chunks of code (REPL inputs) checked and run one after the other, each one
+// against the definitions left by the previous ones
+struct session
+{
+    struct scope check;
+    struct scope run;
+    // changes of the check scope by the chunk being checked
+    struct def_journal journal;
+    struct ast **chunks;
+    int size;
+    // definitions of run kept by session_save
+    struct def_entry *saved;
+    int nsaved;
+    // more chunks may be loaded, the funks a loop calls may be defined by another one
+    int open;
 };
 
 int my_calc(struct parser *p, struct ast *a, struct error_scope *err_s);
+void session_init(struct session *ss);
+// Parse and check the text of p into a new chunk, without running it. On a parse
+// or check error, returns 0 with p and err_s set as by my_calc and defines nothing.
+int session_load(struct session *ss, struct parser *p, struct error_scope *err_s);
+// session_load, then run the chunk. The last value is in ss->run. A runtime error
+// (its message in fuel.error) undoes what the chunk defined and assigned.
+int session_eval(struct session *ss, struct parser *p, struct error_scope *err_s);
+// Run every chunk again from no definition but the builtins. Returns 0 if one fails.
+int session_run(struct session *ss);
+// Keep the definitions of ss->run, and put them back
+void session_save(struct session *ss);
+void session_restore(struct session *ss);
+void session_clean(struct session *ss);
+// Run funk func (a _funcdef) with args in s, natively once the JIT has it. The
+// args stay owned by the caller (the interpreter takes them, leaving 0) and the
+// value of the funk is in s->current_val.
+int call_funk(struct ast *func, struct scope *s, value *args);
 int clean_ast(struct ast *ast);
-int eval(struct ast *a, struct scope *s);
+// Deep copy of ast with its constants copied by val_copy, without resolved calls,
+// JIT code or loop annotations. To clean_ast and free.
+struct ast *copy_ast(struct ast *ast);
+int throw_err(struct ast *ast, struct error_scope *err_s, char *msg);
+unsigned int ast_hash(struct ast *a);
+// Run a checked AST in a new scope, print and println write to out
+int eval(struct ast *a, struct scope *s, FILE *out);
 
 #endif /* _MY_CALC_H */
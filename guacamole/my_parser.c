@@ -1,8 +1,8 @@
 #include "my_parser.h"
+#include "mem.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#include <criterion/logging.h>
 
 struct parser *new_parser(const char *content)
 {
@@ -20,10 +20,10 @@ void clean_parser(struct parser *p)
         {
             struct capture_list *tmp = ptr->next;
 
-            free(ptr);
+            mem_free(MEM_CAPTURES, ptr);
             ptr = tmp;
         }
-        free(ptr);
+        mem_free(MEM_CAPTURES, ptr);
     }
 
 
@@ -51,6 +51,22 @@ int count_lines(struct parser *p, struct position *pos)
     return i;
 }
 
+int *line_starts(const char *text, int *nlines)
+{
+    *nlines = 1;
+    for (const char *c = text; *c; c++)
+        *nlines += *c == '\n';
+
+    int *starts = calloc(*nlines, sizeof(int));
+    for (int i = 0, line = 1; text[i]; i++)
+    {
+        if (text[i] == '\n')
+            starts[line++] = i + 1;
+    }
+
+    return starts;
+}
+
 int reset_pos(struct parser *p, int tmp)
 {
     if (p->current_pos > p->last_pos)
@@ -65,8 +81,11 @@ int reset_pos(struct parser *p, int tmp)
 
 char *get_line_error(struct parser *p)
 {
-    int begin;
-    for (begin = p->last_pos; p->content[begin] != '\n' && begin > 0; begin -= 1)
+    // an error at the end of a line is on that line, not the next one
+    int begin = p->last_pos;
+    if (p->content[begin] == '\n' && begin > 0)
+        begin -= 1;
+    for (; p->content[begin] != '\n' && begin > 0; begin -= 1)
         ;
 
     if (p->content[begin] == '\n')
@@ -80,7 +99,7 @@ char *get_line_error(struct parser *p)
 
     char *res = strndup(&p->content[begin], end - begin);
 
-    for (size_t i = 0; i < strlen(res); i++)
+    for (int i = 0; i < end - begin; i++)
         if (res[i] == '\t')
             res[i] = ' ';
 
@@ -294,13 +313,18 @@ struct capture_list *captures_lookup(struct parser *p, const char *tagname)
 {
     struct capture_list *ptr = p->captures;
 
+    p->lookups += 1;
     if (ptr == NULL)
         return NULL;
 
+    p->lookup_steps += 1;
     while (strcmp(ptr->tagname, tagname))
     {
         if (ptr->next != NULL)
+        {
             ptr = ptr->next;
+            p->lookup_steps += 1;
+        }
         else
             return NULL;
     }
@@ -318,7 +342,7 @@ struct capture_list *create_or_reuse(struct parser *p, const char *tagname)
     }
     else
     {
-        struct capture_list *cl = calloc(1, sizeof(struct capture_list));
+        struct capture_list *cl = mem_calloc(MEM_CAPTURES, 1, sizeof(struct capture_list));
 
         if (p->captures == NULL)
         {
@@ -363,7 +387,7 @@ char *get_value(struct parser *p, const char *tagname)
         int begin = cl->begin;
         int end = cl->end;
 
-        char *r = calloc(1, sizeof(char) * ((end - begin) + 1));
+        char *r = mem_calloc(MEM_NAMES, 1, sizeof(char) * ((end - begin) + 1));
         memcpy(r, p->content + begin, sizeof(char) * (end - begin));
 
         return r;
@@ -23,6 +23,13 @@ struct parser
     int last_pos;
     struct capture_list *captures;
     char *err;
+    // captures_lookup calls and tag names compared, for --stats
+    long lookups;
+    long lookup_steps;
+    // the stack ran out : every rule fails from there, deep_pos is the start of
+    // the outermost expression or block that was being read
+    int deep;
+    int deep_pos;
 };
 
 // instancie et nettoie un parseur
@@ -85,4 +92,7 @@ int reset_pos(struct parser *p, int pos);
 // extrait et retourne une copie de la dernière ligne avant erreur (last_pos)
 char *get_line_error(struct parser *p);
 
+// Offset in text of the start of each of its *nlines lines, to be freed
+int *line_starts(const char *text, int *nlines);
+
 #endif /* _MY_PARSER_H */
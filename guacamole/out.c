@@ -0,0 +1,130 @@
+#include "out.h"
+#include "array.h"
+#include "str.h"
+#include "mem.h"
+#include <string.h>
+#include <unistd.h>
+
+// Holds bytes no flush wrote yet, every return to the host flushes so there is one at most
+static _Thread_local struct out *pending;
+
+void out_open(struct out *o, FILE *f)
+{
+    o->f = f;
+    o->line = 0;
+    o->len = 0;
+    o->buf = NULL;
+}
+
+void out_close(struct out *o)
+{
+    out_flush(o);
+    mem_free(MEM_OUTPUT, o->buf);
+    o->buf = NULL;
+}
+
+// Buffered bytes to the FILE
+static void drain(struct out *o)
+{
+    fwrite(o->buf, 1, o->len, o->f);
+    o->len = 0;
+}
+
+void out_flush(struct out *o)
+{
+    if (pending == o)
+        pending = NULL;
+    if (!o->buf)
+        return;
+
+    drain(o);
+    fflush(o->f);
+}
+
+void out_flush_pending(void)
+{
+    if (pending)
+        out_flush(pending);
+}
+
+// Room for n more bytes
+static void reserve(struct out *o, long n)
+{
+    pending = o;
+
+    if (!o->buf)
+    {
+        int fd = fileno(o->f);
+        o->buf = mem_malloc(MEM_OUTPUT, OUT_BUFFER);
+        o->line = fd >= 0 && isatty(fd);
+        if (!o->buf)
+            val_die("out of memory");
+    }
+
+    if (o->len + n > OUT_BUFFER)
+        drain(o);
+}
+
+void out_write(struct out *o, const char *s, long n)
+{
+    if (n > OUT_BUFFER)
+    {
+        reserve(o, OUT_BUFFER);
+        drain(o);
+        fwrite(s, 1, n, o->f);
+    }
+    else
+    {
+        reserve(o, n);
+        memcpy(o->buf + o->len, s, n);
+        o->len += n;
+    }
+
+    if (o->line && memchr(s, '\n', n))
+        out_flush(o);
+}
+
+void out_char(struct out *o, char c)
+{
+    reserve(o, 1);
+    o->buf[o->len++] = c;
+
+    if (o->line && c == '\n')
+        out_flush(o);
+}
+
+int out_value(struct out *o, value v)
+{
+    char buf[VAL_DIGITS > STR_INLINE ? VAL_DIGITS : STR_INLINE + 1];
+
+    if (val_is_small(v))
+    {
+        char *d = val_digits(buf + VAL_DIGITS, val_untag(v));
+        out_write(o, d, buf + VAL_DIGITS - d);
+        return buf + VAL_DIGITS - d;
+    }
+
+    if (val_is_str(v))
+    {
+        long n = str_len(v);
+        out_write(o, str_bytes(v, buf), n);
+        return n;
+    }
+
+    // arrays go to the FILE directly, after what the buffer holds
+    if (val_is_array(v))
+    {
+        reserve(o, 0);
+        drain(o);
+        return array_fprint(o->f, v);
+    }
+
+    // the budget may run out halfway, nothing is printed then
+    char *digits = val_str_charged(v);
+    if (!digits)
+        return 0;
+    int n = strlen(digits);
+    out_write(o, digits, n);
+    mem_free(MEM_BIGNUM, digits);
+    return n;
+}
@@ -0,0 +1,42 @@
+#ifndef _OUT_H
+#define _OUT_H
+#include "bigint.h"
+#include <stdio.h>
+
+// Buffered output of print and println
+//
+// Every interpreter prints through its own OUT_BUFFER bytes, handed to its FILE
+// in one write when they are full and flushed whenever the program gives control
+// back : at the end of a run, of a REPL input or of a library call, before
+// donut() and before a runtime error is reported. Ints are converted two digits
+// at a time, without a format string or a lock. When the FILE is a TTY every new
+// line is flushed, so output shows up as it is printed.
+
+#define OUT_BUFFER (1 << 16)
+
+struct out
+{
+    FILE *f;
+    // flush at every new line
+    int line;
+    int len;
+    // allocated on the first write
+    char *buf;
+};
+
+// o writes to f, nothing is allocated yet
+void out_open(struct out *o, FILE *f);
+// Flush and release the buffer
+void out_close(struct out *o);
+
+// Buffered bytes to the FILE, and the FILE flushed
+void out_flush(struct out *o);
+// Flush the buffer of this thread still holding bytes, on a runtime error
+void out_flush_pending(void);
+
+void out_write(struct out *o, const char *s, long n);
+void out_char(struct out *o, char c);
+// v as val_fprint would print it, returns the bytes written
+int out_value(struct out *o, value v);
+
+#endif /* _OUT_H */
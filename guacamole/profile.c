@@ -0,0 +1,328 @@
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int profiling = 0;
+
+// Counters of a funk or a line
+struct prof_stat
+{
+    const char *name;
+    unsigned int hash;
+    int line;
+    long count;
+    long self;
+    long incl;
+    long nodes;
+    // activations running, inclusive time is only added by the outermost one
+    int active;
+};
+
+// Call tree for the folded stacks, one node per distinct stack of funks
+struct prof_tree
+{
+    struct prof_stat *funk;
+    long self;
+    struct prof_tree *parent;
+    struct prof_tree *child;
+    struct prof_tree *next;
+};
+
+struct prof_frame
+{
+    struct prof_stat *stat;
+    struct prof_tree *tree;
+    long start;
+    // time spent in child frames, for a funk only in child funks
+    long child;
+    int funk;
+    // enclosing funk frame of a funk frame
+    int outer;
+};
+
+static struct
+{
+    const char *text;
+    int *starts;
+    int nlines;
+    struct prof_stat *lines;
+    struct prof_stat **funks;
+    int nfunks;
+    struct prof_stat root;
+    struct prof_tree tree;
+    struct prof_frame *frames;
+    int depth;
+    int cap;
+    // innermost funk frame
+    int funk;
+} prof;
+
+static long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static struct prof_frame *push_frame(struct prof_stat *stat, int funk)
+{
+    if (prof.depth == prof.cap)
+    {
+        prof.cap = prof.cap ? prof.cap * 2 : 64;
+        prof.frames = reallocarray(prof.frames, prof.cap, sizeof(struct prof_frame));
+    }
+
+    struct prof_frame *fr = &prof.frames[prof.depth++];
+    fr->stat = stat;
+    fr->tree = NULL;
+    fr->child = 0;
+    fr->funk = funk;
+    fr->outer = 0;
+    stat->count += 1;
+    stat->active += 1;
+    fr->start = now_ns();
+
+    return fr;
+}
+
+static void pop_frame(void)
+{
+    struct prof_frame *fr = &prof.frames[--prof.depth];
+    long elapsed = now_ns() - fr->start;
+
+    fr->stat->self += elapsed - fr->child;
+    fr->stat->active -= 1;
+    if (!fr->stat->active)
+        fr->stat->incl += elapsed;
+
+    if (!prof.depth)
+        return;
+
+    struct prof_frame *parent = &prof.frames[prof.depth - 1];
+    if (fr->funk)
+    {
+        fr->tree->self += elapsed - fr->child;
+        prof.funk = fr->outer;
+        prof.frames[prof.funk].child += elapsed;
+        if (!parent->funk)
+            parent->child += elapsed;
+    }
+    else if (!parent->funk)
+    {
+        parent->child += elapsed;
+    }
+}
+
+int profile_start(const char *text)
+{
+    prof.text = text;
+    prof.starts = line_starts(text, &prof.nlines);
+    prof.lines = calloc(prof.nlines, sizeof(struct prof_stat));
+
+    for (int i = 0; i < prof.nlines; i++)
+        prof.lines[i].line = i + 1;
+
+    prof.root.name = "(script)";
+    prof.tree.funk = &prof.root;
+    prof.funk = 0;
+    push_frame(&prof.root, 1)->tree = &prof.tree;
+    profiling = 1;
+
+    return 1;
+}
+
+void profile_stop(void)
+{
+    profiling = 0;
+    while (prof.depth)
+        pop_frame();
+}
+
+void profile_enter_node(struct ast *ast, struct prof_mark *m)
+{
+    struct prof_frame *top = &prof.frames[prof.depth - 1];
+    int line = ast->line;
+
+    // a compound only groups statements, each of them enters its own line
+    m->pushed = 0;
+    if (ast->type != _compound && line >= 1 && line <= prof.nlines && (top->funk || top->stat->line != line))
+    {
+        top = push_frame(&prof.lines[line - 1], 0);
+        m->pushed = 1;
+    }
+
+    if (!top->funk)
+        top->stat->nodes += 1;
+    prof.frames[prof.funk].stat->nodes += 1;
+}
+
+void profile_leave_node(struct prof_mark *m)
+{
+    if (m->pushed)
+        pop_frame();
+}
+
+static struct prof_stat *funk_stat(const char *name, unsigned int hash)
+{
+    for (int i = 0; i < prof.nfunks; i++)
+    {
+        if (prof.funks[i]->hash == hash && !strcmp(prof.funks[i]->name, name))
+            return prof.funks[i];
+    }
+
+    struct prof_stat *stat = calloc(1, sizeof(struct prof_stat));
+    stat->name = name;
+    stat->hash = hash;
+    prof.funks = reallocarray(prof.funks, prof.nfunks + 1, sizeof(struct prof_stat *));
+    prof.funks[prof.nfunks++] = stat;
+
+    return stat;
+}
+
+void profile_enter_funk(const char *name, unsigned int hash)
+{
+    struct prof_stat *stat = funk_stat(name, hash);
+    struct prof_tree *caller = prof.frames[prof.funk].tree;
+    struct prof_tree *node;
+
+    for (node = caller->child; node && node->funk != stat; node = node->next)
+        ;
+
+    if (!node)
+    {
+        node = calloc(1, sizeof(struct prof_tree));
+        node->funk = stat;
+        node->parent = caller;
+        node->next = caller->child;
+        caller->child = node;
+    }
+
+    int outer = prof.funk;
+    struct prof_frame *fr = push_frame(stat, 1);
+    fr->tree = node;
+    fr->outer = outer;
+    prof.funk = prof.depth - 1;
+}
+
+void profile_leave_funk(void)
+{
+    pop_frame();
+}
+
+static int by_self(const void *a, const void *b)
+{
+    const struct prof_stat *x = *(struct prof_stat **)a;
+    const struct prof_stat *y = *(struct prof_stat **)b;
+
+    if (x->self != y->self)
+        return x->self < y->self ? 1 : -1;
+
+    return x->line - y->line;
+}
+
+// Source of line, without its indentation and at most width chars
+static void print_source(FILE *f, int line, int width)
+{
+    const char *c = prof.text + prof.starts[line - 1];
+    while (*c == ' ' || *c == '\t')
+        c++;
+
+    int n = strcspn(c, "\n");
+    fprintf(f, "%.*s%s\n", n > width ? width - 3 : n, c, n > width ? "..." : "");
+}
+
+void profile_report(FILE *f)
+{
+    long total = prof.root.incl;
+    long nodes = prof.root.nodes;
+    for (int i = 0; i < prof.nfunks; i++)
+        nodes += prof.funks[i]->nodes;
+
+    fprintf(f, "\nProfile : %.3f ms, %ld nodes evaluated\n", total / 1e6, nodes);
+
+    struct prof_stat **rows = calloc(prof.nfunks + prof.nlines + 1, sizeof(struct prof_stat *));
+    int n = 0;
+    rows[n++] = &prof.root;
+    for (int i = 0; i < prof.nfunks; i++)
+        rows[n++] = prof.funks[i];
+    qsort(rows, n, sizeof(struct prof_stat *), by_self);
+
+    fprintf(f, "\n%10s %10s %6s %12s %12s  %s\n", "self ms", "incl ms", "%", "calls", "nodes", "funk");
+    for (int i = 0; i < n; i++)
+    {
+        fprintf(f, "%10.3f %10.3f %6.1f %12ld %12ld  %s\n", rows[i]->self / 1e6, rows[i]->incl / 1e6,
+                total ? 100.0 * rows[i]->self / total : 0, rows[i]->count, rows[i]->nodes, rows[i]->name);
+    }
+
+    n = 0;
+    for (int i = 0; i < prof.nlines; i++)
+    {
+        if (prof.lines[i].count)
+            rows[n++] = &prof.lines[i];
+    }
+    qsort(rows, n, sizeof(struct prof_stat *), by_self);
+
+    fprintf(f, "\n%10s %10s %6s %12s %12s  %s\n", "self ms", "incl ms", "%", "runs", "nodes", "line");
+    for (int i = 0; i < n; i++)
+    {
+        fprintf(f, "%10.3f %10.3f %6.1f %12ld %12ld  %5d: ", rows[i]->self / 1e6, rows[i]->incl / 1e6,
+                total ? 100.0 * rows[i]->self / total : 0, rows[i]->count, rows[i]->nodes, rows[i]->line);
+        print_source(f, rows[i]->line, 48);
+    }
+
+    free(rows);
+}
+
+static void print_stack(FILE *f, struct prof_tree *node)
+{
+    if (node->parent)
+    {
+        print_stack(f, node->parent);
+        fputc(';', f);
+    }
+
+    fputs(node->funk->name, f);
+}
+
+static void fold(FILE *f, struct prof_tree *node)
+{
+    // flamegraph weights are integers, in microseconds here
+    if (node->self >= 1000)
+    {
+        print_stack(f, node);
+        fprintf(f, " %ld\n", node->self / 1000);
+    }
+
+    for (struct prof_tree *c = node->child; c; c = c->next)
+        fold(f, c);
+}
+
+int profile_folded(FILE *f)
+{
+    fold(f, &prof.tree);
+    return 1;
+}
+
+static void free_tree(struct prof_tree *node)
+{
+    while (node)
+    {
+        struct prof_tree *next = node->next;
+        free_tree(node->child);
+        free(node);
+        node = next;
+    }
+}
+
+void profile_free(void)
+{
+    free_tree(prof.tree.child);
+    for (int i = 0; i < prof.nfunks; i++)
+        free(prof.funks[i]);
+    free(prof.funks);
+    free(prof.lines);
+    free(prof.starts);
+    free(prof.frames);
+    memset(&prof, 0, sizeof(prof));
+}
@@ -0,0 +1,41 @@
+#ifndef _PROFILE_H
+#define _PROFILE_H
+#include <stdio.h>
+#include "my_calc.h"
+
+// Execution profiler for --profile
+//
+// Counts calls, self and inclusive time and node evaluations per funk and per
+// source line. A line is entered when a node starts on another line than the
+// one running in the current funk, a funk when a call runs its body. Inclusive
+// time only counts the outermost activation of a recursive funk or line.
+// The evaluator only tests `profiling` while it is off.
+
+extern int profiling;
+
+// Where the evaluation of a node entered a line, for profile_leave_node
+struct prof_mark
+{
+    int pushed;
+};
+
+// Start profiling a program of source text, returns 1
+int profile_start(const char *text);
+// Stop the clock of the whole program
+void profile_stop(void);
+
+void profile_enter_node(struct ast *ast, struct prof_mark *m);
+void profile_leave_node(struct prof_mark *m);
+
+// Around the body of funk (or builtin) name
+void profile_enter_funk(const char *name, unsigned int hash);
+void profile_leave_funk(void);
+
+// Funks and lines sorted by self time
+void profile_report(FILE *f);
+// One `main;caller;callee self_us` line per call stack, for flamegraph tools
+int profile_folded(FILE *f);
+
+void profile_free(void);
+
+#endif /* _PROFILE_H */
@@ -0,0 +1,395 @@
+#include "reduce.h"
+#include "builtins.h"
+#include "callstack.h"
+#include "fuel.h"
+#include "loopopt.h"
+#include "mem.h"
+#include "profile.h"
+#include "sampler.h"
+#include "stats.h"
+#include "str.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int reduce_threads = 0;
+
+static const char *op_names[] = {"+", "*", "min", "max"};
+
+// Chunks of a worker not taken yet, next << 32 | end : the owner takes next, a thief end - 1
+struct share
+{
+    atomic_ulong span;
+    // one share per cache line
+    char pad[64 - sizeof(atomic_ulong)];
+};
+
+struct job
+{
+    // the caller, only read while the workers run
+    struct scope *s;
+    int op;
+    long lo;
+    long n;
+    long nchunks;
+    // value of every chunk, by the worker that ran it
+    value *partials;
+    struct share *shares;
+    int nworkers;
+    // what the workers copy : funks[0] is the funk reduced
+    struct def_entry **funks;
+    int nfunks;
+    struct def_entry **vars;
+    int nvars;
+    atomic_int failed;
+    // message of the first runtime error of a worker thread, the caller reports it
+    _Atomic(char *) error;
+};
+
+struct worker
+{
+    struct job *job;
+    int id;
+    pthread_t thread;
+    int started;
+};
+
+void reduce_configure(int threads)
+{
+    reduce_threads = threads;
+}
+
+int reduce_op(const char *name)
+{
+    for (int i = 0; i < (int)(sizeof(op_names) / sizeof(op_names[0])); i++)
+    {
+        if (!strcmp(op_names[i], name))
+            return i;
+    }
+
+    return -1;
+}
+
+// acc op v, consumes both. min and max keep the first of equal values.
+static value combine(int op, value acc, value v)
+{
+    if (op == REDUCE_ADD)
+        return val_add(acc, v);
+    if (op == REDUCE_MUL)
+        return val_mul(acc, v);
+
+    int c = val_cmp(v, acc);
+    if (op == REDUCE_MIN ? c < 0 : c > 0)
+    {
+        val_drop(acc);
+        return v;
+    }
+
+    val_drop(v);
+    return acc;
+}
+
+// op over funk(lo) ... funk(hi - 1) called in s, hi > lo
+static int reduce_chunk(struct ast *funk, struct scope *s, int op, long lo, long hi, value *acc)
+{
+    for (long i = lo; i < hi; i++)
+    {
+        value arg = VAL_SMALL(i);
+        if (call_funk(funk, s, &arg) != EVAL_OK)
+            return 0;
+
+        value v = val_take(&s->current_val);
+        *acc = i == lo ? v : combine(op, *acc, v);
+    }
+
+    return 1;
+}
+
+static long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// The first calls of [lo, hi) on the calling thread, until they took REDUCE_SERIAL_NS,
+// the clock read after 1, 2, 4 ... calls. Returns the first call not made, -1 when a
+// call failed.
+static long reduce_head(struct ast *funk, struct scope *s, int op, long lo, long hi, value *acc)
+{
+    long start = now_ns();
+    long i = lo;
+
+    while (i < hi && ((i - lo) & (i - lo - 1) || now_ns() - start < REDUCE_SERIAL_NS))
+    {
+        value v;
+        if (!reduce_chunk(funk, s, op, i, i + 1, &v))
+            return -1;
+
+        *acc = i == lo ? v : combine(op, *acc, v);
+        i++;
+    }
+
+    return i;
+}
+
+// First of chunk k, chunks differ by one call at most
+static long chunk_start(struct job *j, long k)
+{
+    return j->lo + j->n / j->nchunks * k + (k < j->n % j->nchunks ? k : j->n % j->nchunks);
+}
+
+static long take_next(struct share *sh)
+{
+    unsigned long span = atomic_load(&sh->span);
+    while ((span >> 32) < (span & 0xffffffff))
+    {
+        if (atomic_compare_exchange_weak(&sh->span, &span, span + (1UL << 32)))
+            return span >> 32;
+    }
+
+    return -1;
+}
+
+static long take_last(struct share *sh)
+{
+    unsigned long span = atomic_load(&sh->span);
+    while ((span >> 32) < (span & 0xffffffff))
+    {
+        if (atomic_compare_exchange_weak(&sh->span, &span, span - 1))
+            return (span & 0xffffffff) - 1;
+    }
+
+    return -1;
+}
+
+// A chunk of the share of w, or stolen from the next worker that has one left
+static long take_chunk(struct worker *w)
+{
+    struct job *j = w->job;
+    long k = take_next(&j->shares[w->id]);
+
+    for (int i = 1; k < 0 && i < j->nworkers; i++)
+        k = take_last(&j->shares[(w->id + i) % j->nworkers]);
+
+    return k;
+}
+
+static void *work(void *arg)
+{
+    struct worker *w = arg;
+    struct job *j = w->job;
+
+    struct scope s;
+    init_scope(&s);
+    register_builtins(&s);
+    // the first worker goes on with the calls of the caller
+    if (w->id)
+        callstack_start();
+
+    for (int i = 0; i < j->nvars; i++)
+    {
+        struct def_entry *e = putdef(&s, j->vars[i]->name, j->vars[i]->hash);
+        e->type = _int;
+        e->val.intval = val_copy(j->vars[i]->val.intval);
+    }
+
+    struct ast **copies = mem_calloc(MEM_AST, j->nfunks, sizeof(struct ast *));
+    for (int i = 0; i < j->nfunks; i++)
+    {
+        copies[i] = copy_ast(j->funks[i]->val.astptr);
+        optimize_loops(copies[i], 0);
+
+        struct def_entry *e = putdef(&s, j->funks[i]->name, j->funks[i]->hash);
+        e->type = _func;
+        e->val.astptr = copies[i];
+    }
+
+    long k;
+    while (!atomic_load(&j->failed) && (k = take_chunk(w)) >= 0)
+    {
+        if (!reduce_chunk(copies[0], &s, j->op, chunk_start(j, k), chunk_start(j, k + 1), &j->partials[k]))
+            atomic_store(&j->failed, 1);
+    }
+
+    val_drop(s.current_val);
+    clean_scope(&s);
+    if (w->id)
+    {
+        callstack_end();
+        // the caller reports the first error, the fuel of this thread ends with it
+        char *none = NULL;
+        if (fuel.error && atomic_compare_exchange_strong(&j->error, &none, fuel.error))
+            fuel.error = NULL;
+        fuel_end();
+    }
+    for (int i = 0; i < j->nfunks; i++)
+    {
+        clean_ast(copies[i]);
+        mem_free(MEM_AST, copies[i]);
+    }
+    mem_free(MEM_AST, copies);
+
+    return NULL;
+}
+
+static int has_def(struct def_entry **defs, int n, struct def_entry *e)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (defs[i] == e)
+            return 1;
+    }
+
+    return 0;
+}
+
+// The funks of s ast may call and the variables of s they may read
+static void gather(struct job *j, struct ast *ast)
+{
+    struct def_entry *e = NULL;
+    if (ast->type == _funccall || ast->type == _var || ast->type == _index)
+        e = getdef_hashed(j->s, ast->val.strval, ast_hash(ast));
+
+    if (e && ast->type == _funccall && e->type == _func && !e->builtin && !has_def(j->funks, j->nfunks, e))
+    {
+        j->funks = reallocarray(j->funks, j->nfunks + 1, sizeof(struct def_entry *));
+        j->funks[j->nfunks++] = e;
+        gather(j, e->val.astptr->edges[1]);
+    }
+    else if (e && ast->type != _funccall && e->type == _int && !has_def(j->vars, j->nvars, e))
+    {
+        j->vars = reallocarray(j->vars, j->nvars + 1, sizeof(struct def_entry *));
+        j->vars[j->nvars++] = e;
+    }
+
+    for (int i = 0; i < ast->size; i++)
+        gather(j, ast->edges[i]);
+}
+
+// The chunks of j on nworkers threads, their values combined in order into *acc
+static int run_workers(struct job *j, struct def_entry *f, value *acc)
+{
+    j->funks = malloc(sizeof(struct def_entry *));
+    j->funks[j->nfunks++] = f;
+    gather(j, f->val.astptr->edges[1]);
+
+    j->partials = mem_calloc(MEM_ARGS, j->nchunks, sizeof(value));
+    j->shares = calloc(j->nworkers, sizeof(struct share));
+    struct worker *workers = calloc(j->nworkers, sizeof(struct worker));
+
+    for (int i = 0; i < j->nworkers; i++)
+    {
+        unsigned long first = j->nchunks * i / j->nworkers, end = j->nchunks * (i + 1) / j->nworkers;
+        atomic_init(&j->shares[i].span, first << 32 | end);
+        workers[i].job = j;
+        workers[i].id = i;
+    }
+
+    // the first worker is the calling thread, the chunks of a worker that did not
+    // start are stolen by the others
+    pthread_attr_t attr;
+    callstack_attr(&attr);
+    for (int i = 1; i < j->nworkers; i++)
+        workers[i].started = !pthread_create(&workers[i].thread, &attr, work, &workers[i]);
+    pthread_attr_destroy(&attr);
+    work(&workers[0]);
+    for (int i = 1; i < j->nworkers; i++)
+    {
+        if (workers[i].started)
+            pthread_join(workers[i].thread, NULL);
+    }
+
+    int ok = !atomic_load(&j->failed);
+    for (long k = 0; k < j->nchunks; k++)
+    {
+        if (ok)
+            *acc = k ? combine(j->op, *acc, j->partials[k]) : j->partials[k];
+        else
+            val_drop(j->partials[k]);
+    }
+
+    mem_free(MEM_ARGS, j->partials);
+    free(j->shares);
+    free(workers);
+    free(j->funks);
+    free(j->vars);
+    return ok;
+}
+
+int reduce_range(struct scope *s, struct def_entry *f, value lo, value hi, value op)
+{
+    char buf[STR_INLINE + 1];
+    int o = val_is_str(op) ? reduce_op(str_bytes(op, buf)) : -1;
+    if (o < 0)
+    {
+        val_fail("reduce op is \"+\", \"*\", \"min\" or \"max\"");
+        return 0;
+    }
+    if (!val_is_small(lo) || !val_is_small(hi))
+    {
+        val_fail("reduce expects a range of ints");
+        return 0;
+    }
+
+    long n = val_untag(hi) - val_untag(lo);
+    if (n <= 0 && (o == REDUCE_MIN || o == REDUCE_MAX))
+    {
+        val_fail(o == REDUCE_MIN ? "reduce min of an empty range" : "reduce max of an empty range");
+        return 0;
+    }
+    if (n <= 0)
+    {
+        val_assign(&s->current_val, VAL_SMALL(o == REDUCE_MUL));
+        return 1;
+    }
+
+    long threads = reduce_threads ? reduce_threads : sysconf(_SC_NPROCESSORS_ONLN);
+
+    value acc = 0;
+    int ok;
+    if (threads <= 1 || n == 1 || profiling || sampling || stats_enabled || mem_tracking || fuel_limited)
+    {
+        ok = reduce_chunk(f->val.astptr, s, o, val_untag(lo), val_untag(hi), &acc);
+    }
+    else
+    {
+        // a short range is done before the workers would have started
+        long mid = reduce_head(f->val.astptr, s, o, val_untag(lo), val_untag(hi), &acc);
+        ok = mid >= 0;
+        n = val_untag(hi) - mid;
+        if (threads > n)
+            threads = n;
+
+        if (ok && n > 0)
+        {
+            // a worker failing may end the program, what was printed goes first
+            out_flush(&s->out);
+
+            struct job j = {s, o, mid, n, n < threads * REDUCE_CHUNKS ? n : threads * REDUCE_CHUNKS};
+            j.nworkers = threads;
+            atomic_init(&j.failed, 0);
+            atomic_init(&j.error, NULL);
+            value rest = 0;
+            ok = run_workers(&j, f, &rest);
+            if (ok)
+                acc = mid > val_untag(lo) ? combine(o, acc, rest) : rest;
+            // the error of another thread stops the run of this one
+            char *error = atomic_load(&j.error);
+            if (error)
+                fuel_fail(error);
+            free(error);
+        }
+    }
+
+    if (!ok)
+    {
+        val_drop(acc);
+        return 0;
+    }
+
+    val_assign(&s->current_val, acc);
+    return 1;
+}
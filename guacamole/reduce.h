@@ -0,0 +1,48 @@
+#ifndef _REDUCE_H
+#define _REDUCE_H
+#include "my_calc.h"
+
+// Parallel reductions
+//
+// reduce(f, lo, hi, op) is op ("+", "*", "min" or "max") over f(lo), f(lo + 1)
+// ... f(hi - 1). check_ast only lets through a funk of one arg that prints nothing
+// and assigns no variable of its caller, calling funks that do the same, so the
+// calls are independent. The range is cut in REDUCE_CHUNKS chunks per worker
+// thread, each worker taking the chunks of its share first, then stealing the
+// last chunks of another one. Reference counts are not atomic, so a worker runs
+// copies of f, of the funks it calls and of the variables they read, in a scope
+// of its own. The value of each chunk is kept and they are combined in the order
+// of the range once every worker is done, so the result does not depend on the
+// number of threads. The calling thread makes the first calls itself, and only
+// starts the workers on what is left after REDUCE_SERIAL_NS: a short reduction
+// never pays for them.
+//
+// With --profile, --sample, --stats or --mem-stats, whose counters are shared,
+// and with a budget (fuel.h), the reduction runs on the calling thread.
+
+// Chunks per worker, more balance the load better, fewer cost less to combine
+#define REDUCE_CHUNKS 8
+
+// Time the calling thread spends on the first calls before the workers start
+#define REDUCE_SERIAL_NS 500000
+
+enum reduce_op
+{
+    REDUCE_ADD,
+    REDUCE_MUL,
+    REDUCE_MIN,
+    REDUCE_MAX,
+};
+
+// Worker threads of a reduction, 0 for one per CPU
+void reduce_configure(int threads);
+
+// The op named name, -1 when there is none
+int reduce_op(const char *name);
+
+// op over the calls to [lo, hi) of the funk defined by f in s, the scope of the
+// caller. The value is left in s->current_val, lo, hi and op are borrowed.
+// Returns 0 when a call failed.
+int reduce_range(struct scope *s, struct def_entry *f, value lo, value hi, value op);
+
+#endif /* _REDUCE_H */
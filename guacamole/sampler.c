@@ -0,0 +1,370 @@
+#include "sampler.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define RING_SIZE 4096
+
+int sampling = 0;
+struct shadow_stack shadow;
+
+// One SIGPROF, frames innermost first
+struct sample
+{
+    struct ast *node;
+    int depth;
+    int nframes;
+    struct ast *frames[SAMPLE_FRAMES];
+};
+
+// Single producer (the handler), single consumer (sampler_drain) ring
+static struct sample *ring;
+static atomic_ulong ring_head;
+static atomic_ulong ring_tail;
+static atomic_ulong dropped;
+
+struct funk_count
+{
+    const char *name;
+    unsigned int hash;
+    long self;
+    long incl;
+    // last sample counted in incl, so recursion counts once
+    long seen;
+};
+
+struct node_count
+{
+    struct ast *node;
+    long samples;
+};
+
+static struct
+{
+    int hz;
+    const char *text;
+    int *starts;
+    int nlines;
+    long samples;
+    long script_self;
+    long *lines;
+    struct funk_count *funks;
+    int nfunks;
+    // open addressing on the node address, cap is a power of 2
+    struct node_count *nodes;
+    int nodes_cap;
+    int nodes_count;
+} smp;
+
+static void on_sigprof(int sig)
+{
+    (void)sig;
+    unsigned long head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    unsigned long tail = atomic_load_explicit(&ring_tail, memory_order_acquire);
+
+    if (head - tail == RING_SIZE)
+    {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    struct sample *smpl = &ring[head & (RING_SIZE - 1)];
+    int depth = shadow.depth;
+    int recorded = depth < SHADOW_MAX ? depth : SHADOW_MAX;
+
+    smpl->node = shadow.node;
+    smpl->depth = depth;
+    smpl->nframes = recorded < SAMPLE_FRAMES ? recorded : SAMPLE_FRAMES;
+    for (int i = 0; i < smpl->nframes; i++)
+        smpl->frames[i] = shadow.calls[recorded - 1 - i];
+
+    atomic_store_explicit(&ring_head, head + 1, memory_order_release);
+    if (head + 1 - tail >= RING_SIZE / 2)
+        shadow.full = 1;
+}
+
+static struct funk_count *funk_count(struct ast *call)
+{
+    const char *name = call->val.strval;
+    unsigned int hash = ast_hash(call);
+
+    for (int i = 0; i < smp.nfunks; i++)
+    {
+        if (smp.funks[i].hash == hash && !strcmp(smp.funks[i].name, name))
+            return &smp.funks[i];
+    }
+
+    smp.funks = reallocarray(smp.funks, smp.nfunks + 1, sizeof(struct funk_count));
+    struct funk_count *fc = &smp.funks[smp.nfunks++];
+    memset(fc, 0, sizeof(*fc));
+    fc->name = name;
+    fc->hash = hash;
+    fc->seen = -1;
+
+    return fc;
+}
+
+static struct node_count *node_count(struct ast *node)
+{
+    if ((smp.nodes_count + 1) * 2 > smp.nodes_cap)
+    {
+        struct node_count *old = smp.nodes;
+        int old_cap = smp.nodes_cap;
+
+        smp.nodes_cap = old_cap ? old_cap * 2 : 256;
+        smp.nodes = calloc(smp.nodes_cap, sizeof(struct node_count));
+        smp.nodes_count = 0;
+        for (int i = 0; i < old_cap; i++)
+        {
+            if (old[i].node)
+            {
+                *node_count(old[i].node) = old[i];
+            }
+        }
+        free(old);
+    }
+
+    unsigned long mask = smp.nodes_cap - 1;
+    unsigned long i = ((uintptr_t)node >> 4) * 2654435761u & mask;
+    while (smp.nodes[i].node && smp.nodes[i].node != node)
+        i = (i + 1) & mask;
+
+    if (!smp.nodes[i].node)
+    {
+        smp.nodes[i].node = node;
+        smp.nodes_count += 1;
+    }
+
+    return &smp.nodes[i];
+}
+
+static void count_sample(struct sample *smpl)
+{
+    smp.samples += 1;
+
+    if (smpl->node)
+    {
+        node_count(smpl->node)->samples += 1;
+        if (smpl->node->line >= 1 && smpl->node->line <= smp.nlines)
+            smp.lines[smpl->node->line - 1] += 1;
+    }
+
+    if (!smpl->depth)
+        smp.script_self += 1;
+    else if (smpl->nframes)
+        funk_count(smpl->frames[0])->self += 1;
+
+    for (int i = 0; i < smpl->nframes; i++)
+    {
+        struct funk_count *fc = funk_count(smpl->frames[i]);
+        if (fc->seen != smp.samples)
+        {
+            fc->seen = smp.samples;
+            fc->incl += 1;
+        }
+    }
+}
+
+void sampler_drain(void)
+{
+    shadow.full = 0;
+
+    unsigned long head = atomic_load_explicit(&ring_head, memory_order_acquire);
+    unsigned long tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+
+    for (; tail != head; tail++)
+        count_sample(&ring[tail & (RING_SIZE - 1)]);
+
+    atomic_store_explicit(&ring_tail, tail, memory_order_release);
+}
+
+int sampler_start(int hz, const char *text)
+{
+    smp.hz = hz;
+    smp.text = text;
+    smp.starts = line_starts(text, &smp.nlines);
+    smp.lines = calloc(smp.nlines, sizeof(long));
+
+    ring = calloc(RING_SIZE, sizeof(struct sample));
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigprof;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+
+    long usec = hz < 1000000 ? 1000000L / hz : 1;
+    struct itimerval it;
+    it.it_interval.tv_sec = usec / 1000000;
+    it.it_interval.tv_usec = usec % 1000000;
+    it.it_value = it.it_interval;
+
+    sampling = 1;
+    if (sigaction(SIGPROF, &sa, NULL) || setitimer(ITIMER_PROF, &it, NULL))
+    {
+        sampling = 0;
+        return 0;
+    }
+
+    return 1;
+}
+
+void sampler_stop(void)
+{
+    struct itimerval it;
+    memset(&it, 0, sizeof(it));
+    setitimer(ITIMER_PROF, &it, NULL);
+    // a SIGPROF still pending would terminate the process
+    signal(SIGPROF, SIG_IGN);
+
+    sampling = 0;
+    sampler_drain();
+}
+
+static int by_self(const void *a, const void *b)
+{
+    const struct funk_count *x = a;
+    const struct funk_count *y = b;
+
+    if (x->self != y->self)
+        return x->self < y->self ? 1 : -1;
+
+    return strcmp(x->name, y->name);
+}
+
+static int by_samples(const void *a, const void *b)
+{
+    const struct node_count *x = a;
+    const struct node_count *y = b;
+
+    if (x->samples != y->samples)
+        return x->samples < y->samples ? 1 : -1;
+
+    return x->node && y->node ? x->node->begin - y->node->begin : 0;
+}
+
+struct line_count
+{
+    int line;
+    long samples;
+};
+
+static int by_line_samples(const void *a, const void *b)
+{
+    const struct line_count *x = a;
+    const struct line_count *y = b;
+
+    if (x->samples != y->samples)
+        return x->samples < y->samples ? 1 : -1;
+
+    return x->line - y->line;
+}
+
+static const char *type_name(struct ast *node)
+{
+    static const char *names[] = {"", "args", "call", "assign", "const", "unary", "var", "math", "comp",
+                                  "funk", "block", "while", "logic", "compound", "control", "index",
+                                  "array"};
+
+    return node->type < sizeof(names) / sizeof(*names) ? names[node->type] : "?";
+}
+
+// Text from begin to end on one line, at most width chars
+static void print_text(FILE *f, int begin, int end, int width)
+{
+    int n = 0;
+    int space = 0;
+
+    for (int i = begin; i < end && smp.text[i] && n < width; i++)
+    {
+        char c = smp.text[i];
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+        {
+            space = n > 0;
+            continue;
+        }
+
+        if (space)
+        {
+            fputc(' ', f);
+            n += 1;
+            space = 0;
+        }
+        fputc(c, f);
+        n += 1;
+    }
+
+    fputs(n >= width ? "...\n" : "\n", f);
+}
+
+static void print_line(FILE *f, int line, int width)
+{
+    int begin = smp.starts[line - 1];
+    int end = begin + strcspn(smp.text + begin, "\n");
+    print_text(f, begin, end, width);
+}
+
+#define SAMPLER_TOP 20
+
+void sampler_report(FILE *f)
+{
+    long total = smp.samples;
+    double pct = total ? 100.0 / total : 0;
+
+    fprintf(f, "\nSamples : %ld at %d Hz (%.1f ms of CPU time), %lu dropped\n", total, smp.hz,
+            total * 1000.0 / smp.hz, atomic_load(&dropped));
+
+    qsort(smp.funks, smp.nfunks, sizeof(struct funk_count), by_self);
+    fprintf(f, "\n%8s %6s %8s %6s  %s\n", "self", "%", "incl", "%", "funk");
+    fprintf(f, "%8ld %6.1f %8ld %6.1f  %s\n", smp.script_self, smp.script_self * pct, total, total * pct,
+            "(script)");
+    for (int i = 0; i < smp.nfunks; i++)
+    {
+        fprintf(f, "%8ld %6.1f %8ld %6.1f  %s\n", smp.funks[i].self, smp.funks[i].self * pct, smp.funks[i].incl,
+                smp.funks[i].incl * pct, smp.funks[i].name);
+    }
+
+    struct line_count *rows = calloc(smp.nlines, sizeof(struct line_count));
+    int n = 0;
+    for (int i = 0; i < smp.nlines; i++)
+    {
+        if (smp.lines[i])
+        {
+            rows[n].line = i + 1;
+            rows[n++].samples = smp.lines[i];
+        }
+    }
+    qsort(rows, n, sizeof(struct line_count), by_line_samples);
+
+    fprintf(f, "\n%8s %6s  %s\n", "samples", "%", "line");
+    for (int i = 0; i < n && i < SAMPLER_TOP; i++)
+    {
+        fprintf(f, "%8ld %6.1f  %5d: ", rows[i].samples, rows[i].samples * pct, rows[i].line);
+        print_line(f, rows[i].line, 56);
+    }
+    free(rows);
+
+    qsort(smp.nodes, smp.nodes_cap, sizeof(struct node_count), by_samples);
+    fprintf(f, "\n%8s %6s  %s\n", "samples", "%", "node");
+    for (int i = 0; i < smp.nodes_cap && smp.nodes[i].samples && i < SAMPLER_TOP; i++)
+    {
+        struct ast *node = smp.nodes[i].node;
+        int col = node->begin - smp.starts[node->line - 1] + 1;
+
+        fprintf(f, "%8ld %6.1f  %5d:%-3d %-9s ", smp.nodes[i].samples, smp.nodes[i].samples * pct, node->line, col,
+                type_name(node));
+        // operator nodes span their operator only, show the rest of the line
+        print_text(f, node->begin, node->begin + strcspn(smp.text + node->begin, "\n"), 40);
+    }
+}
+
+void sampler_free(void)
+{
+    free(ring);
+    free(smp.starts);
+    free(smp.lines);
+    free(smp.funks);
+    free(smp.nodes);
+    memset(&smp, 0, sizeof(smp));
+}
@@ -0,0 +1,78 @@
+#ifndef _SAMPLER_H
+#define _SAMPLER_H
+#include <signal.h>
+#include <stdio.h>
+#include "my_calc.h"
+
+// Sampling profiler for --sample
+//
+// SIGPROF fires every 1 / hz seconds of CPU time. The handler copies the node
+// being evaluated and the shadow stack of funk calls the evaluator keeps into a
+// lock-free ring, the evaluator drains it into counters once it is half full,
+// and the counters become a hot-spot report at exit. Funks run by the JIT are
+// sampled at their call. The evaluator only tests `sampling` while it is off.
+
+#define SAMPLER_DEFAULT_HZ 1000
+// Innermost funk calls kept by a sample
+#define SAMPLE_FRAMES 32
+// Calls deeper than this are counted but not recorded
+#define SHADOW_MAX 4096
+
+extern int sampling;
+
+// Written by the evaluator, read by the signal handler
+struct shadow_stack
+{
+    struct ast *volatile node;
+    volatile int depth;
+    struct ast *calls[SHADOW_MAX];
+    // set by the handler when the ring needs draining
+    volatile sig_atomic_t full;
+};
+
+extern struct shadow_stack shadow;
+
+void sampler_drain(void);
+
+// Node ast starts being evaluated, returns the node to restore after it
+static inline struct ast *sample_enter(struct ast *ast)
+{
+    struct ast *outer = shadow.node;
+    shadow.node = ast;
+    if (shadow.full)
+        sampler_drain();
+
+    return outer;
+}
+
+static inline void sample_leave(struct ast *outer)
+{
+    shadow.node = outer;
+}
+
+// Around the body of the funk called by call (a _funccall)
+static inline void sample_push(struct ast *call)
+{
+    if (shadow.depth < SHADOW_MAX)
+        shadow.calls[shadow.depth] = call;
+    // the handler must not see the new depth before the frame
+    __atomic_signal_fence(__ATOMIC_RELEASE);
+    shadow.depth += 1;
+}
+
+static inline void sample_pop(void)
+{
+    shadow.depth -= 1;
+}
+
+// Start sampling hz times per second of CPU time, text is the program source.
+// Returns 0 when the timer cannot be set.
+int sampler_start(int hz, const char *text);
+void sampler_stop(void);
+
+// Funks, lines and nodes sorted by samples
+void sampler_report(FILE *f);
+
+void sampler_free(void);
+
+#endif /* _SAMPLER_H */
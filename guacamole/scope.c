@@ -0,0 +1,254 @@
+#include "scope.h"
+#include "mem.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCOPE_MIN_CAP 16
+
+_Thread_local struct scope_stats scope_stats;
+
+static atomic_ulong last_epoch;
+
+unsigned long new_epoch(void)
+{
+    return atomic_fetch_add_explicit(&last_epoch, 1, memory_order_relaxed) + 1;
+}
+
+unsigned int hash_name(const char *name)
+{
+    unsigned int h = 2166136261u;
+
+    for (; *name; name++)
+    {
+        h ^= (unsigned char)*name;
+        h *= 16777619u;
+    }
+
+    return h ? h : 1;
+}
+
+void init_scope(struct scope *s)
+{
+    s->defs.slots = mem_calloc(MEM_DEFS, SCOPE_MIN_CAP, sizeof(struct def_entry));
+    scope_stats.tables += 1;
+    scope_stats.table_bytes += SCOPE_MIN_CAP * sizeof(struct def_entry);
+    s->defs.cap = SCOPE_MIN_CAP;
+    s->defs.count = 0;
+    s->current_val = 0;
+    s->journal = NULL;
+    s->epoch = new_epoch();
+    out_open(&s->out, stdout);
+    in_open(&s->in, stdin);
+}
+
+void clean_scope(struct scope *s)
+{
+    out_close(&s->out);
+    in_close(&s->in);
+
+    for (int i = 0; i < s->defs.cap; i++)
+    {
+        if (s->defs.slots[i].name && s->defs.slots[i].type == _int)
+            val_drop(s->defs.slots[i].val.intval);
+    }
+
+    mem_free(MEM_DEFS, s->defs.slots);
+    s->defs.slots = NULL;
+    s->defs.cap = 0;
+    s->defs.count = 0;
+}
+
+static struct def_entry *probe(struct def_table *t, const char *name, unsigned int hash)
+{
+    unsigned int mask = t->cap - 1;
+    unsigned int i = hash & mask;
+    long probes = 1;
+
+    while (t->slots[i].name)
+    {
+        if (t->slots[i].hash == hash && (t->slots[i].name == name || !strcmp(t->slots[i].name, name)))
+            break;
+        i = (i + 1) & mask;
+        probes += 1;
+    }
+
+    scope_stats.lookups += 1;
+    scope_stats.probes += probes;
+
+    return &t->slots[i];
+}
+
+static void grow(struct def_table *t)
+{
+    struct def_table old = *t;
+
+    t->cap = old.cap * 2;
+    t->slots = mem_calloc(MEM_DEFS, t->cap, sizeof(struct def_entry));
+    scope_stats.tables += 1;
+    scope_stats.table_bytes += t->cap * sizeof(struct def_entry);
+
+    for (int i = 0; i < old.cap; i++)
+    {
+        if (old.slots[i].name)
+            *probe(t, old.slots[i].name, old.slots[i].hash) = old.slots[i];
+    }
+
+    mem_free(MEM_DEFS, old.slots);
+}
+
+struct def_entry *getdef_hashed(struct scope *s, const char *name, unsigned int hash)
+{
+    struct def_entry *e = probe(&s->defs, name, hash);
+
+    return e->name ? e : NULL;
+}
+
+struct def_entry *getdef(struct scope *s, const char *name)
+{
+    return getdef_hashed(s, name, hash_name(name));
+}
+
+static void journal_push(struct def_journal *j, struct def_entry *e, int existed)
+{
+    if (j->size == j->cap)
+    {
+        j->cap = j->cap ? j->cap * 2 : SCOPE_MIN_CAP;
+        j->log = mem_reallocarray(MEM_DEFS, j->log, j->cap, sizeof(struct def_undo));
+    }
+
+    // the caller may drop the value it replaces, the journal keeps its own reference
+    if (existed && e->type == _int)
+        val_ref(e->val.intval);
+    j->log[j->size++] = (struct def_undo){e->name, e->hash, existed, e->type, e->val, e->builtin};
+}
+
+struct def_entry *putdef(struct scope *s, const char *name, unsigned int hash)
+{
+    struct def_entry *e = probe(&s->defs, name, hash);
+
+    if (e->name)
+    {
+        if (s->journal && s->journal->all)
+            journal_push(s->journal, e, 1);
+        return e;
+    }
+
+    // keep load factor under 3/4 so probe sequences stay short
+    if ((s->defs.count + 1) * 4 > s->defs.cap * 3)
+    {
+        grow(&s->defs);
+        e = probe(&s->defs, name, hash);
+    }
+
+    e->name = name;
+    e->hash = hash;
+    e->type = __;
+    s->defs.count += 1;
+
+    if (s->journal)
+        journal_push(s->journal, e, 0);
+
+    return e;
+}
+
+// Backward shift deletion, the entries after e in its probe run move up so none is cut off
+static void remove_entry(struct def_table *t, struct def_entry *e)
+{
+    unsigned int mask = t->cap - 1;
+    unsigned int hole = e - t->slots;
+
+    for (unsigned int i = (hole + 1) & mask; t->slots[i].name; i = (i + 1) & mask)
+    {
+        unsigned int home = t->slots[i].hash & mask;
+        // entry i may fill the hole unless its home lies cyclically in (hole, i]
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            t->slots[hole] = t->slots[i];
+            hole = i;
+        }
+    }
+
+    memset(&t->slots[hole], 0, sizeof(struct def_entry));
+    t->count -= 1;
+}
+
+void journal_begin(struct scope *s, struct def_journal *j, int all)
+{
+    j->size = 0;
+    j->all = all;
+    j->outer = s->journal;
+    s->journal = j;
+    scope_stats.journals += 1;
+}
+
+void journal_def(struct scope *s, const char *name, unsigned int hash)
+{
+    struct def_entry *e = probe(&s->defs, name, hash);
+
+    // putdef records it when it creates it, or when the journal records everything
+    if (e->name && !s->journal->all)
+        journal_push(s->journal, e, 1);
+}
+
+int journal_end(struct scope *s, int undo)
+{
+    struct def_journal *j = s->journal;
+    int funks = 0;
+
+    for (int i = j->size - 1; i >= 0; i--)
+    {
+        struct def_undo *u = &j->log[i];
+
+        if (!undo)
+        {
+            if (u->existed && u->type == _int)
+                val_drop(u->val.intval);
+            continue;
+        }
+
+        struct def_entry *e = probe(&s->defs, u->name, u->hash);
+        funks |= e->type == _func || u->type == _func;
+        if (e->type == _int)
+            val_drop(e->val.intval);
+
+        if (!u->existed)
+        {
+            remove_entry(&s->defs, e);
+            continue;
+        }
+
+        // the reference of the journal moves back to the entry
+        e->type = u->type;
+        e->val = u->val;
+        e->builtin = u->builtin;
+    }
+
+    if (undo)
+        scope_stats.undone += j->size;
+    j->size = 0;
+    s->journal = j->outer;
+
+    return funks;
+}
+
+void free_journal(struct def_journal *j)
+{
+    mem_free(MEM_DEFS, j->log);
+    j->log = NULL;
+    j->cap = 0;
+}
+
+struct def_entry *nextdef(struct scope *s, struct def_entry *prev)
+{
+    struct def_entry *end = s->defs.slots + s->defs.cap;
+    struct def_entry *e = prev ? prev + 1 : s->defs.slots;
+
+    for (; e < end; e++)
+    {
+        if (e->name)
+            return e;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,128 @@
+#ifndef _SCOPE_H
+#define _SCOPE_H
+#include <stdio.h>
+#include "bigint.h"
+#include "in.h"
+#include "out.h"
+
+struct ast;
+struct builtin;
+
+union Definition
+{
+    // an int or an array
+    value intval;
+    struct ast *astptr;
+};
+
+typedef enum
+{
+    __,
+    _int,
+    _func,
+} dltype;
+
+// Variable & Function definition, one slot of the scope table
+// name is borrowed (AST or builtin table), never owned by the scope
+struct def_entry
+{
+    const char *name;
+    unsigned int hash;
+    dltype type;
+    union Definition val;
+    const struct builtin *builtin;
+};
+
+// Open-addressing (linear probing) table, cap is a power of 2
+struct def_table
+{
+    struct def_entry *slots;
+    int cap;
+    int count;
+};
+
+// Entry as it was before a change, to undo it
+struct def_undo
+{
+    const char *name;
+    unsigned int hash;
+    int existed;
+    dltype type;
+    union Definition val;
+    const struct builtin *builtin;
+};
+
+// Changes of a scope that can be undone : a funk body checked or a call run in
+// the scope of its caller, a REPL input that fails its check
+struct def_journal
+{
+    struct def_undo *log;
+    int size;
+    int cap;
+    // record the entries putdef returns, not only those it creates
+    int all;
+    struct def_journal *outer;
+};
+
+// Scope for evalutation functions and variables
+struct scope
+{
+    struct def_table defs;
+    // last value evaluated, owned by the scope
+    value current_val;
+    // innermost journal, NULL when no change is recorded
+    struct def_journal *journal;
+    // changes with the funks defined, call targets and JIT code of another epoch are stale
+    unsigned long epoch;
+    // where print and println write, stdout after init_scope
+    struct out out;
+    // where read_int and eof read, stdin after init_scope
+    struct in in;
+};
+
+// Counters for --stats, since the start of the thread
+struct scope_stats
+{
+    // getdef / putdef lookups and entries compared by them
+    long lookups;
+    long probes;
+    // definition tables allocated (new or grown) and their bytes
+    long tables;
+    long table_bytes;
+    // journals begun and changes they undid
+    long journals;
+    long undone;
+};
+
+extern _Thread_local struct scope_stats scope_stats;
+
+// FNV-1a of name, never 0 so 0 can mean "not computed yet"
+unsigned int hash_name(const char *name);
+
+// Epoch never handed out before, by any thread
+unsigned long new_epoch(void);
+
+void init_scope(struct scope *s);
+// releases the definitions, current_val is left to the caller
+void clean_scope(struct scope *s);
+
+// Definition of name or NULL
+struct def_entry *getdef(struct scope *s, const char *name);
+struct def_entry *getdef_hashed(struct scope *s, const char *name, unsigned int hash);
+
+// Definition of name, created empty (type __) when missing
+struct def_entry *putdef(struct scope *s, const char *name, unsigned int hash);
+
+// Start recording the changes of s into j (zeroed or used before), inside the current journal
+void journal_begin(struct scope *s, struct def_journal *j, int all);
+// The entry of name is restored when the journal is undone, even if it already exists
+void journal_def(struct scope *s, const char *name, unsigned int hash);
+// Stop recording, undoing the changes newest first when undo is set. Returns 1
+// when a funk definition was removed or restored.
+int journal_end(struct scope *s, int undo);
+void free_journal(struct def_journal *j);
+
+// Iterate definitions : for (e = nextdef(s, NULL); e; e = nextdef(s, e))
+struct def_entry *nextdef(struct scope *s, struct def_entry *prev);
+
+#endif /* _SCOPE_H */
@@ -0,0 +1,131 @@
+#include "stats.h"
+#include "scope.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+_Thread_local struct run_stats run_stats;
+int stats_enabled = 0;
+
+static const char *phase_names[PHASE_COUNT] = {"readfile", "readlang", "check_ast", "eval"};
+
+// Accumulated wall and CPU nanoseconds of each phase, start of the running one
+static _Thread_local long phase_wall[PHASE_COUNT];
+static _Thread_local long phase_cpu[PHASE_COUNT];
+static _Thread_local long start_wall[PHASE_COUNT];
+static _Thread_local long start_cpu[PHASE_COUNT];
+
+// Calls by funk name, names borrowed from the AST
+struct call_count
+{
+    const char *name;
+    unsigned int hash;
+    long calls;
+};
+
+static _Thread_local struct call_count *calls;
+static _Thread_local int ncalls;
+
+static long clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void stats_begin(enum stats_phase phase)
+{
+    start_wall[phase] = clock_ns(CLOCK_MONOTONIC);
+    start_cpu[phase] = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void stats_end(enum stats_phase phase)
+{
+    phase_wall[phase] += clock_ns(CLOCK_MONOTONIC) - start_wall[phase];
+    phase_cpu[phase] += clock_ns(CLOCK_PROCESS_CPUTIME_ID) - start_cpu[phase];
+}
+
+void stats_count_call(const char *name, unsigned int hash)
+{
+    run_stats.funk_calls += 1;
+    for (int i = 0; i < ncalls; i++)
+    {
+        if (calls[i].hash == hash && !strcmp(calls[i].name, name))
+        {
+            calls[i].calls += 1;
+            return;
+        }
+    }
+
+    calls = reallocarray(calls, ncalls + 1, sizeof(struct call_count));
+    calls[ncalls].name = name;
+    calls[ncalls].hash = hash;
+    calls[ncalls].calls = 1;
+    ncalls += 1;
+}
+
+static int by_calls(const void *a, const void *b)
+{
+    const struct call_count *x = a;
+    const struct call_count *y = b;
+
+    if (x->calls != y->calls)
+        return x->calls < y->calls ? 1 : -1;
+
+    return strcmp(x->name, y->name);
+}
+
+void stats_print(FILE *f, struct parser *p)
+{
+    fprintf(f, "\n%-12s %12s %12s\n", "phase", "wall ms", "cpu ms");
+    for (int i = 0; i < PHASE_COUNT; i++)
+        fprintf(f, "%-12s %12.3f %12.3f\n", phase_names[i], phase_wall[i] / 1e6, phase_cpu[i] / 1e6);
+
+    fprintf(f, "\n");
+    fprintf(f, "%-24s %12ld\n", "ast nodes built", run_stats.ast_built);
+    fprintf(f, "%-24s %12ld\n", "ast nodes discarded", run_stats.ast_discarded);
+    fprintf(f, "%-24s %12ld\n", "capture lookups", p->lookups);
+    fprintf(f, "%-24s %12ld\n", "capture comparisons", p->lookup_steps);
+    fprintf(f, "%-24s %12ld\n", "getdef calls", scope_stats.lookups);
+    fprintf(f, "%-24s %12ld\n", "getdef comparisons", scope_stats.probes);
+    fprintf(f, "%-24s %12ld\n", "def tables allocated", scope_stats.tables);
+    fprintf(f, "%-24s %12ld\n", "def table bytes", scope_stats.table_bytes);
+    fprintf(f, "%-24s %12ld\n", "scope journals", scope_stats.journals);
+    fprintf(f, "%-24s %12ld\n", "definitions undone", scope_stats.undone);
+    fprintf(f, "%-24s %12ld\n", "funk calls", run_stats.funk_calls);
+
+    qsort(calls, ncalls, sizeof(struct call_count), by_calls);
+    for (int i = 0; i < ncalls; i++)
+        fprintf(f, "  %-22s %12ld\n", calls[i].name, calls[i].calls);
+}
+
+void stats_print_json(FILE *f, struct parser *p)
+{
+    fprintf(f, "{\"phases\":{");
+    for (int i = 0; i < PHASE_COUNT; i++)
+    {
+        fprintf(f, "%s\"%s\":{\"wall_ms\":%.3f,\"cpu_ms\":%.3f}", i ? "," : "", phase_names[i],
+                phase_wall[i] / 1e6, phase_cpu[i] / 1e6);
+    }
+
+    fprintf(f, "},\"ast_built\":%ld,\"ast_discarded\":%ld", run_stats.ast_built, run_stats.ast_discarded);
+    fprintf(f, ",\"capture_lookups\":%ld,\"capture_comparisons\":%ld", p->lookups, p->lookup_steps);
+    fprintf(f, ",\"getdef_calls\":%ld,\"getdef_comparisons\":%ld", scope_stats.lookups, scope_stats.probes);
+    fprintf(f, ",\"def_tables\":%ld,\"def_table_bytes\":%ld", scope_stats.tables, scope_stats.table_bytes);
+    fprintf(f, ",\"scope_journals\":%ld,\"definitions_undone\":%ld", scope_stats.journals, scope_stats.undone);
+    fprintf(f, ",\"funk_calls\":%ld,\"calls\":{", run_stats.funk_calls);
+
+    // names are identifiers, nothing to escape
+    qsort(calls, ncalls, sizeof(struct call_count), by_calls);
+    for (int i = 0; i < ncalls; i++)
+        fprintf(f, "%s\"%s\":%ld", i ? "," : "", calls[i].name, calls[i].calls);
+
+    fprintf(f, "}}\n");
+}
+
+void stats_free(void)
+{
+    free(calls);
+    calls = NULL;
+    ncalls = 0;
+}
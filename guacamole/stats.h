@@ -0,0 +1,45 @@
+#ifndef _STATS_H
+#define _STATS_H
+#include <stdio.h>
+#include "my_parser.h"
+
+// Phase timings and runtime counters for --stats
+//
+// Wall and CPU time of each phase, AST nodes built and dropped by backtracking,
+// funk calls by name, plus the counters kept by the parser and the scopes.
+// Counters belong to the thread that runs the program.
+
+enum stats_phase
+{
+    PHASE_READFILE,
+    PHASE_READLANG,
+    PHASE_CHECK,
+    PHASE_EVAL,
+    PHASE_COUNT,
+};
+
+struct run_stats
+{
+    long ast_built;
+    long ast_discarded;
+    long funk_calls;
+};
+
+extern _Thread_local struct run_stats run_stats;
+// funk calls are only counted by name when set
+extern int stats_enabled;
+
+void stats_begin(enum stats_phase phase);
+void stats_end(enum stats_phase phase);
+
+// Call of funk (or builtin) name, its string must outlive the report
+void stats_count_call(const char *name, unsigned int hash);
+
+// Report of phases and counters, p is the parser of the program
+void stats_print(FILE *f, struct parser *p);
+// Same as one JSON object on one line
+void stats_print_json(FILE *f, struct parser *p);
+
+void stats_free(void);
+
+#endif /* _STATS_H */
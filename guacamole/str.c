@@ -0,0 +1,223 @@
+#include "str.h"
+#include "mem.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Initial slots of a literal table, a power of two
+#define POOL_SLOTS 64
+
+struct str_pool
+{
+    long slots;
+    long used;
+    // 0 for a free slot
+    value *strings;
+};
+
+static struct string *new_string(long size, long cap)
+{
+    struct string *s = mem_malloc(MEM_STRINGS, sizeof(struct string) + cap + 1);
+    if (!s)
+        val_die("out of memory");
+
+    s->refs = 1;
+    s->size = size;
+    s->cap = cap;
+    s->data[size] = 0;
+    return s;
+}
+
+static value wrap(struct string *s)
+{
+    return (value)((uintptr_t)s + 5);
+}
+
+static int is_inline(value v)
+{
+    return (v & 7) == 7;
+}
+
+// Inline string of the n <= STR_INLINE bytes of s, unused bytes are zero
+static value inline_of(const char *s, long n)
+{
+    uintptr_t w = 0;
+    for (long i = n - 1; i >= 0; i--)
+        w = w << 8 | (unsigned char)s[i];
+
+    return (value)(w << 8 | n << 3 | 7);
+}
+
+value str_new(const char *s, long n)
+{
+    if (n <= STR_INLINE)
+        return inline_of(s, n);
+
+    struct string *str = new_string(n, n);
+    memcpy(str->data, s, n);
+    return wrap(str);
+}
+
+long str_len(value v)
+{
+    if (is_inline(v))
+        return (v & 0xff) >> 3;
+
+    return val_string(v)->size;
+}
+
+const char *str_bytes(value v, char *buf)
+{
+    if (!is_inline(v))
+        return val_string(v)->data;
+
+    long n = str_len(v);
+    uintptr_t w = (uintptr_t)v >> 8;
+    for (long i = 0; i < n; i++, w >>= 8)
+        buf[i] = (char)(w & 0xff);
+    buf[n] = 0;
+
+    return buf;
+}
+
+value str_concat(value a, value b)
+{
+    if (!val_is_str(a) || !val_is_str(b))
+    {
+        val_drop(a);
+        val_drop(b);
+        val_fail("only strings can be added to strings");
+        return 0;
+    }
+
+    char ba[STR_INLINE + 1], bb[STR_INLINE + 1];
+    long an = str_len(a), bn = str_len(b), n = an + bn;
+    const char *y = str_bytes(b, bb);
+
+    // the only reference : nobody else can see the buffer change
+    if (!is_inline(a) && val_string(a)->refs == 1 && val_string(a)->cap >= n)
+    {
+        struct string *s = val_string(a);
+        memcpy(s->data + an, y, bn);
+        s->data[n] = 0;
+        s->size = n;
+        val_drop(b);
+        return a;
+    }
+
+    const char *x = str_bytes(a, ba);
+    value r;
+    if (n <= STR_INLINE)
+    {
+        char buf[STR_INLINE];
+        memcpy(buf, x, an);
+        memcpy(buf + an, y, bn);
+        r = inline_of(buf, n);
+    }
+    else
+    {
+        // a string that grew once is likely to grow again
+        struct string *s = new_string(n, is_inline(a) ? n : n + n / 2);
+        memcpy(s->data, x, an);
+        memcpy(s->data + an, y, bn);
+        r = wrap(s);
+    }
+
+    val_drop(a);
+    val_drop(b);
+    return r;
+}
+
+int str_cmp(value a, value b)
+{
+    char ba[STR_INLINE + 1], bb[STR_INLINE + 1];
+    long an = str_len(a), bn = str_len(b);
+    int c = memcmp(str_bytes(a, ba), str_bytes(b, bb), an < bn ? an : bn);
+
+    if (c)
+        return c < 0 ? -1 : 1;
+
+    return (an > bn) - (an < bn);
+}
+
+int str_fprint(FILE *f, value v)
+{
+    char buf[STR_INLINE + 1];
+    long n = str_len(v);
+
+    return fwrite(str_bytes(v, buf), 1, n, f) == (size_t)n ? (int)n : -1;
+}
+
+// LITERAL TABLE
+
+// FNV-1a
+static unsigned long hash_of(const char *s, long n)
+{
+    unsigned long h = 14695981039346656037UL;
+    for (long i = 0; i < n; i++)
+        h = (h ^ (unsigned char)s[i]) * 1099511628211UL;
+
+    return h;
+}
+
+struct str_pool *str_pool_new(void)
+{
+    struct str_pool *pool = mem_malloc(MEM_STRINGS, sizeof(struct str_pool));
+    pool->slots = POOL_SLOTS;
+    pool->used = 0;
+    pool->strings = mem_calloc(MEM_STRINGS, POOL_SLOTS, sizeof(value));
+    return pool;
+}
+
+static void pool_grow(struct str_pool *pool)
+{
+    long slots = pool->slots * 2;
+    value *strings = mem_calloc(MEM_STRINGS, slots, sizeof(value));
+
+    for (long i = 0; i < pool->slots; i++)
+    {
+        value v = pool->strings[i];
+        if (!v)
+            continue;
+
+        struct string *s = val_string(v);
+        long j = hash_of(s->data, s->size) & (slots - 1);
+        while (strings[j])
+            j = (j + 1) & (slots - 1);
+        strings[j] = v;
+    }
+
+    mem_free(MEM_STRINGS, pool->strings);
+    pool->strings = strings;
+    pool->slots = slots;
+}
+
+value str_intern(struct str_pool *pool, const char *s, long n)
+{
+    // inline strings are equal words already
+    if (n <= STR_INLINE)
+        return inline_of(s, n);
+
+    if (2 * (pool->used + 1) > pool->slots)
+        pool_grow(pool);
+
+    long i = hash_of(s, n) & (pool->slots - 1);
+    for (; pool->strings[i]; i = (i + 1) & (pool->slots - 1))
+    {
+        struct string *str = val_string(pool->strings[i]);
+        if (str->size == n && !memcmp(str->data, s, n))
+            return val_ref(pool->strings[i]);
+    }
+
+    pool->strings[i] = str_new(s, n);
+    pool->used += 1;
+    return val_ref(pool->strings[i]);
+}
+
+void str_pool_free(struct str_pool *pool)
+{
+    for (long i = 0; i < pool->slots; i++)
+        val_drop(pool->strings[i]);
+
+    mem_free(MEM_STRINGS, pool->strings);
+    mem_free(MEM_STRINGS, pool);
+}
@@ -0,0 +1,54 @@
+#ifndef _STR_H
+#define _STR_H
+#include "bigint.h"
+
+// Strings
+//
+// A string is a value like an int. Up to STR_INLINE bytes it lives in the word
+// itself : the low byte is 111 with the length above, the bytes follow, so short
+// strings are never allocated and two equal ones are the same word. Longer ones
+// end in binary 101 and point (plus 5) to a reference counted buffer. Strings
+// are immutable to the program : `s = s + t` appends in place when s holds the
+// only reference and the buffer has room, otherwise the buffer is copied first.
+//
+// Literals are interned while a program is parsed, the same text anywhere in it
+// is one buffer, so comparing two of them stops at the pointers.
+
+#define STR_INLINE ((int)sizeof(value) - 1)
+
+struct string
+{
+    int refs;
+    long size;
+    long cap;
+    // NUL terminated
+    char data[];
+};
+
+static inline struct string *val_string(value v)
+{
+    return (struct string *)(uintptr_t)(v - 5);
+}
+
+// String of the n bytes of s
+value str_new(const char *s, long n);
+
+long str_len(value v);
+// Bytes of v, copied to buf when it is inline (buf holds STR_INLINE + 1 bytes), NUL terminated
+const char *str_bytes(value v, char *buf);
+
+// a + b, consumes both, one of them must be a string
+value str_concat(value a, value b);
+// -1, 0 or 1 comparing the bytes of a and b, then their lengths. Both must be strings.
+int str_cmp(value a, value b);
+int str_fprint(FILE *f, value v);
+
+// Literal table, one reference per distinct string
+struct str_pool;
+
+struct str_pool *str_pool_new(void);
+// The pooled string equal to the n bytes of s, a new reference
+value str_intern(struct str_pool *pool, const char *s, long n);
+void str_pool_free(struct str_pool *pool);
+
+#endif /* _STR_H */